@@ -0,0 +1,318 @@
+/**
+ *  Sphere: the JavaScript game platform
+ *  Copyright (c) 2015-2025, Where'd She Go?
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of Spherical nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+
+// the asset cache lets repeated loads of the same file share a single decoded
+// object rather than decoding the file again.  entries are keyed on the fully
+// resolved path along with the file's size and modification time, so a file
+// which is rewritten by the game is picked up again on the next load.
+// the cache holds a reference to every object in it; once nothing else is
+// using an object, it becomes eligible for eviction, least recently used first,
+// whenever the total size of cached objects goes over budget.
+
+#include "neosphere.h"
+#include "asset_cache.h"
+
+#include "audio.h"
+#include "image.h"
+#include "package.h"
+#include "spriteset.h"
+
+struct entry
+{
+	int64_t      file_size;
+	unsigned int last_used;
+	time_t       mtime;
+	void*        object;
+	char*        path;
+	size_t       size;
+	cache_type_t type;
+	int          variant;
+};
+
+static void         evict_entry     (int index);
+static int          find_entry      (cache_type_t type, const char* path, int variant);
+static bool         identify_file   (const char* filename, char* *out_path, time_t *out_mtime, int64_t *out_size);
+static unsigned int object_refcount (const struct entry* entry);
+static void         trim_to_budget  (void);
+
+static size_t       s_budget;
+static size_t       s_bytes_used = 0;
+static unsigned int s_clock = 0;
+static vector_t*    s_entries = NULL;
+static unsigned int s_num_evictions = 0;
+static unsigned int s_num_hits = 0;
+static unsigned int s_num_misses = 0;
+
+void
+asset_cache_init(size_t budget)
+{
+	console_log(1, "initializing asset cache");
+	console_log(1, "    budget: %.1f MiB", budget / 1048576.0);
+
+	s_entries = vector_new(sizeof(struct entry));
+	s_budget = budget;
+}
+
+void
+asset_cache_uninit(void)
+{
+	console_log(1, "shutting down asset cache");
+	console_log(2, "    objects cached: %d (%.1f MiB)",
+		s_entries != NULL ? vector_len(s_entries) : 0, s_bytes_used / 1048576.0);
+	console_log(2, "    cache hits: %u", s_num_hits);
+	console_log(2, "    cache misses: %u", s_num_misses);
+	console_log(2, "    evictions: %u", s_num_evictions);
+
+	if (s_entries == NULL)
+		return;
+	while (vector_len(s_entries) > 0)
+		evict_entry(0);
+	vector_free(s_entries);
+	s_entries = NULL;
+}
+
+void*
+asset_cache_get(cache_type_t type, const char* filename, int variant)
+{
+	struct entry* entry;
+	int64_t       file_size;
+	int           index;
+	time_t        mtime;
+	char*         path;
+
+	if (s_entries == NULL)
+		return NULL;
+
+	if (!identify_file(filename, &path, &mtime, &file_size))
+		return NULL;
+	index = find_entry(type, path, variant);
+	free(path);
+	if (index < 0) {
+		++s_num_misses;
+		return NULL;
+	}
+	entry = vector_get(s_entries, index);
+	if (entry->mtime != mtime || entry->file_size != file_size) {
+		// the file has changed since it was cached, so the cached copy is stale.
+		// anyone still holding a reference keeps the old object.
+		console_log(2, "asset cache: '%s' changed on disk, reloading", filename);
+		evict_entry(index);
+		++s_num_misses;
+		return NULL;
+	}
+	entry->last_used = ++s_clock;
+	++s_num_hits;
+	switch (type) {
+	case CACHE_FONT:
+		return font_ref(entry->object);
+	case CACHE_IMAGE:
+		return image_ref(entry->object);
+	case CACHE_SAMPLE:
+		return sample_ref(entry->object);
+	case CACHE_SPRITESET:
+		return spriteset_ref(entry->object);
+	}
+	return NULL;
+}
+
+void
+asset_cache_put(cache_type_t type, const char* filename, int variant, void* object, size_t size)
+{
+	// note: the caller must already hold its own reference to `object`.  the
+	//       cache's reference alone makes it eligible for eviction, so trimming
+	//       to budget below would otherwise free it out from under the caller.
+	struct entry entry;
+	int          index;
+
+	if (s_entries == NULL || object == NULL)
+		return;
+
+	if (!identify_file(filename, &entry.path, &entry.mtime, &entry.file_size))
+		return;
+	if ((index = find_entry(type, entry.path, variant)) >= 0)
+		evict_entry(index);
+	switch (type) {
+	case CACHE_FONT:
+		entry.object = font_ref(object);
+		break;
+	case CACHE_IMAGE:
+		entry.object = image_ref(object);
+		break;
+	case CACHE_SAMPLE:
+		entry.object = sample_ref(object);
+		break;
+	case CACHE_SPRITESET:
+		entry.object = spriteset_ref(object);
+		break;
+	}
+	entry.type = type;
+	entry.variant = variant;
+	entry.size = size;
+	entry.last_used = ++s_clock;
+	vector_push(s_entries, &entry);
+	s_bytes_used += size;
+	trim_to_budget();
+}
+
+void
+asset_cache_stats(cache_stats_t *out_stats)
+{
+	out_stats->budget = s_budget;
+	out_stats->bytes_used = s_bytes_used;
+	out_stats->num_entries = s_entries != NULL ? vector_len(s_entries) : 0;
+	out_stats->num_evictions = s_num_evictions;
+	out_stats->num_hits = s_num_hits;
+	out_stats->num_misses = s_num_misses;
+}
+
+static void
+evict_entry(int index)
+{
+	struct entry* entry;
+
+	entry = vector_get(s_entries, index);
+	console_log(3, "asset cache: evicting '%s' (%zu bytes)", entry->path, entry->size);
+	switch (entry->type) {
+	case CACHE_FONT:
+		font_unref(entry->object);
+		break;
+	case CACHE_IMAGE:
+		image_unref(entry->object);
+		break;
+	case CACHE_SAMPLE:
+		sample_unref(entry->object);
+		break;
+	case CACHE_SPRITESET:
+		spriteset_unref(entry->object);
+		break;
+	}
+	s_bytes_used -= entry->size;
+	free(entry->path);
+	vector_remove(s_entries, index);
+}
+
+static int
+find_entry(cache_type_t type, const char* path, int variant)
+{
+	struct entry* entry;
+
+	iter_t iter;
+
+	iter = vector_enum(s_entries);
+	while ((entry = iter_next(&iter))) {
+		if (entry->type == type && entry->variant == variant
+			&& strcmp(entry->path, path) == 0)
+		{
+			return iter.index;
+		}
+	}
+	return -1;
+}
+
+static bool
+identify_file(const char* filename, char* *out_path, time_t *out_mtime, int64_t *out_size)
+{
+	ALLEGRO_FS_ENTRY* fs_entry;
+	package_t*        package;
+	path_t*           path;
+
+	if (g_game == NULL || !game_locate_file(g_game, filename, &path, &package))
+		return false;
+	if (package != NULL) {
+		// note: an SPK package can't change while the game is running, so for
+		//       packaged files the resolved path is all we need.
+		*out_mtime = 0;
+		*out_size = 0;
+		package_unref(package);
+	}
+	else {
+		fs_entry = al_create_fs_entry(path_cstr(path));
+		if (fs_entry == NULL || !al_fs_entry_exists(fs_entry)) {
+			if (fs_entry != NULL)
+				al_destroy_fs_entry(fs_entry);
+			path_free(path);
+			return false;
+		}
+		*out_mtime = al_get_fs_entry_mtime(fs_entry);
+		*out_size = al_get_fs_entry_size(fs_entry);
+		al_destroy_fs_entry(fs_entry);
+	}
+	*out_path = strdup(path_cstr(path));
+	path_free(path);
+	return true;
+}
+
+static unsigned int
+object_refcount(const struct entry* entry)
+{
+	switch (entry->type) {
+	case CACHE_FONT:
+		return font_refcount(entry->object);
+	case CACHE_IMAGE:
+		return image_refcount(entry->object);
+	case CACHE_SAMPLE:
+		return sample_refcount(entry->object);
+	case CACHE_SPRITESET:
+		return spriteset_refcount(entry->object);
+	}
+	return 0;
+}
+
+static void
+trim_to_budget(void)
+{
+	struct entry* entry;
+	int           lru_index;
+	unsigned int  lru_time;
+
+	iter_t iter;
+
+	while (s_bytes_used > s_budget) {
+		// only objects nobody else is using can be evicted; anything still in
+		// use stays put even if that means going over budget.
+		lru_index = -1;
+		lru_time = UINT_MAX;
+		iter = vector_enum(s_entries);
+		while ((entry = iter_next(&iter))) {
+			if (entry->last_used < lru_time && object_refcount(entry) <= 1) {
+				lru_index = iter.index;
+				lru_time = entry->last_used;
+			}
+		}
+		if (lru_index < 0)
+			break;
+		evict_entry(lru_index);
+		++s_num_evictions;
+	}
+}
@@ -0,0 +1,64 @@
+/**
+ *  Sphere: the JavaScript game platform
+ *  Copyright (c) 2015-2025, Where'd She Go?
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of Spherical nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+
+#ifndef NEOSPHERE_ASSET_CACHE_H_INCLUDED
+#define NEOSPHERE_ASSET_CACHE_H_INCLUDED
+
+typedef
+enum cache_type
+{
+	CACHE_FONT,
+	CACHE_IMAGE,
+	CACHE_SAMPLE,
+	CACHE_SPRITESET,
+} cache_type_t;
+
+typedef
+struct cache_stats
+{
+	size_t       budget;
+	size_t       bytes_used;
+	unsigned int num_entries;
+	unsigned int num_evictions;
+	unsigned int num_hits;
+	unsigned int num_misses;
+} cache_stats_t;
+
+void  asset_cache_init   (size_t budget);
+void  asset_cache_uninit (void);
+void* asset_cache_get    (cache_type_t type, const char* filename, int variant);
+void  asset_cache_put    (cache_type_t type, const char* filename, int variant, void* object, size_t size);
+void  asset_cache_stats  (cache_stats_t *out_stats);
+
+#endif // !NEOSPHERE_ASSET_CACHE_H_INCLUDED
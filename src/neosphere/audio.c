@@ -33,13 +33,23 @@
 #include "neosphere.h"
 #include "audio.h"
 
+#include "asset_cache.h"
+#include "ring.h"
+
+#define DEFAULT_MAX_VOICES 64
+
 struct mixer
 {
 	unsigned int   refcount;
 	unsigned int   id;
+	float          gain;
+	vector_t*      instances;
+	bool           is_busy;
+	int            max_voices;
+	unsigned int   next_serial;
 	ALLEGRO_MIXER* ptr;
+	voice_stats_t  stats;
 	ALLEGRO_VOICE* voice;
-	float          gain;
 };
 
 struct stream
@@ -47,9 +57,7 @@ struct stream
 	unsigned int          refcount;
 	unsigned int          id;
 	ALLEGRO_AUDIO_STREAM* ptr;
-	unsigned char*        buffer;
-	size_t                buffer_size;
-	size_t                feed_size;
+	ring_t*               buffer;
 	size_t                fragment_size;
 	mixer_t*              mixer;
 };
@@ -58,8 +66,6 @@ struct sound
 {
 	unsigned int          refcount;
 	unsigned int          id;
-	void*                 file_data;
-	size_t                file_size;
 	float                 gain;
 	bool                  is_looping;
 	mixer_t*              mixer;
@@ -76,31 +82,40 @@ struct sample
 	unsigned int    id;
 	float           gain;
 	float           pan;
+	sample_t*       parent;
 	char*           path;
 	bool            polyphonic;
+	int             priority;
 	float           speed;
 	ALLEGRO_SAMPLE* ptr;
 };
 
 struct sample_instance
 {
-	mixer_t*                 mixer;
+	int                      priority;
 	ALLEGRO_SAMPLE_INSTANCE* ptr;
 	sample_t*                sample;
+	unsigned int             serial;
 };
 
-static bool reload_sound  (sound_t* sound);
-static void update_stream (stream_t* stream);
+static struct sample_instance* acquire_voice (mixer_t* mixer, sample_t* sample);
+static void*                   feed_streams  (ALLEGRO_THREAD* thread, void* udata);
+static void                    release_voice (mixer_t* mixer, struct sample_instance* instance);
+static size_t                  sample_bytes  (const ALLEGRO_SAMPLE* ptr);
+static void                    update_stream (stream_t* stream);
 
-static vector_t*            s_active_samples;
+static vector_t*            s_busy_mixers;
 static vector_t*            s_active_sounds;
 static vector_t*            s_active_streams;
+static ALLEGRO_THREAD*      s_feeder_thread = NULL;
 static bool                 s_have_sound;
 static unsigned int         s_next_mixer_id = 1;
 static unsigned int         s_next_sample_id = 1;
 static unsigned int         s_next_sound_id = 1;
 static unsigned int         s_next_stream_id = 1;
 static unsigned int         s_num_refs = 0;
+static ALLEGRO_EVENT_QUEUE* s_stream_events = NULL;
+static ALLEGRO_MUTEX*       s_stream_mutex = NULL;
 
 void
 audio_init(void)
@@ -110,25 +125,36 @@ audio_init(void)
 
 	console_log(1, "initializing audio subsystem");
 
-	s_have_sound = true;
-	if (!al_install_audio()) {
-		s_have_sound = false;
+	// note: without sound, mixers are created silent and samples never get a
+	//       voice, but everything can still be loaded and played as usual so
+	//       games don't have to care.
+	s_have_sound = false;
+	if (g_headless)
+		console_log(1, "  audio is disabled in headless mode");
+	else if (!(s_have_sound = al_install_audio()))
 		console_log(1, "  audio is not available");
-		return;
-	}
 	al_init_acodec_addon();
-	s_active_samples = vector_new(sizeof(struct sample_instance));
+	s_busy_mixers = vector_new(sizeof(mixer_t*));
 	s_active_sounds = vector_new(sizeof(sound_t*));
 	s_active_streams = vector_new(sizeof(stream_t*));
+
+	// note: streams are fed from a thread of their own, so that a long frame on
+	//       the main thread doesn't cause them to run dry.
+	s_stream_mutex = al_create_mutex();
+	s_stream_events = al_create_event_queue();
+	if (s_have_sound && (s_feeder_thread = al_create_thread(feed_streams, NULL)))
+		al_start_thread(s_feeder_thread);
 }
 
 void
 audio_uninit(void)
 {
-	struct sample_instance* sample_instance;
+	struct sample_instance* instance;
+	mixer_t**               mixer_ptr;
 	sound_t**               sound_ptr;
 
 	iter_t iter;
+	iter_t iter2;
 
 	if (--s_num_refs > 0)
 		return;
@@ -139,18 +165,40 @@ audio_uninit(void)
 	while ((sound_ptr = iter_next(&iter)))
 		sound_unref(*sound_ptr);
 	vector_free(s_active_sounds);
-	iter = vector_enum(s_active_samples);
-	while ((sample_instance = iter_next(&iter))) {
-		al_destroy_sample_instance(sample_instance->ptr);
-		sample_unref(sample_instance->sample);
-		mixer_unref(sample_instance->mixer);
+	iter = vector_enum(s_busy_mixers);
+	while ((mixer_ptr = iter_next(&iter))) {
+		iter2 = vector_enum((*mixer_ptr)->instances);
+		while ((instance = iter_next(&iter2))) {
+			if (instance->sample != NULL)
+				release_voice(*mixer_ptr, instance);
+		}
+		(*mixer_ptr)->is_busy = false;
+		mixer_unref(*mixer_ptr);
 	}
-	vector_free(s_active_samples);
+	vector_free(s_busy_mixers);
+	if (s_feeder_thread != NULL)
+		al_destroy_thread(s_feeder_thread);
+	if (s_stream_events != NULL)
+		al_destroy_event_queue(s_stream_events);
+	if (s_stream_mutex != NULL)
+		al_destroy_mutex(s_stream_mutex);
+	s_feeder_thread = NULL;
+	s_stream_events = NULL;
+	s_stream_mutex = NULL;
 	vector_free(s_active_streams);
 	if (s_have_sound)
 		al_uninstall_audio();
 }
 
+void
+audio_get_stats(int* out_num_sounds, int* out_num_streams)
+{
+	*out_num_sounds = vector_len(s_active_sounds);
+	al_lock_mutex(s_stream_mutex);
+	*out_num_streams = vector_len(s_active_streams);
+	al_unlock_mutex(s_stream_mutex);
+}
+
 void
 audio_resume(void)
 {
@@ -182,27 +230,36 @@ audio_suspend(void)
 void
 audio_update(void)
 {
+	struct sample_instance* instance;
+	mixer_t*                mixer;
 	sound_t*                sound;
-	struct sample_instance* sample_instance;
-	stream_t**              stream_ptr;
 
 	iter_t iter;
+	iter_t iter2;
 
 	if (s_num_refs == 0)
 		return;
 
-	iter = vector_enum(s_active_streams);
-	while ((stream_ptr = iter_next(&iter)))
-		update_stream(*stream_ptr);
-
-	iter = vector_enum(s_active_samples);
-	while ((sample_instance = iter_next(&iter))) {
-		if (al_get_sample_instance_playing(sample_instance->ptr))
+	// note: finished voices stay attached to the mixer so they can be recycled
+	//       by a later sample_play(); they're only destroyed if the pool has
+	//       grown past the mixer's polyphony limit.
+	iter = vector_enum(s_busy_mixers);
+	while (iter_next(&iter)) {
+		mixer = *(mixer_t**)iter.ptr;
+		iter2 = vector_enum(mixer->instances);
+		while ((instance = iter_next(&iter2))) {
+			if (instance->sample != NULL && !al_get_sample_instance_playing(instance->ptr))
+				release_voice(mixer, instance);
+			if (instance->sample == NULL && vector_len(mixer->instances) > mixer->max_voices) {
+				al_destroy_sample_instance(instance->ptr);
+				iter_remove(&iter2);
+			}
+		}
+		if (mixer->stats.num_active > 0)
 			continue;
-		al_destroy_sample_instance(sample_instance->ptr);
-		sample_unref(sample_instance->sample);
-		mixer_unref(sample_instance->mixer);
+		mixer->is_busy = false;
 		iter_remove(&iter);
+		mixer_unref(mixer);
 	}
 
 	iter = vector_enum(s_active_sounds);
@@ -239,16 +296,22 @@ mixer_new(int frequency, int bits, int channels)
 
 	if (!(mixer = calloc(1, sizeof(mixer_t))))
 		goto on_error;
-	if (!(mixer->voice = al_create_voice(frequency, depth, conf)))
-		goto on_error;
-	if (!(mixer->ptr = al_create_mixer(frequency, ALLEGRO_AUDIO_DEPTH_FLOAT32, conf)))
+	if (!(mixer->instances = vector_new(sizeof(struct sample_instance))))
 		goto on_error;
-	al_attach_mixer_to_voice(mixer->ptr, mixer->voice);
-	al_set_mixer_gain(mixer->ptr, 1.0);
-	al_set_voice_playing(mixer->voice, true);
-	al_set_mixer_playing(mixer->ptr, true);
+	mixer->gain = 1.0;
+	if (s_have_sound) {
+		if (!(mixer->voice = al_create_voice(frequency, depth, conf)))
+			goto on_error;
+		if (!(mixer->ptr = al_create_mixer(frequency, ALLEGRO_AUDIO_DEPTH_FLOAT32, conf)))
+			goto on_error;
+		al_attach_mixer_to_voice(mixer->ptr, mixer->voice);
+		al_set_mixer_gain(mixer->ptr, 1.0);
+		al_set_voice_playing(mixer->voice, true);
+		al_set_mixer_playing(mixer->ptr, true);
+		mixer->gain = al_get_mixer_gain(mixer->ptr);
+	}
 
-	mixer->gain = al_get_mixer_gain(mixer->ptr);
+	mixer->max_voices = DEFAULT_MAX_VOICES;
 	mixer->id = s_next_mixer_id++;
 	return mixer_ref(mixer);
 
@@ -259,6 +322,7 @@ on_error:
 			al_destroy_mixer(mixer->ptr);
 		if (mixer->voice != NULL)
 			al_destroy_voice(mixer->voice);
+		vector_free(mixer->instances);
 		free(mixer);
 	}
 	return NULL;
@@ -274,11 +338,25 @@ mixer_ref(mixer_t* mixer)
 void
 mixer_unref(mixer_t* mixer)
 {
+	struct sample_instance* instance;
+
+	iter_t iter;
+
 	if (mixer == NULL || --mixer->refcount > 0)
 		return;
 
 	console_log(3, "disposing mixer #%u no longer in use", mixer->id);
-	al_destroy_mixer(mixer->ptr);
+	console_log(3, "    voices: %u plays, %u reused, %u stolen, %u dropped, peak %d",
+		mixer->stats.num_plays, mixer->stats.num_reuses, mixer->stats.num_steals,
+		mixer->stats.num_drops, mixer->stats.peak_active);
+	iter = vector_enum(mixer->instances);
+	while ((instance = iter_next(&iter))) {
+		al_destroy_sample_instance(instance->ptr);
+		sample_unref(instance->sample);
+	}
+	vector_free(mixer->instances);
+	if (mixer->ptr != NULL)
+		al_destroy_mixer(mixer->ptr);
 	free(mixer);
 }
 
@@ -288,22 +366,64 @@ mixer_get_gain(mixer_t* mixer)
 	return mixer->gain;
 }
 
+int
+mixer_get_max_voices(const mixer_t* mixer)
+{
+	return mixer->max_voices;
+}
+
+void
+mixer_get_voice_stats(const mixer_t* mixer, voice_stats_t* out_stats)
+{
+	*out_stats = mixer->stats;
+	out_stats->max_voices = mixer->max_voices;
+	out_stats->num_voices = vector_len(mixer->instances);
+}
+
 void
 mixer_set_gain(mixer_t* mixer, float gain)
 {
-	al_set_mixer_gain(mixer->ptr, gain);
+	if (mixer->ptr != NULL)
+		al_set_mixer_gain(mixer->ptr, gain);
 	mixer->gain = gain;
 }
 
+void
+mixer_set_max_voices(mixer_t* mixer, int max_voices)
+{
+	struct sample_instance* instance;
+
+	iter_t iter;
+
+	mixer->max_voices = max_voices;
+
+	// trim idle voices right away.  any excess voices still playing are let
+	// finish and get trimmed by audio_update() afterwards.
+	iter = vector_enum(mixer->instances);
+	while ((instance = iter_next(&iter))) {
+		if (vector_len(mixer->instances) <= max_voices)
+			break;
+		if (instance->sample != NULL)
+			continue;
+		al_destroy_sample_instance(instance->ptr);
+		iter_remove(&iter);
+	}
+}
+
 sample_t*
 sample_new(const char* path, bool polyphonic)
 {
-	ALLEGRO_SAMPLE* al_sample;
+	ALLEGRO_SAMPLE* al_sample = NULL;
 	ALLEGRO_FILE*   file;
-	void*           file_data;
+	void*           file_data = NULL;
 	size_t          file_size;
 	sample_t*       sample = NULL;
 
+	if ((sample = asset_cache_get(CACHE_SAMPLE, path, polyphonic))) {
+		console_log(2, "using cached sample #%u for '%s'", sample->id, path);
+		return sample;
+	}
+
 	console_log(2, "loading sample #%u from '%s'", s_next_sample_id, path);
 
 	if (!(file_data = game_read_file(g_game, path, &file_size)))
@@ -311,6 +431,10 @@ sample_new(const char* path, bool polyphonic)
 	file = al_open_memfile(file_data, file_size, "rb");
 	al_sample = al_load_sample_f(file, strrchr(path, '.'));
 	al_fclose(file);
+	free(file_data);
+	file_data = NULL;
+	if (al_sample == NULL)
+		goto on_error;
 
 	if (!(sample = calloc(1, sizeof(sample_t))))
 		goto on_error;
@@ -321,14 +445,84 @@ sample_new(const char* path, bool polyphonic)
 	sample->gain = 1.0;
 	sample->pan = 0.0;
 	sample->speed = 1.0;
-	return sample_ref(sample);
+	sample_ref(sample);
+	asset_cache_put(CACHE_SAMPLE, path, polyphonic, sample, sample_bytes(al_sample));
+	return sample;
 
 on_error:
 	console_log(2, "    failed to load sample #%u", s_next_sample_id);
+	if (al_sample != NULL)
+		al_destroy_sample(al_sample);
+	free(file_data);
 	free(sample);
 	return NULL;
 }
 
+sample_t*
+sample_clone(sample_t* sample)
+{
+	sample_t* dolly;
+
+	// note: the clone shares its audio data with the original, but has its own
+	//       gain, pan, priority and speed settings.
+	console_log(2, "cloning sample #%u from source sample #%u", s_next_sample_id, sample->id);
+
+	if (!(dolly = calloc(1, sizeof(sample_t))))
+		return NULL;
+	dolly->id = s_next_sample_id++;
+	dolly->parent = sample_ref(sample);
+	dolly->path = strdup(sample->path);
+	dolly->ptr = sample->ptr;
+	dolly->polyphonic = sample->polyphonic;
+	dolly->gain = sample->gain;
+	dolly->pan = sample->pan;
+	dolly->priority = sample->priority;
+	dolly->speed = sample->speed;
+	return sample_ref(dolly);
+}
+
+sample_t*
+sample_from_data(void* decoded, const char* path, bool polyphonic)
+{
+	sample_t* sample = NULL;
+
+	// note: `decoded` comes from sample_decode(), normally on a worker thread.
+	console_log(2, "creating sample #%u decoded from '%s'", s_next_sample_id, path);
+
+	if (!(sample = calloc(1, sizeof(sample_t))))
+		goto on_error;
+	sample->id = s_next_sample_id++;
+	sample->path = strdup(path);
+	sample->ptr = decoded;
+	sample->polyphonic = polyphonic;
+	sample->gain = 1.0;
+	sample->pan = 0.0;
+	sample->speed = 1.0;
+	sample_ref(sample);
+	asset_cache_put(CACHE_SAMPLE, path, polyphonic, sample, sample_bytes(decoded));
+	return sample;
+
+on_error:
+	console_log(2, "    failed to create sample #%u", s_next_sample_id);
+	al_destroy_sample(decoded);
+	return NULL;
+}
+
+void*
+sample_decode(void* data, size_t size, const char* path)
+{
+	// note: this is called on a worker thread and takes ownership of `data`.
+	ALLEGRO_SAMPLE* al_sample = NULL;
+	ALLEGRO_FILE*   file;
+
+	if ((file = al_open_memfile(data, size, "rb"))) {
+		al_sample = al_load_sample_f(file, strrchr(path, '.'));
+		al_fclose(file);
+	}
+	free(data);
+	return al_sample;
+}
+
 sample_t*
 sample_ref(sample_t* sample)
 {
@@ -343,7 +537,10 @@ sample_unref(sample_t* sample)
 		return;
 
 	console_log(3, "disposing sample #%u no longer in use", sample->id);
-	al_destroy_sample(sample->ptr);
+	if (sample->parent == NULL)
+		al_destroy_sample(sample->ptr);
+	sample_unref(sample->parent);
+	free(sample->path);
 	free(sample);
 }
 
@@ -353,6 +550,12 @@ sample_path(const sample_t* sample)
 	return sample->path;
 }
 
+int
+sample_refcount(const sample_t* sample)
+{
+	return sample->refcount;
+}
+
 float
 sample_get_gain(const sample_t* sample)
 {
@@ -365,6 +568,12 @@ sample_get_pan(const sample_t* sample)
 	return sample->pan;
 }
 
+int
+sample_get_priority(const sample_t* sample)
+{
+	return sample->priority;
+}
+
 float
 sample_get_speed(const sample_t* sample)
 {
@@ -383,6 +592,12 @@ sample_set_pan(sample_t* sample, float pan)
 	sample->pan = pan;
 }
 
+void
+sample_set_priority(sample_t* sample, int priority)
+{
+	sample->priority = priority;
+}
+
 void
 sample_set_speed(sample_t* sample, float speed)
 {
@@ -392,68 +607,94 @@ sample_set_speed(sample_t* sample, float speed)
 void
 sample_play(sample_t* sample, mixer_t* mixer)
 {
-	struct sample_instance   instance;
-	ALLEGRO_SAMPLE_INSTANCE* stream_ptr;
+	struct sample_instance* instance;
 
 	console_log(2, "playing sample #%u on mixer #%u", sample->id, mixer->id);
 
 	if (!sample->polyphonic)
 		sample_stop_all(sample);
-	stream_ptr = al_create_sample_instance(sample->ptr);
-	al_set_sample_instance_gain(stream_ptr, sample->gain);
-	al_set_sample_instance_speed(stream_ptr, sample->speed);
-	al_set_sample_instance_pan(stream_ptr, sample->pan);
-	al_attach_sample_instance_to_mixer(stream_ptr, mixer->ptr);
-	al_play_sample_instance(stream_ptr);
-
-	instance.sample = sample_ref(sample);
-	instance.mixer = mixer_ref(mixer);
-	instance.ptr = stream_ptr;
-	vector_push(s_active_samples, &instance);
+	if (mixer->ptr == NULL || !(instance = acquire_voice(mixer, sample))) {
+		console_log(3, "    no voice available, sample #%u dropped", sample->id);
+		++mixer->stats.num_drops;
+		return;
+	}
+	al_set_sample_instance_gain(instance->ptr, sample->gain);
+	al_set_sample_instance_speed(instance->ptr, sample->speed);
+	al_set_sample_instance_pan(instance->ptr, sample->pan);
+	al_play_sample_instance(instance->ptr);
+
+	instance->priority = sample->priority;
+	instance->sample = sample_ref(sample);
+	instance->serial = mixer->next_serial++;
+	++mixer->stats.num_plays;
+	if (++mixer->stats.num_active > mixer->stats.peak_active)
+		mixer->stats.peak_active = mixer->stats.num_active;
+	if (!mixer->is_busy) {
+		mixer_ref(mixer);
+		vector_push(s_busy_mixers, &mixer);
+		mixer->is_busy = true;
+	}
 }
 
 void
 sample_stop_all(sample_t* sample)
 {
 	struct sample_instance* instance;
+	mixer_t**               mixer_ptr;
 
 	iter_t iter;
+	iter_t iter2;
 
 	console_log(2, "stopping all instances of sample #%u", sample->id);
-	iter = vector_enum(s_active_samples);
-	while ((instance = iter_next(&iter))) {
-		if (instance->sample != sample)
-			continue;
-		al_destroy_sample_instance(instance->ptr);
-		sample_unref(instance->sample);
-		mixer_unref(instance->mixer);
-		iter_remove(&iter);
+	iter = vector_enum(s_busy_mixers);
+	while ((mixer_ptr = iter_next(&iter))) {
+		iter2 = vector_enum((*mixer_ptr)->instances);
+		while ((instance = iter_next(&iter2))) {
+			if (instance->sample == sample)
+				release_voice(*mixer_ptr, instance);
+		}
 	}
 }
 
 sound_t*
 sound_new(const char* path)
 {
-	sound_t* sound;
+	ALLEGRO_FILE* file = NULL;
+	sound_t*      sound;
 
 	console_log(2, "loading sound #%u from '%s'", s_next_sound_id, path);
 
 	if (!(sound = calloc(1, sizeof(sound_t))))
 		goto on_error;
 	sound->path = strdup(path);
-
-	if (!(sound->file_data = game_read_file(g_game, sound->path, &sound->file_size)))
-		goto on_error;
 	sound->gain = 1.0;
 	sound->pan = 0.0;
 	sound->pitch = 1.0;
-	if (!reload_sound(sound))
+
+	// note: the file is streamed and decoded a few fragments at a time rather
+	//       than being read in all at once.  this keeps memory usage low even
+	//       for long music tracks, including those inside an SPK.
+	if (!(file = game_open_stream(g_game, path)))
 		goto on_error;
+	if (s_have_sound) {
+		if (!(sound->stream = al_load_audio_stream_f(file, strrchr(path, '.'), 4, 1024)))
+			goto on_error;
+		al_set_audio_stream_gain(sound->stream, sound->gain);
+		al_set_audio_stream_pan(sound->stream, sound->pan);
+		al_set_audio_stream_speed(sound->stream, sound->pitch);
+		al_set_audio_stream_playmode(sound->stream, ALLEGRO_PLAYMODE_ONCE);
+		al_set_audio_stream_playing(sound->stream, false);
+	}
+	else {
+		al_fclose(file);
+	}
 	sound->id = s_next_sound_id++;
 	return sound_ref(sound);
 
 on_error:
 	console_log(2, "    failed to load sound #%u", s_next_sound_id);
+	if (file != NULL)
+		al_fclose(file);
 	if (sound != NULL) {
 		free(sound->path);
 		free(sound);
@@ -475,7 +716,6 @@ sound_unref(sound_t* sound)
 		return;
 
 	console_log(3, "disposing sound #%u no longer in use", sound->id);
-	free(sound->file_data);
 	if (sound->stream != NULL)
 		al_destroy_audio_stream(sound->stream);
 	mixer_unref(sound->mixer);
@@ -662,15 +902,20 @@ stream_new(int frequency, int bits, int channels)
 		: bits == 32 ? 4
 		: 0;
 	stream->fragment_size = 1024 * sample_size * al_get_channel_count(conf);
-	stream->buffer_size = frequency * sample_size;  // 1 second
-	stream->buffer = malloc(stream->buffer_size);
+	if (!(stream->buffer = ring_new(frequency * sample_size * al_get_channel_count(conf))))  // 1 second
+		goto on_error;
 
 	stream->id = s_next_stream_id++;
+	al_lock_mutex(s_stream_mutex);
 	vector_push(s_active_streams, &stream);
+	al_unlock_mutex(s_stream_mutex);
+	al_register_event_source(s_stream_events, al_get_audio_stream_event_source(stream->ptr));
 	return stream_ref(stream);
 
 on_error:
 	console_log(2, "couldn't create stream #%u", s_next_stream_id++);
+	if (stream != NULL && stream->ptr != NULL)
+		al_destroy_audio_stream(stream->ptr);
 	free(stream);
 	return NULL;
 }
@@ -694,6 +939,7 @@ stream_unref(stream_t* stream)
 
 	console_log(3, "disposing stream #%u no longer in use", stream->id);
 
+	al_lock_mutex(s_stream_mutex);
 	iter = vector_enum(s_active_streams);
 	while ((stream_ptr = iter_next(&iter))) {
 		if (*stream_ptr == stream) {
@@ -701,11 +947,13 @@ stream_unref(stream_t* stream)
 			break;
 		}
 	}
+	al_unlock_mutex(s_stream_mutex);
+	al_unregister_event_source(s_stream_events, al_get_audio_stream_event_source(stream->ptr));
 
 	al_drain_audio_stream(stream->ptr);
 	al_destroy_audio_stream(stream->ptr);
 	mixer_unref(stream->mixer);
-	free(stream->buffer);
+	ring_free(stream->buffer);
 	free(stream);
 }
 
@@ -724,7 +972,7 @@ stream_length(const stream_t* stream)
 	num_channels = al_get_channel_count(channel_conf);
 	sample_size = al_get_audio_depth_size(depth_conf);
 
-	return (double)stream->feed_size / (frequency * num_channels * sample_size);
+	return (double)ring_len(stream->buffer) / (frequency * num_channels * sample_size);
 }
 
 mixer_t*
@@ -742,19 +990,23 @@ stream_playing(const stream_t* stream)
 void
 stream_buffer(stream_t* stream, const void* data, size_t size)
 {
-	size_t needed_size;
-
 	console_log(4, "buffering %zu bytes into stream #%u", size, stream->id);
 
-	needed_size = stream->feed_size + size;
-	if (needed_size > stream->buffer_size) {
-		// buffer is too small, double size until large enough
-		while (needed_size > stream->buffer_size)
-			stream->buffer_size *= 2;
-		stream->buffer = realloc(stream->buffer, stream->buffer_size);
+	// without sound there's no feeder thread to drain the buffer, so don't
+	// bother filling it.
+	if (s_feeder_thread == NULL)
+		return;
+
+	// note: the main thread is the only writer and the feeder thread the only
+	//       reader, so no locking is needed--unless the ring is too small for
+	//       the new data.  growing it moves everything around, so the feeder
+	//       has to be kept out while that happens.
+	if (size > ring_space(stream->buffer)) {
+		al_lock_mutex(s_stream_mutex);
+		ring_resize(stream->buffer, ring_len(stream->buffer) + size);
+		al_unlock_mutex(s_stream_mutex);
 	}
-	memcpy(stream->buffer + stream->feed_size, data, size);
-	stream->feed_size += size;
+	ring_write(stream->buffer, data, size);
 }
 
 void
@@ -774,6 +1026,8 @@ stream_play(stream_t* stream, mixer_t* mixer)
 	stream->mixer = mixer_ref(mixer);
 	mixer_unref(old_mixer);
 
+	if (stream->mixer->ptr == NULL)
+		return;
 	al_detach_audio_stream(stream->ptr);
 	al_attach_audio_stream_to_mixer(stream->ptr, stream->mixer->ptr);
 	al_set_audio_stream_playing(stream->ptr, true);
@@ -785,56 +1039,121 @@ stream_stop(stream_t* stream)
 	al_drain_audio_stream(stream->ptr);
 	mixer_unref(stream->mixer);
 	stream->mixer = NULL;
-	free(stream->buffer); stream->buffer = NULL;
-	stream->feed_size = 0;
+	al_lock_mutex(s_stream_mutex);
+	ring_clear(stream->buffer);
+	al_unlock_mutex(s_stream_mutex);
 }
 
-static bool
-reload_sound(sound_t* sound)
+static struct sample_instance*
+acquire_voice(mixer_t* mixer, sample_t* sample)
 {
-	// TODO: fold this back into sound_new() as it's not used anywhere else anymore.
-	//       it was originally needed to work around a bug where Allegro wouldn't play a
-	//       stream that had already played once, but that bug has since been fixed.
+	struct sample_instance* instance;
+	struct sample_instance  new_instance;
+	int                     victim_index = -1;
+	struct sample_instance* victim = NULL;
 
-	ALLEGRO_FILE*         memfile;
-	ALLEGRO_AUDIO_STREAM* new_stream = NULL;
-	int                   play_mode;
+	iter_t iter;
 
-	new_stream = NULL;
-	if (s_have_sound) {
-		memfile = al_open_memfile(sound->file_data, sound->file_size, "rb");
-		if (!(new_stream = al_load_audio_stream_f(memfile, strrchr(sound->path, '.'), 4, 1024)))
-			goto on_error;
+	// recycle an idle voice if there is one.  this avoids creating a new sample
+	// instance and attaching it to the mixer, which is expensive enough to
+	// matter for sounds like footsteps or gunfire that get played constantly.
+	iter = vector_enum(mixer->instances);
+	while ((instance = iter_next(&iter))) {
+		if (instance->sample == NULL) {
+			if (!al_set_sample(instance->ptr, sample->ptr)) {
+				al_destroy_sample_instance(instance->ptr);
+				iter_remove(&iter);
+				continue;
+			}
+			++mixer->stats.num_reuses;
+			return instance;
+		}
+		if (victim == NULL || instance->priority < victim->priority
+			|| (instance->priority == victim->priority && instance->serial < victim->serial))
+		{
+			victim = instance;
+			victim_index = iter.index;
+		}
 	}
-	if (s_have_sound && new_stream == NULL)
-		return false;
-	if (sound->stream != NULL)
-		al_destroy_audio_stream(sound->stream);
-	if ((sound->stream = new_stream) != NULL) {
-		play_mode = sound->is_looping ? ALLEGRO_PLAYMODE_LOOP : ALLEGRO_PLAYMODE_ONCE;
-		al_set_audio_stream_gain(sound->stream, sound->gain);
-		al_set_audio_stream_pan(sound->stream, sound->pan);
-		al_set_audio_stream_speed(sound->stream, sound->pitch);
-		al_set_audio_stream_playmode(sound->stream, play_mode);
-		al_set_audio_stream_playing(sound->stream, false);
+
+	// no idle voices, grow the pool if we're under the polyphony limit...
+	if (vector_len(mixer->instances) < mixer->max_voices) {
+		if (!(new_instance.ptr = al_create_sample_instance(sample->ptr)))
+			return NULL;
+		if (!al_attach_sample_instance_to_mixer(new_instance.ptr, mixer->ptr)) {
+			al_destroy_sample_instance(new_instance.ptr);
+			return NULL;
+		}
+		new_instance.sample = NULL;
+		if (!vector_push(mixer->instances, &new_instance)) {
+			al_destroy_sample_instance(new_instance.ptr);
+			return NULL;
+		}
+		return vector_get(mixer->instances, vector_len(mixer->instances) - 1);
 	}
-	return true;
 
-on_error:
-	return false;
+	// ...otherwise steal the oldest voice with the lowest priority, unless
+	// everything playing is more important than the new sound.
+	if (victim == NULL || victim->priority > sample->priority)
+		return NULL;
+	release_voice(mixer, victim);
+	if (!al_set_sample(victim->ptr, sample->ptr)) {
+		al_destroy_sample_instance(victim->ptr);
+		vector_remove(mixer->instances, victim_index);
+		return NULL;
+	}
+	++mixer->stats.num_steals;
+	return victim;
+}
+
+static void*
+feed_streams(ALLEGRO_THREAD* thread, void* udata)
+{
+	ALLEGRO_EVENT event;
+	stream_t**    stream_ptr;
+
+	iter_t iter;
+
+	while (!al_get_thread_should_stop(thread)) {
+		// Allegro posts an event whenever a stream has room for another fragment,
+		// but new data may well show up afterwards, so check back regularly too.
+		al_wait_for_event_timed(s_stream_events, &event, 0.005);
+		al_lock_mutex(s_stream_mutex);
+		iter = vector_enum(s_active_streams);
+		while ((stream_ptr = iter_next(&iter)))
+			update_stream(*stream_ptr);
+		al_unlock_mutex(s_stream_mutex);
+	}
+	return NULL;
+}
+
+static void
+release_voice(mixer_t* mixer, struct sample_instance* instance)
+{
+	al_stop_sample_instance(instance->ptr);
+	sample_unref(instance->sample);
+	instance->sample = NULL;
+	--mixer->stats.num_active;
+}
+
+static size_t
+sample_bytes(const ALLEGRO_SAMPLE* ptr)
+{
+	return al_get_sample_length(ptr)
+		* al_get_channel_count(al_get_sample_channels(ptr))
+		* al_get_audio_depth_size(al_get_sample_depth(ptr));
 }
 
 static void
 update_stream(stream_t* stream)
 {
-	void*  buffer;
+	// note: this runs on the feeder thread with `s_stream_mutex` held.
+	void* buffer;
 
-	if (stream->feed_size < stream->fragment_size)
-		return;
-	if (!(buffer = al_get_audio_stream_fragment(stream->ptr)))
-		return;
-	memcpy(buffer, stream->buffer, stream->fragment_size);
-	stream->feed_size -= stream->fragment_size;
-	memmove(stream->buffer, stream->buffer + stream->fragment_size, stream->feed_size);
-	al_set_audio_stream_fragment(stream->ptr, buffer);
+	while (ring_len(stream->buffer) >= stream->fragment_size) {
+		if (!(buffer = al_get_audio_stream_fragment(stream->ptr)))
+			break;
+		ring_read(stream->buffer, buffer, stream->fragment_size);
+		al_set_audio_stream_fragment(stream->ptr, buffer);
+	}
 }
@@ -38,57 +38,80 @@ typedef struct sample sample_t;
 typedef struct sound  sound_t;
 typedef struct stream stream_t;
 
-void        audio_init        (void);
-void        audio_uninit      (void);
-void        audio_resume      (void);
-void        audio_suspend     (void);
-void        audio_update      (void);
-mixer_t*    mixer_new         (int frequency, int bits, int channels);
-mixer_t*    mixer_ref         (mixer_t* mixer);
-void        mixer_unref       (mixer_t* mixer);
-float       mixer_get_gain    (mixer_t* mixer);
-void        mixer_set_gain    (mixer_t* mixer, float gain);
-sample_t*   sample_new        (const char* path, bool polyphonic);
-sample_t*   sample_ref        (sample_t* sample);
-void        sample_unref      (sample_t* sample);
-const char* sample_path       (const sample_t* sample);
-float       sample_get_gain   (const sample_t* sample);
-float       sample_get_pan    (const sample_t* sample);
-float       sample_get_speed  (const sample_t* sample);
-void        sample_set_gain   (sample_t* sample, float gain);
-void        sample_set_pan    (sample_t* sample, float pan);
-void        sample_set_speed  (sample_t* sample, float speed);
-void        sample_play       (sample_t* sample, mixer_t* mixer);
-void        sample_stop_all   (sample_t* sample);
-sound_t*    sound_new         (const char* path);
-sound_t*    sound_ref         (sound_t* sound);
-void        sound_unref       (sound_t* sound);
-float       sound_gain        (sound_t* sound);
-double      sound_len         (sound_t* sound);
-mixer_t*    sound_mixer       (sound_t* sound);
-float       sound_pan         (sound_t* sound);
-const char* sound_path        (const sound_t* sound);
-bool        sound_playing     (sound_t* sound);
-bool        sound_repeat      (sound_t* sound);
-float       sound_speed       (sound_t* sound);
-void        sound_set_gain    (sound_t* sound, float gain);
-void        sound_set_pan     (sound_t* sound, float pan);
-void        sound_set_repeat  (sound_t* sound, bool repeat);
-void        sound_set_speed   (sound_t* sound, float pitch);
-void        sound_pause       (sound_t* sound, bool paused);
-void        sound_play        (sound_t* sound, mixer_t* mixer);
-void        sound_seek        (sound_t* sound, double position);
-void        sound_stop        (sound_t* sound);
-double      sound_tell        (sound_t* sound);
-stream_t*   stream_new        (int frequency, int bits, int channels);
-stream_t*   stream_ref        (stream_t* stream);
-void        stream_unref      (stream_t* stream);
-double      stream_length     (const stream_t* stream);
-mixer_t*    stream_mixer      (const stream_t* stream);
-bool        stream_playing    (const stream_t* stream);
-void        stream_buffer     (stream_t* stream, const void* data, size_t size);
-void        stream_pause      (stream_t* stream, bool paused);
-void        stream_play       (stream_t* stream, mixer_t* mixer);
-void        stream_stop       (stream_t* stream);
+typedef
+struct voice_stats
+{
+	int          max_voices;
+	int          num_active;
+	int          num_voices;
+	int          peak_active;
+	unsigned int num_drops;
+	unsigned int num_plays;
+	unsigned int num_reuses;
+	unsigned int num_steals;
+} voice_stats_t;
+
+void        audio_init            (void);
+void        audio_uninit          (void);
+void        audio_get_stats       (int* out_num_sounds, int* out_num_streams);
+void        audio_resume          (void);
+void        audio_suspend         (void);
+void        audio_update          (void);
+mixer_t*    mixer_new             (int frequency, int bits, int channels);
+mixer_t*    mixer_ref             (mixer_t* mixer);
+void        mixer_unref           (mixer_t* mixer);
+float       mixer_get_gain        (mixer_t* mixer);
+int         mixer_get_max_voices  (const mixer_t* mixer);
+void        mixer_get_voice_stats (const mixer_t* mixer, voice_stats_t* out_stats);
+void        mixer_set_gain        (mixer_t* mixer, float gain);
+void        mixer_set_max_voices  (mixer_t* mixer, int max_voices);
+sample_t*   sample_new            (const char* path, bool polyphonic);
+sample_t*   sample_clone          (sample_t* sample);
+sample_t*   sample_from_data      (void* decoded, const char* path, bool polyphonic);
+void*       sample_decode         (void* data, size_t size, const char* path);
+sample_t*   sample_ref            (sample_t* sample);
+void        sample_unref          (sample_t* sample);
+const char* sample_path           (const sample_t* sample);
+int         sample_refcount       (const sample_t* sample);
+float       sample_get_gain       (const sample_t* sample);
+float       sample_get_pan        (const sample_t* sample);
+int         sample_get_priority   (const sample_t* sample);
+float       sample_get_speed      (const sample_t* sample);
+void        sample_set_gain       (sample_t* sample, float gain);
+void        sample_set_pan        (sample_t* sample, float pan);
+void        sample_set_priority   (sample_t* sample, int priority);
+void        sample_set_speed      (sample_t* sample, float speed);
+void        sample_play           (sample_t* sample, mixer_t* mixer);
+void        sample_stop_all       (sample_t* sample);
+sound_t*    sound_new             (const char* path);
+sound_t*    sound_ref             (sound_t* sound);
+void        sound_unref           (sound_t* sound);
+float       sound_gain            (sound_t* sound);
+double      sound_len             (sound_t* sound);
+mixer_t*    sound_mixer           (sound_t* sound);
+float       sound_pan             (sound_t* sound);
+const char* sound_path            (const sound_t* sound);
+bool        sound_playing         (sound_t* sound);
+bool        sound_repeat          (sound_t* sound);
+float       sound_speed           (sound_t* sound);
+void        sound_set_gain        (sound_t* sound, float gain);
+void        sound_set_pan         (sound_t* sound, float pan);
+void        sound_set_repeat      (sound_t* sound, bool repeat);
+void        sound_set_speed       (sound_t* sound, float pitch);
+void        sound_pause           (sound_t* sound, bool paused);
+void        sound_play            (sound_t* sound, mixer_t* mixer);
+void        sound_seek            (sound_t* sound, double position);
+void        sound_stop            (sound_t* sound);
+double      sound_tell            (sound_t* sound);
+stream_t*   stream_new            (int frequency, int bits, int channels);
+stream_t*   stream_ref            (stream_t* stream);
+void        stream_unref          (stream_t* stream);
+double      stream_length         (const stream_t* stream);
+mixer_t*    stream_mixer          (const stream_t* stream);
+bool        stream_playing        (const stream_t* stream);
+void        stream_buffer         (stream_t* stream, const void* data, size_t size);
+void        stream_pause          (stream_t* stream, bool paused);
+void        stream_play           (stream_t* stream, mixer_t* mixer);
+void        stream_stop           (stream_t* stream);
 
 #endif // !NEOSPHERE_AUDIO_H_INCLUDED
@@ -0,0 +1,379 @@
+/**
+ *  Sphere: the JavaScript game platform
+ *  Copyright (c) 2015-2025, Where'd She Go?
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of Spherical nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+#include "neosphere.h"
+#include "benchmark.h"
+
+#include "api.h"
+#include "dispatch.h"
+#include "jsal.h"
+#include "table.h"
+
+// each case is run with an increasing number of iterations until a single run
+// takes at least this long, in seconds.  the earlier runs double as warmup.
+#define MIN_RUN_TIME 0.25
+
+// class ID for the dummy class used to measure class object overhead.  this
+// only exists in benchmark mode so it can't collide with the real APIs.
+#define BENCHMARK_OBJECT 999
+
+struct bench_case
+{
+	const char*   name;
+	const char*   description;
+	js_function_t run;
+};
+
+static bool js_benchmark_noop     (int num_args, bool is_ctor, intptr_t magic);
+static bool js_benchmark_unwrap   (int num_args, bool is_ctor, intptr_t magic);
+static bool js_benchmark_buffer   (int num_args, bool is_ctor, intptr_t magic);
+static bool run_buffer_access     (int num_args, bool is_ctor, intptr_t magic);
+static bool run_class_construct   (int num_args, bool is_ctor, intptr_t magic);
+static bool run_class_unwrap      (int num_args, bool is_ctor, intptr_t magic);
+static bool run_js_loop           (int num_args, bool is_ctor, intptr_t magic);
+static bool run_native_call       (int num_args, bool is_ctor, intptr_t magic);
+static bool run_promise_resolve   (int num_args, bool is_ctor, intptr_t magic);
+static bool run_prop_get          (int num_args, bool is_ctor, intptr_t magic);
+static bool run_prop_set          (int num_args, bool is_ctor, intptr_t magic);
+
+static js_ref_t* compile_function (const char* source);
+static void      run_js_driver    (js_ref_t* native_fn, int arg_index);
+static bool      time_case        (const struct bench_case* bench, double *out_ns_per_op, int *out_num_ops);
+static bool      write_results    (const char* out_path, const double ns_per_op[], const int num_ops[]);
+
+static const struct bench_case BENCHMARKS[] =
+{
+	{ "js-loop", "empty JS loop (baseline)", run_js_loop },
+	{ "native-call", "empty native call", run_native_call },
+	{ "class-unwrap", "jsal_require_class_obj()", run_class_unwrap },
+	{ "buffer-access", "typed array buffer access", run_buffer_access },
+	{ "prop-get", "jsal_get_prop_string()", run_prop_get },
+	{ "prop-set", "jsal_put_prop_string()", run_prop_set },
+	{ "class-construct", "jsal_push_class_obj()", run_class_construct },
+	{ "promise-resolve", "promise resolution + tick", run_promise_resolve },
+	{ NULL },
+};
+
+static js_ref_t* s_buffer_fn;
+static js_ref_t* s_buffer_obj;
+static js_ref_t* s_class_obj;
+static js_ref_t* s_driver_fn;
+static int       s_dummy;
+static js_ref_t* s_loop_fn;
+static js_ref_t* s_noop_fn;
+static int       s_num_ops;
+static js_ref_t* s_then_fn;
+static js_ref_t* s_unwrap_fn;
+
+bool
+benchmark_run(const char* out_path)
+{
+	const struct bench_case* bench;
+	char*                    heading;
+	int                      num_cases = 0;
+	int                      num_ops[32];
+	double                   ns_per_op[32];
+	bool                     success = true;
+	table_t*                 table;
+
+	int i;
+
+	console_log(0, "running JS/native boundary benchmarks");
+
+	api_init(false);
+	api_define_class("BenchmarkObject", BENCHMARK_OBJECT, NULL, NULL, 0);
+
+	// set up the functions and objects the benchmarks operate on
+	s_loop_fn = compile_function("(function (n) { for (let i = 0; i < n; ++i) {} })");
+	s_driver_fn = compile_function("(function (n, fn, arg) { for (let i = 0; i < n; ++i) fn(arg); })");
+	s_then_fn = compile_function("(function (promise, fn) { promise.then(fn); })");
+	jsal_push_new_function(js_benchmark_noop, "noop", 0, false, 0);
+	s_noop_fn = jsal_pop_ref();
+	jsal_push_new_function(js_benchmark_unwrap, "unwrap", 0, false, 0);
+	s_unwrap_fn = jsal_pop_ref();
+	jsal_push_new_function(js_benchmark_buffer, "buffer", 0, false, 0);
+	s_buffer_fn = jsal_pop_ref();
+	jsal_push_class_obj(BENCHMARK_OBJECT, &s_dummy, false);
+	s_class_obj = jsal_pop_ref();
+	jsal_push_new_buffer(JS_UINT8ARRAY, 256, NULL);
+	s_buffer_obj = jsal_pop_ref();
+
+	for (bench = &BENCHMARKS[0]; bench->name != NULL; ++bench) {
+		jsal_gc();
+		if (!time_case(bench, &ns_per_op[num_cases], &num_ops[num_cases])) {
+			console_error("benchmark '%s' threw: %s", bench->name, jsal_to_string(-1));
+			jsal_pop(1);
+			success = false;
+			break;
+		}
+		console_log(1, "    %s: %.1f ns/op", bench->name, ns_per_op[num_cases]);
+		++num_cases;
+	}
+
+	if (success) {
+		heading = strnewf("%s %s native call benchmarks", SPHERE_ENGINE_NAME, SPHERE_VERSION);
+		table = table_new(heading, false);
+		table_add_column(table, "benchmark");
+		table_add_column(table, "description");
+		table_add_column(table, "ops");
+		table_add_column(table, "ns/op");
+		for (i = 0; i < num_cases; ++i) {
+			table_add_text(table, 0, BENCHMARKS[i].name);
+			table_add_text(table, 1, BENCHMARKS[i].description);
+			table_add_number(table, 2, num_ops[i]);
+			table_add_number(table, 3, llround(ns_per_op[i]));
+		}
+		printf("\n");
+		table_print(table);
+		table_free(table);
+		free(heading);
+		if (!write_results(out_path, ns_per_op, num_ops)) {
+			console_error("couldn't write benchmark results to '%s'", out_path);
+			success = false;
+		}
+	}
+
+	jsal_unref(s_buffer_fn);
+	jsal_unref(s_buffer_obj);
+	jsal_unref(s_class_obj);
+	jsal_unref(s_driver_fn);
+	jsal_unref(s_loop_fn);
+	jsal_unref(s_noop_fn);
+	jsal_unref(s_then_fn);
+	jsal_unref(s_unwrap_fn);
+	api_uninit();
+	return success;
+}
+
+static js_ref_t*
+compile_function(const char* source)
+{
+	jsal_push_string(source);
+	jsal_compile("#/benchmark.js");
+	jsal_call(0);
+	return jsal_pop_ref();
+}
+
+static void
+run_js_driver(js_ref_t* native_fn, int arg_index)
+{
+	// calls `native_fn` from JS `s_num_ops` times, passing it the value at
+	// `arg_index` (or undefined if it's -1).
+	jsal_push_ref_weak(s_driver_fn);
+	jsal_push_undefined();
+	jsal_push_int(s_num_ops);
+	jsal_push_ref_weak(native_fn);
+	if (arg_index >= 0)
+		jsal_dup(arg_index);
+	else
+		jsal_push_undefined();
+	jsal_call_method(3);
+	jsal_pop(1);
+}
+
+static bool
+time_case(const struct bench_case* bench, double *out_ns_per_op, int *out_num_ops)
+{
+	double elapsed;
+	double start_time;
+
+	s_num_ops = 1000;
+	for (;;) {
+		start_time = al_get_time();
+		if (!jsal_try(bench->run, 0))
+			return false;
+		elapsed = al_get_time() - start_time;
+		jsal_pop(1);
+		if (elapsed >= MIN_RUN_TIME || s_num_ops >= INT_MAX / 10)
+			break;
+		s_num_ops *= elapsed < MIN_RUN_TIME / 10 ? 10 : 2;
+	}
+	*out_ns_per_op = elapsed * 1.0e9 / s_num_ops;
+	*out_num_ops = s_num_ops;
+	return true;
+}
+
+static bool
+write_results(const char* out_path, const double ns_per_op[], const int num_ops[])
+{
+	// note: results are written as JSON so CI can track them over time.  the
+	//       format is deliberately flat: one entry per benchmark.
+	FILE* file;
+
+	int i;
+
+	if (!(file = fopen(out_path, "wb")))
+		return false;
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"engine\": \"%s\",\n", SPHERE_ENGINE_NAME);
+	fprintf(file, "\t\"version\": \"%s\",\n", SPHERE_VERSION);
+	fprintf(file, "\t\"unit\": \"ns/op\",\n");
+	fprintf(file, "\t\"results\": [\n");
+	for (i = 0; BENCHMARKS[i].name != NULL; ++i) {
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"ops\": %d, \"nsPerOp\": %.3f }%s\n",
+			BENCHMARKS[i].name, num_ops[i], ns_per_op[i],
+			BENCHMARKS[i + 1].name != NULL ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	return true;
+}
+
+static bool
+js_benchmark_noop(int num_args, bool is_ctor, intptr_t magic)
+{
+	return false;
+}
+
+static bool
+js_benchmark_unwrap(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_require_class_obj(0, BENCHMARK_OBJECT);
+	return false;
+}
+
+static bool
+js_benchmark_buffer(int num_args, bool is_ctor, intptr_t magic)
+{
+	uint8_t* data;
+	size_t   size;
+
+	data = jsal_require_buffer_ptr(0, &size);
+	if (size > 0)
+		data[0] ^= 0xFF;
+	return false;
+}
+
+static bool
+run_buffer_access(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_ref_weak(s_buffer_obj);
+	run_js_driver(s_buffer_fn, jsal_get_top() - 1);
+	return false;
+}
+
+static bool
+run_class_construct(int num_args, bool is_ctor, intptr_t magic)
+{
+	int i;
+
+	for (i = 0; i < s_num_ops; ++i) {
+		jsal_push_class_obj(BENCHMARK_OBJECT, &s_dummy, false);
+		jsal_pop(1);
+	}
+	return false;
+}
+
+static bool
+run_class_unwrap(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_ref_weak(s_class_obj);
+	run_js_driver(s_unwrap_fn, jsal_get_top() - 1);
+	return false;
+}
+
+static bool
+run_js_loop(int num_args, bool is_ctor, intptr_t magic)
+{
+	jsal_push_ref_weak(s_loop_fn);
+	jsal_push_undefined();
+	jsal_push_int(s_num_ops);
+	jsal_call_method(1);
+	return false;
+}
+
+static bool
+run_native_call(int num_args, bool is_ctor, intptr_t magic)
+{
+	run_js_driver(s_noop_fn, -1);
+	return false;
+}
+
+static bool
+run_promise_resolve(int num_args, bool is_ctor, intptr_t magic)
+{
+	// note: events_tick() needs a display to flip, so this drives the same path
+	//       it uses to settle async API calls: call the resolver and then run the
+	//       tick queue to deliver the reaction.
+	js_ref_t* rejector;
+	js_ref_t* resolver;
+
+	int i;
+
+	for (i = 0; i < s_num_ops; ++i) {
+		jsal_push_new_promise(&resolver, &rejector);
+		jsal_push_ref_weak(s_then_fn);
+		jsal_push_undefined();
+		jsal_dup(-3);
+		jsal_push_ref_weak(s_noop_fn);
+		jsal_call_method(2);
+		jsal_pop(2);
+		jsal_push_ref_weak(resolver);
+		jsal_push_int(i);
+		jsal_call(1);
+		jsal_pop(1);
+		jsal_unref(resolver);
+		jsal_unref(rejector);
+		dispatch_run(JOB_ON_TICK);
+	}
+	return false;
+}
+
+static bool
+run_prop_get(int num_args, bool is_ctor, intptr_t magic)
+{
+	int i;
+
+	jsal_push_new_object();
+	jsal_push_int(812);
+	jsal_put_prop_string(-2, "value");
+	for (i = 0; i < s_num_ops; ++i) {
+		jsal_get_prop_string(-1, "value");
+		jsal_pop(1);
+	}
+	return false;
+}
+
+static bool
+run_prop_set(int num_args, bool is_ctor, intptr_t magic)
+{
+	int i;
+
+	jsal_push_new_object();
+	for (i = 0; i < s_num_ops; ++i) {
+		jsal_push_int(i);
+		jsal_put_prop_string(-2, "value");
+	}
+	return false;
+}
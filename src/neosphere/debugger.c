@@ -33,7 +33,12 @@
 #include "neosphere.h"
 #include "debugger.h"
 
+#include "asset_cache.h"
 #include "audio.h"
+#include "dispatch.h"
+#include "event_loop.h"
+#include "galileo.h"
+#include "image.h"
 #include "jsal.h"
 #include "ki.h"
 #include "sockets.h"
@@ -41,9 +46,19 @@
 
 static int const TCP_DEBUG_PORT = 1208;
 
+struct breakpoint
+{
+	char* condition;
+	int   hit_count;
+	char* log_expr;
+	int   num_hits;
+};
+
 static js_step_t  on_breakpoint_hit  (void);
 static void       on_throw_exception (void);
+static void       add_stats          (ki_message_t* message);
 static ki_atom_t* atom_from_value    (int stack_index);
+static bool       check_breakpoint   (struct breakpoint* breakpoint);
 static bool       do_attach_debugger (void);
 static void       do_detach_debugger (bool is_shutdown);
 static bool       process_message    (js_step_t* out_step);
@@ -52,12 +67,15 @@ static ssj_mode_t s_attach_mode;
 static js_step_t  s_auto_step_op;
 static color_t    s_banner_color;
 static char*      s_banner_text;
+static vector_t*  s_breakpoints;
 static js_ref_t*  s_cell_data = NULL;
 static char*      s_compiler = NULL;
 static bool       s_is_attached = false;
 static bool       s_needs_attachment;
+static double     s_next_stats_time = 0.0;
 static server_t*  s_server;
 static socket_t*  s_socket = NULL;
+static double     s_stats_interval = 0.0;
 
 void
 debugger_init(ssj_mode_t attach_mode, bool allow_remote)
@@ -71,6 +89,7 @@ debugger_init(ssj_mode_t attach_mode, bool allow_remote)
 	const char* url;
 
 	s_attach_mode = attach_mode;
+	s_breakpoints = vector_new(sizeof(struct breakpoint));
 
 	if (attach_mode != SSJ_OFF) {
 		jsal_debug_on_throw(on_throw_exception);
@@ -160,12 +179,23 @@ debugger_init(ssj_mode_t attach_mode, bool allow_remote)
 void
 debugger_uninit()
 {
+	struct breakpoint* breakpoint;
+
+	iter_t iter;
+
 	if (s_attach_mode != SSJ_OFF) {
 		do_detach_debugger(true);
 		jsal_debug_uninit();
 		server_unref(s_server);
 	}
 
+	iter = vector_enum(s_breakpoints);
+	while ((breakpoint = iter_next(&iter))) {
+		free(breakpoint->condition);
+		free(breakpoint->log_expr);
+	}
+	vector_free(s_breakpoints);
+
 	jsal_unref(s_cell_data);
 	free(s_compiler);
 	free(s_banner_text);
@@ -178,6 +208,7 @@ debugger_update(void)
 {
 	socket_t*     client;
 	char*         handshake;
+	ki_message_t* notify;
 	js_step_t     step_op;
 
 	if (s_attach_mode == SSJ_OFF)
@@ -211,6 +242,16 @@ debugger_update(void)
 		}
 	}
 
+	// if SSj asked for them, send engine stats periodically while the game is running
+	if (s_socket != NULL && s_stats_interval > 0.0 && al_get_time() >= s_next_stats_time) {
+		notify = ki_message_new(KI_NFY);
+		ki_message_add_int(notify, KI_NFY_STATS);
+		add_stats(notify);
+		ki_message_send(notify, s_socket);
+		ki_message_free(notify);
+		s_next_stats_time = al_get_time() + s_stats_interval;
+	}
+
 	// process any incoming SSj requests
 	if (s_socket == NULL || socket_bytes_avail(s_socket) == 0)
 		return;
@@ -267,12 +308,14 @@ debugger_log(const char* text, ki_log_op_t op, bool use_console)
 static js_step_t
 on_breakpoint_hit(void)
 {
-	int           column;
-	const char*   filename;
-	int           line;
-	mapping_t     mapping;
-	ki_message_t* message;
-	js_step_t     step_op;
+	struct breakpoint* breakpoint;
+	int                breakpoint_index;
+	int                column;
+	const char*        filename;
+	int                line;
+	mapping_t          mapping;
+	ki_message_t*      message;
+	js_step_t          step_op;
 
 	if (s_socket == NULL)
 		return JS_STEP_CONTINUE;
@@ -280,11 +323,21 @@ on_breakpoint_hit(void)
 	filename = jsal_get_string(0);
 	line = jsal_get_int(1);
 	column = jsal_get_int(2);
+	breakpoint_index = jsal_get_int(3);
 	mapping = source_map_lookup(filename, line, column);
 	
 	if (strncmp(mapping.filename, "#/", 2) == 0)
 		return s_auto_step_op;
 
+	// note: conditions, hit counts and log points are handled here rather than in SSj so
+	//       that a breakpoint in a hot loop doesn't need a round trip to the debugger every
+	//       time it's hit.
+	if (breakpoint_index >= 0 && breakpoint_index < vector_len(s_breakpoints)) {
+		breakpoint = vector_get(s_breakpoints, breakpoint_index);
+		if (!check_breakpoint(breakpoint))
+			return JS_STEP_CONTINUE;
+	}
+
 	audio_suspend();
 
 	message = ki_message_new(KI_NFY);
@@ -341,6 +394,93 @@ on_throw_exception(void)
 	ki_message_free(message);
 }
 
+static void
+add_stats(ki_message_t* message)
+{
+	// note: stats are sent as name-value pairs so that SSj can display them without
+	//       having to know about every one of them.  times are in milliseconds.
+
+	cache_stats_t cache_stats;
+	double        frame_max = 0.0;
+	double        frame_mean = 0.0;
+	double        frame_stddev = 0.0;
+	js_gc_stats_t gc_stats;
+	loop_stats_t  loop_stats;
+	int           num_images;
+	int           num_sounds;
+	int           num_streams;
+	size_t        texture_bytes;
+
+	if (g_screen != NULL)
+		screen_get_frame_stats(g_screen, &frame_mean, &frame_stddev, &frame_max);
+	events_get_stats(&loop_stats);
+	asset_cache_stats(&cache_stats);
+	jsal_get_gc_stats(&gc_stats);
+	images_get_usage(&num_images, &texture_bytes);
+	audio_get_stats(&num_sounds, &num_streams);
+
+	ki_message_add_string(message, "frame.mean_ms");
+	ki_message_add_number(message, frame_mean * 1000.0);
+	ki_message_add_string(message, "frame.stddev_ms");
+	ki_message_add_number(message, frame_stddev * 1000.0);
+	ki_message_add_string(message, "frame.max_ms");
+	ki_message_add_number(message, frame_max * 1000.0);
+	ki_message_add_string(message, "loop.render_ms");
+	ki_message_add_number(message, loop_stats.render_time * 1000.0);
+	ki_message_add_string(message, "loop.flip_ms");
+	ki_message_add_number(message, loop_stats.flip_time * 1000.0);
+	ki_message_add_string(message, "loop.update_ms");
+	ki_message_add_number(message, loop_stats.update_time * 1000.0);
+	ki_message_add_string(message, "loop.tick_ms");
+	ki_message_add_number(message, loop_stats.tick_time * 1000.0);
+	ki_message_add_string(message, "loop.tasks");
+	ki_message_add_int(message, loop_stats.num_tasks);
+	ki_message_add_string(message, "dispatch.onetime");
+	ki_message_add_int(message, dispatch_num_jobs(false));
+	ki_message_add_string(message, "dispatch.recurring");
+	ki_message_add_int(message, dispatch_num_jobs(true));
+	ki_message_add_string(message, "js.heap_bytes");
+	ki_message_add_number(message, (double)jsal_get_memory_usage());
+	ki_message_add_string(message, "js.limit_bytes");
+	ki_message_add_number(message, (double)jsal_get_memory_limit());
+	ki_message_add_string(message, "js.gc_count");
+	ki_message_add_int(message, gc_stats.num_collections);
+	ki_message_add_string(message, "js.gc_explicit");
+	ki_message_add_int(message, gc_stats.num_explicit);
+	ki_message_add_string(message, "js.gc_pause_ms");
+	ki_message_add_number(message, gc_stats.total_pause * 1000.0);
+	ki_message_add_string(message, "js.gc_max_pause_ms");
+	ki_message_add_number(message, gc_stats.max_pause * 1000.0);
+	ki_message_add_string(message, "js.alloc_failures");
+	ki_message_add_int(message, gc_stats.num_alloc_failures);
+	ki_message_add_string(message, "gfx.images");
+	ki_message_add_int(message, num_images);
+	ki_message_add_string(message, "gfx.texture_bytes");
+	ki_message_add_number(message, (double)texture_bytes);
+	ki_message_add_string(message, "gfx.draws_saved");
+	ki_message_add_int(message, galileo_draws_saved());
+	ki_message_add_string(message, "audio.sounds");
+	ki_message_add_int(message, num_sounds);
+	ki_message_add_string(message, "audio.streams");
+	ki_message_add_int(message, num_streams);
+	ki_message_add_string(message, "net.bytes_in");
+	ki_message_add_number(message, (double)sockets_bytes_in());
+	ki_message_add_string(message, "net.bytes_out");
+	ki_message_add_number(message, (double)sockets_bytes_out());
+	ki_message_add_string(message, "cache.entries");
+	ki_message_add_int(message, cache_stats.num_entries);
+	ki_message_add_string(message, "cache.used_bytes");
+	ki_message_add_number(message, (double)cache_stats.bytes_used);
+	ki_message_add_string(message, "cache.budget_bytes");
+	ki_message_add_number(message, (double)cache_stats.budget);
+	ki_message_add_string(message, "cache.hits");
+	ki_message_add_int(message, cache_stats.num_hits);
+	ki_message_add_string(message, "cache.misses");
+	ki_message_add_int(message, cache_stats.num_misses);
+	ki_message_add_string(message, "cache.evictions");
+	ki_message_add_int(message, cache_stats.num_evictions);
+}
+
 static ki_atom_t*
 atom_from_value(int stack_index)
 {
@@ -356,6 +496,35 @@ atom_from_value(int stack_index)
 		return ki_atom_new_string(jsal_to_string(stack_index));
 }
 
+static bool
+check_breakpoint(struct breakpoint* breakpoint)
+{
+	bool is_error;
+	bool is_true;
+
+	if (breakpoint->condition != NULL) {
+		if (!jsal_debug_inspect_eval(0, breakpoint->condition, &is_error))
+			return true;
+		is_true = jsal_get_uint(-1) != 0 || jsal_to_boolean(-2);
+		if (is_error)
+			debugger_log(jsal_to_string(-2), KI_LOG_ERROR, false);
+		jsal_pop(3);
+		if (!is_true && !is_error)
+			return false;
+	}
+	if (++breakpoint->num_hits < breakpoint->hit_count)
+		return false;
+	if (breakpoint->log_expr != NULL) {
+		// log points never pause, they just send the result of the expression to SSj
+		if (jsal_debug_inspect_eval(0, breakpoint->log_expr, &is_error)) {
+			debugger_log(jsal_to_string(-2), is_error ? KI_LOG_ERROR : KI_LOG_NORMAL, false);
+			jsal_pop(3);
+		}
+		return false;
+	}
+	return true;
+}
+
 static bool
 do_attach_debugger(void)
 {
@@ -384,6 +553,7 @@ do_detach_debugger(bool is_shutdown)
 	// detach the debugger
 	console_log(1, "detaching SSj debug session");
 	s_is_attached = false;
+	s_stats_interval = 0.0;
 	if (s_socket != NULL) {
 		notify = ki_message_new(KI_NFY);
 		ki_message_add_int(notify, KI_NFY_DETACH);
@@ -403,24 +573,29 @@ do_detach_debugger(bool is_shutdown)
 static bool
 process_message(js_step_t* out_step)
 {
-	unsigned int  breakpoint_id;
-	int           call_index;
-	int           column;
-	const char*   compiler;
-	char*         engine_name;
-	const char*   eval_code;
-	bool          eval_errored;
-	char*         file_data;
-	size_t        file_size;
-	const char*   filename;
-	unsigned int  handle;
-	unsigned int  line;
-	mapping_t     mapping;
-	ki_message_t* reply;
-	ki_message_t* request = NULL;
-	size2_t       resolution;
-	bool          resuming = false;
-	const char*   source_text;
+	struct breakpoint  breakpoint;
+	unsigned int       breakpoint_id;
+	int                call_index;
+	int                column;
+	const char*        compiler;
+	int                count;
+	char*              engine_name;
+	const char*        eval_code;
+	bool               eval_errored;
+	char*              file_data;
+	size_t             file_size;
+	const char*        filename;
+	unsigned int       handle;
+	unsigned int       line;
+	mapping_t          mapping;
+	int                num_props;
+	struct breakpoint* p_breakpoint;
+	ki_message_t*      reply;
+	ki_message_t*      request = NULL;
+	size2_t            resolution;
+	bool               resuming = false;
+	const char*        source_text;
+	int                start;
 
 	int i;
 
@@ -440,10 +615,29 @@ process_message(js_step_t* out_step)
 		line = ki_message_int(request, 2) - 1;
 		mapping = source_map_reverse(filename, line, 0);
 		breakpoint_id = jsal_debug_breakpoint_add(mapping.filename, mapping.line, mapping.column);
+		memset(&breakpoint, 0, sizeof(struct breakpoint));
+		if (ki_message_len(request) >= 6) {
+			if (ki_message_string(request, 3)[0] != '\0')
+				breakpoint.condition = strdup(ki_message_string(request, 3));
+			breakpoint.hit_count = ki_message_int(request, 4);
+			if (ki_message_string(request, 5)[0] != '\0')
+				breakpoint.log_expr = strdup(ki_message_string(request, 5));
+		}
+		vector_push(s_breakpoints, &breakpoint);
 		ki_message_add_int(reply, breakpoint_id);
 		break;
+	case KI_REQ_COUNT_PROPS:
+		handle = ki_message_handle(request, 1);
+		ki_message_add_int(reply, jsal_debug_count_props(handle));
+		break;
 	case KI_REQ_DEL_BREAK:
 		breakpoint_id = ki_message_int(request, 1);
+		if (breakpoint_id >= vector_len(s_breakpoints))
+			break;
+		p_breakpoint = vector_get(s_breakpoints, breakpoint_id);
+		free(p_breakpoint->condition);
+		free(p_breakpoint->log_expr);
+		vector_remove(s_breakpoints, breakpoint_id);
 		jsal_debug_breakpoint_remove(breakpoint_id);
 		break;
 	case KI_REQ_DETACH:
@@ -531,8 +725,17 @@ process_message(js_step_t* out_step)
 		break;
 	case KI_REQ_INSPECT_OBJ:
 		handle = ki_message_handle(request, 1);
-		i = 0;
-		while (jsal_debug_inspect_object(handle, i++)) {
+		start = 0;
+		count = INT_MAX;
+		if (ki_message_len(request) >= 4) {
+			start = ki_message_int(request, 2);
+			count = ki_message_int(request, 3);
+		}
+		if ((num_props = jsal_debug_inspect_object(handle, start, count)) < 0)
+			break;
+		for (i = 0; i < num_props; ++i) {
+			if (!jsal_debug_inspect_prop(-1, i))
+				break;
 			ki_message_add_string(reply, jsal_get_string(-3));
 			ki_message_add_int(reply, KI_ATTR_NONE);
 			if (jsal_get_uint(-1) != 0)
@@ -541,6 +744,7 @@ process_message(js_step_t* out_step)
 				ki_message_add_atom(reply, atom_from_value(-2));
 			jsal_pop(3);
 		}
+		jsal_pop(1);
 		break;
 	case KI_REQ_INSPECT_STACK:
 		i = 0;
@@ -563,6 +767,13 @@ process_message(js_step_t* out_step)
 		*out_step = JS_STEP_CONTINUE;
 		resuming = true;
 		break;
+	case KI_REQ_STATS:
+		if (ki_message_len(request) >= 2) {
+			s_stats_interval = ki_message_int(request, 1) / 1000.0;
+			s_next_stats_time = 0.0;
+		}
+		add_stats(reply);
+		break;
 	case KI_REQ_STEP_IN:
 		*out_step = JS_STEP_IN;
 		resuming = true;
@@ -160,6 +160,12 @@ dispatch_defer(script_t* script, int timeout, job_type_t hint, bool critical)
 	return job.token;
 }
 
+int
+dispatch_num_jobs(bool recurring)
+{
+	return vector_len(recurring ? s_recurring_jobs : s_onetime_jobs);
+}
+
 void
 dispatch_pause(int64_t token, bool paused)
 {
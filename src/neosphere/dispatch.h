@@ -52,6 +52,7 @@ bool    dispatch_can_exit   (void);
 void    dispatch_cancel     (int64_t token);
 void    dispatch_cancel_all (bool recurring, bool also_critical);
 int64_t dispatch_defer      (script_t* script, int timeout, job_type_t hint, bool critical);
+int     dispatch_num_jobs   (bool recurring);
 void    dispatch_pause      (int64_t token, bool paused);
 int64_t dispatch_recur      (script_t* script, double priority, bool background, job_type_t hint);
 bool    dispatch_run        (job_type_t hint);
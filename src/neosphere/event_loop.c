@@ -34,7 +34,9 @@
 #include "event_loop.h"
 
 #include "api.h"
+#include "audio.h"
 #include "dispatch.h"
+#include "loader.h"
 #include "pegasus.h"
 #include "sockets.h"
 
@@ -43,6 +45,9 @@ enum task_type
 	TASK_ACCEPT_CLIENT,
 	TASK_CLOSE_SOCKET,
 	TASK_CONNECT,
+	TASK_LOAD_FONT,
+	TASK_LOAD_IMAGE,
+	TASK_LOAD_SAMPLE,
 	TASK_READ_SOCKET,
 	TASK_WRITE_SOCKET,
 };
@@ -54,18 +59,42 @@ struct task
 	js_ref_t*      rejector;
 	server_t*      server;
 	socket_t*      socket;
+	unsigned int   activity;
+	bool           polled;
 	js_ref_t*      buffer_ref;
+	int            num_bytes;
+	bool           read_into;
+	bool           read_failed;
+	unsigned int   ticket;
 	int            bytes_left;
-	uint8_t*       ptr;
+	load_t*        load;
+	char*          filename;
+	int            class_id;
+	bool           private_copy;
+	int            font_size;
+	bool           font_kerning;
+	bool           font_antialias;
+	uint32_t       preload_first;
+	uint32_t       preload_last;
 };
 
+static void         free_bitmap           (void* bitmap);
+static void         free_sample           (void* sample);
 static void         free_task             (struct task* task);
+static bool         is_idle               (void);
 static struct task* push_new_task_promise (enum task_type type);
 static bool         run_main_event_loop   (int num_args, bool is_ctor, intptr_t magic);
-
-static bool      s_exiting = false;
-static int       s_frame_rate = 60;
-static vector_t* s_tasks;
+static unsigned int task_activity         (const struct task* task);
+static bool         task_is_ready         (const struct task* task);
+static void         update_tasks          (void);
+static bool         wait_for_tick         (int api_version, int framerate);
+
+static bool         s_exiting = false;
+static int          s_frame_rate = 60;
+static loop_stats_t s_last_stats;
+static double       s_next_tick_time = 0.0;
+static vector_t*    s_tasks;
+static int          s_tick_rate = -1;
 
 void
 events_init(void)
@@ -99,12 +128,33 @@ events_get_frame_rate(void)
 	return s_frame_rate;
 }
 
+void
+events_get_stats(loop_stats_t* out_stats)
+{
+	*out_stats = s_last_stats;
+}
+
 void
 events_set_frame_rate(int frame_rate)
 {
 	s_frame_rate = frame_rate;
 }
 
+int
+events_get_tick_rate(void)
+{
+	return s_tick_rate;
+}
+
+void
+events_set_tick_rate(int tick_rate)
+{
+	// note: a negative tick rate means ticks follow the frame rate.  this only
+	//       has any effect in headless mode; otherwise, ticks are always paced
+	//       by screen flips.
+	s_tick_rate = tick_rate;
+}
+
 void
 events_accept_client(server_t* server)
 {
@@ -140,6 +190,43 @@ events_connect_to(socket_t* socket, const char* hostname, int port)
 	task->socket = socket_ref(socket);
 }
 
+void
+events_load_font(const char* filename, int size, bool kerning, bool antialiasing, uint32_t preload_first, uint32_t preload_last)
+{
+	struct task* task;
+
+	task = push_new_task_promise(TASK_LOAD_FONT);
+	task->filename = strdup(filename);
+	task->load = load_new(filename, NULL, NULL);
+	task->font_size = size;
+	task->font_kerning = kerning;
+	task->font_antialias = antialiasing;
+	task->preload_first = preload_first;
+	task->preload_last = preload_last;
+}
+
+void
+events_load_image(const char* filename, int class_id, bool private_copy)
+{
+	struct task* task;
+
+	task = push_new_task_promise(TASK_LOAD_IMAGE);
+	task->filename = strdup(filename);
+	task->load = load_new(filename, image_decode, free_bitmap);
+	task->class_id = class_id;
+	task->private_copy = private_copy;
+}
+
+void
+events_load_sample(const char* filename)
+{
+	struct task* task;
+
+	task = push_new_task_promise(TASK_LOAD_SAMPLE);
+	task->filename = strdup(filename);
+	task->load = load_new(filename, sample_decode, free_sample);
+}
+
 void
 events_read_socket(socket_t* socket, int num_bytes)
 {
@@ -153,8 +240,29 @@ events_read_socket(socket_t* socket, int num_bytes)
 	task = push_new_task_promise(TASK_READ_SOCKET);
 	task->socket = socket_ref(socket);
 	task->buffer_ref = buffer_ref;
-	task->bytes_left = num_bytes;
-	task->ptr = data_ptr;
+	task->num_bytes = num_bytes;
+	task->read_failed = !socket_read_async(socket, data_ptr, num_bytes, &task->ticket);
+}
+
+void
+events_read_socket_into(socket_t* socket, int buffer_index)
+{
+	js_ref_t*    buffer_ref;
+	void*        data_ptr;
+	size_t       data_size;
+	struct task* task;
+
+	// note: the buffer is filled in place, so hold a reference to it until the
+	//       read completes to keep it from being garbage collected.
+	data_ptr = jsal_require_buffer_ptr(buffer_index, &data_size);
+	buffer_ref = jsal_ref(buffer_index);
+
+	task = push_new_task_promise(TASK_READ_SOCKET);
+	task->socket = socket_ref(socket);
+	task->buffer_ref = buffer_ref;
+	task->num_bytes = (int)data_size;
+	task->read_into = true;
+	task->read_failed = !socket_read_async(socket, data_ptr, (int)data_size, &task->ticket);
 }
 
 void
@@ -185,98 +293,56 @@ events_run_main_loop(void)
 void
 events_tick(int api_version, bool clear_screen, int framerate)
 {
-	int          bytes_read;
-	socket_t*    client;
-	bool         task_errored;
-	bool         task_finished;
-	struct task* task;
-
-	int i;
+	double start_time;
+	double time;
 
 	sphere_heartbeat(true, api_version);
 
-	if (!screen_skipping_frame(g_screen)) {
-		if (!dispatch_run(JOB_ON_RENDER))
+	// note: the time spent in each phase is recorded so it can be reported to the
+	//       debugger.  flip time includes waiting for the next frame.
+	start_time = al_get_time();
+	if (g_headless) {
+		// nothing to render or flip, so just wait for the next tick.
+		s_last_stats.render_time = 0.0;
+		if (!wait_for_tick(api_version, framerate))
 			return;
 	}
-
-	// flip the backbuffer.  if this is a Sphere v2 frame, also reset clipping.
-	screen_flip(g_screen, framerate, clear_screen);
-	if (api_version >= 2)
-		image_clip_to(screen_backbuffer(g_screen), screen_bounds(g_screen), CLIP_RESET);
+	else {
+		if (!screen_skipping_frame(g_screen)) {
+			if (!dispatch_run(JOB_ON_RENDER))
+				return;
+		}
+		time = al_get_time();
+		s_last_stats.render_time = time - start_time;
+		start_time = time;
+
+		// flip the backbuffer.  if this is a Sphere v2 frame, also reset clipping.
+		screen_flip(g_screen, framerate, clear_screen);
+		if (api_version >= 2)
+			image_clip_to(screen_backbuffer(g_screen), screen_bounds(g_screen), CLIP_RESET);
+	}
+	time = al_get_time();
+	s_last_stats.flip_time = time - start_time;
+	start_time = time;
 
 	if (!dispatch_run(JOB_ON_UPDATE))
 		return;
+	time = al_get_time();
+	s_last_stats.update_time = time - start_time;
+	start_time = time;
 
 	if (!dispatch_run(JOB_ON_TICK))
 		return;
 
 	// handle ongoing asynchronous tasks
-	for (i = 0; i < vector_len(s_tasks); ++i) {
-		task = vector_get(s_tasks, i);
-		task_finished = false;
-		task_errored = false;
-		switch (task->type) {
-		case TASK_ACCEPT_CLIENT:
-			if ((client = server_accept(task->server))) {
-				jsal_push_class_obj(PEGASUS_SOCKET, client, false);
-				task_finished = true;
-			}
-			break;
-		case TASK_CONNECT:
-			if (socket_connected(task->socket)) {
-				jsal_push_class_obj(PEGASUS_SOCKET, task->socket, false);
-				task_finished = true;
-			}
-			else if (socket_closed(task->socket)) {
-				jsal_push_new_error(JS_ERROR, "Unable to establish TCP connection");
-				task_errored = true;
-			}
-			break;
-		case TASK_CLOSE_SOCKET:
-			if (socket_closed(task->socket)) {
-				jsal_push_undefined();
-				task_finished = true;
-			}
-			break;
-		case TASK_READ_SOCKET:
-			bytes_read = socket_read(task->socket, task->ptr, task->bytes_left);
-			task->bytes_left -= bytes_read;
-			task->ptr += bytes_read;
-			if (task->bytes_left == 0) {
-				jsal_push_ref_weak(task->buffer_ref);
-				task_finished = true;
-			}
-			else if (!socket_connected(task->socket)) {
-				jsal_push_new_error(JS_ERROR, "Connection was lost before completion of read");
-				task_errored = true;
-			}
-			break;
-		case TASK_WRITE_SOCKET:
-			if (socket_bytes_out(task->socket) >= task->bytes_left) {
-				jsal_push_undefined();
-				task_finished = true;
-			}
-			else if (!socket_connected(task->socket)) {
-				jsal_push_new_error(JS_ERROR, "Connection was lost before completion of write");
-				task_errored = true;
-			}
-			break;
-		}
-		if (task_finished || task_errored) {
-			jsal_push_ref_weak(task_errored ? task->rejector : task->resolver);
-			jsal_pull(-2);
-			jsal_call(1);
-			jsal_pop(1);
-			free_task(task);
-			vector_remove(s_tasks, i--);
-		}
-	}
+	update_tasks();
 
 	// run the microtask queue one more time to finalize any promises that
 	// were settled above.
 	if (!dispatch_run(JOB_ON_TICK))
 		return;
+	s_last_stats.tick_time = al_get_time() - start_time;
+	s_last_stats.num_tasks = vector_len(s_tasks);
 
 	++g_tick_count;
 }
@@ -299,16 +365,51 @@ push_new_task_promise(enum task_type type)
 	return vector_get(s_tasks, vector_len(s_tasks) - 1);
 }
 
+static void
+free_bitmap(void* bitmap)
+{
+	al_destroy_bitmap(bitmap);
+}
+
+static void
+free_sample(void* sample)
+{
+	al_destroy_sample(sample);
+}
+
 static void
 free_task(struct task* task)
 {
+	load_free(task->load);
+	free(task->filename);
 	jsal_unref(task->buffer_ref);
 	jsal_unref(task->rejector);
 	jsal_unref(task->resolver);
+	if (task->socket != NULL && task->ticket != 0)
+		socket_read_cancel(task->socket, task->ticket);
 	socket_unref(task->socket);
 	server_unref(task->server);
 }
 
+static bool
+is_idle(void)
+{
+	struct task* task;
+
+	int i, len;
+
+	if (dispatch_busy() || jsal_busy())
+		return false;
+	for (i = 0, len = vector_len(s_tasks); i < len; ++i) {
+		task = vector_get(s_tasks, i);
+		if (task->socket == NULL && task->server == NULL)
+			return false;
+		if (task_is_ready(task))
+			return false;
+	}
+	return true;
+}
+
 static bool
 run_main_event_loop(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -324,8 +425,14 @@ run_main_event_loop(int num_args, bool is_ctor, intptr_t magic)
 	// bail, so we need to re-enable it here.
 	jsal_enable_vm(true);
 
-	while (dispatch_busy() || jsal_busy() || vector_len(s_tasks) > 0)
+	while (dispatch_busy() || jsal_busy() || vector_len(s_tasks) > 0) {
+		// if the only thing keeping the event loop alive is network I/O, there's
+		// no point running frames until a socket has something for us.  the
+		// timeout is only there so the window stays responsive.
+		if (is_idle())
+			sockets_wait(0.25);
 		events_tick(2, true, s_frame_rate);
+	}
 
 	// deal with Dispatch.onExit() jobs
 	// note: the JavaScript VM might have been disabled due to a Sphere v1
@@ -341,3 +448,189 @@ run_main_event_loop(int num_args, bool is_ctor, intptr_t magic)
 
 	return false;
 }
+
+static unsigned int
+task_activity(const struct task* task)
+{
+	if (task->socket != NULL)
+		return socket_activity(task->socket);
+	else if (task->server != NULL)
+		return server_activity(task->server);
+	else
+		return 0;
+}
+
+static bool
+task_is_ready(const struct task* task)
+{
+	// note: socket and server tasks only need to be checked again if there has
+	//       been activity on their socket since the last time.  this keeps the
+	//       per-frame cost down when there are lots of idle connections.
+	if (task->socket == NULL && task->server == NULL)
+		return true;
+	return !task->polled || task_activity(task) != task->activity;
+}
+
+static void
+update_tasks(void)
+{
+	socket_t*    client;
+	void*        data;
+	size_t       data_size;
+	ttf_t*       font;
+	image_t*     image;
+	sample_t*    sample;
+	bool         task_errored;
+	bool         task_finished;
+	struct task* task;
+
+	int i;
+
+	loader_update();
+	for (i = 0; i < vector_len(s_tasks); ++i) {
+		task = vector_get(s_tasks, i);
+		if (!task_is_ready(task))
+			continue;
+		task->activity = task_activity(task);
+		task->polled = true;
+		task_finished = false;
+		task_errored = false;
+		switch (task->type) {
+		case TASK_ACCEPT_CLIENT:
+			if ((client = server_accept(task->server))) {
+				jsal_push_class_obj(PEGASUS_SOCKET, client, false);
+				task_finished = true;
+			}
+			break;
+		case TASK_CONNECT:
+			if (socket_connected(task->socket)) {
+				jsal_push_class_obj(PEGASUS_SOCKET, task->socket, false);
+				task_finished = true;
+			}
+			else if (socket_closed(task->socket)) {
+				jsal_push_new_error(JS_ERROR, "Unable to establish TCP connection");
+				task_errored = true;
+			}
+			break;
+		case TASK_CLOSE_SOCKET:
+			if (socket_closed(task->socket)) {
+				jsal_push_undefined();
+				task_finished = true;
+			}
+			break;
+		case TASK_LOAD_FONT:
+			if (task->load == NULL || load_done(task->load)) {
+				// note: only the file read happens in the background for fonts;
+				//       FreeType setup and preloading the glyph cache both need
+				//       to happen here, on the main thread.
+				data = task->load != NULL ? load_result(task->load, &data_size) : NULL;
+				if (data != NULL && (font = ttf_from_data(task->filename, data, data_size,
+					task->font_size, task->font_kerning, task->font_antialias)))
+				{
+					ttf_preload(font, task->preload_first, task->preload_last);
+					jsal_push_class_obj(PEGASUS_FONT, font, false);
+					task_finished = true;
+				}
+				else {
+					jsal_push_new_error(JS_ERROR, "Unable to load a font from file '%s'", task->filename);
+					task_errored = true;
+				}
+			}
+			break;
+		case TASK_LOAD_IMAGE:
+			if (task->load == NULL || load_done(task->load)) {
+				data = task->load != NULL ? load_result(task->load, NULL) : NULL;
+				if (data != NULL && (image = image_new_decoded(data, task->filename, task->private_copy))) {
+					jsal_push_class_obj(task->class_id, image, false);
+					task_finished = true;
+				}
+				else {
+					jsal_push_new_error(JS_ERROR, "Unable to load an image from file '%s'", task->filename);
+					task_errored = true;
+				}
+			}
+			break;
+		case TASK_LOAD_SAMPLE:
+			if (task->load == NULL || load_done(task->load)) {
+				data = task->load != NULL ? load_result(task->load, NULL) : NULL;
+				if (data != NULL && (sample = sample_from_data(data, task->filename, true))) {
+					jsal_push_class_obj(PEGASUS_SAMPLE, sample, false);
+					task_finished = true;
+				}
+				else {
+					jsal_push_new_error(JS_ERROR, "Unable to load an audio sample from file '%s'", task->filename);
+					task_errored = true;
+				}
+			}
+			break;
+		case TASK_READ_SOCKET:
+			// note: the socket fills the buffer directly as data arrives, all
+			//       we need to do here is check whether it's done.
+			if (task->read_failed) {
+				jsal_push_new_error(JS_ERROR, "Couldn't queue up a read on the socket");
+				task_errored = true;
+			}
+			else if (socket_read_left(task->socket, task->ticket) == 0) {
+				if (task->read_into)
+					jsal_push_int(task->num_bytes);
+				else
+					jsal_push_ref_weak(task->buffer_ref);
+				task_finished = true;
+			}
+			else if (!socket_connected(task->socket)) {
+				jsal_push_new_error(JS_ERROR, "Connection was lost before completion of read");
+				task_errored = true;
+			}
+			break;
+		case TASK_WRITE_SOCKET:
+			if (socket_bytes_out(task->socket) >= task->bytes_left) {
+				jsal_push_undefined();
+				task_finished = true;
+			}
+			else if (!socket_connected(task->socket)) {
+				jsal_push_new_error(JS_ERROR, "Connection was lost before completion of write");
+				task_errored = true;
+			}
+			break;
+		}
+		if (task_finished || task_errored) {
+			jsal_push_ref_weak(task_errored ? task->rejector : task->resolver);
+			jsal_pull(-2);
+			jsal_call(1);
+			jsal_pop(1);
+			free_task(task);
+			vector_remove(s_tasks, i--);
+		}
+	}
+}
+
+static bool
+wait_for_tick(int api_version, int framerate)
+{
+	double tick_rate;
+	double time_left;
+
+	// note: in headless mode, ticks are paced on their own rate rather than by
+	//       screen_flip().  the time in between is spent blocked on the network,
+	//       and anything that comes in gets dealt with right away instead of
+	//       waiting for the next tick--so a server can run a slow simulation
+	//       without also being slow to respond.
+	tick_rate = s_tick_rate >= 0 ? s_tick_rate : framerate;
+	if (tick_rate <= 0) {
+		s_next_tick_time = al_get_time();
+		return true;
+	}
+	while ((time_left = s_next_tick_time - al_get_time()) > 0.0) {
+		sockets_wait(time_left);
+		sphere_heartbeat(true, api_version);
+		update_tasks();
+		if (!dispatch_run(JOB_ON_TICK))
+			return false;
+	}
+
+	// if we've fallen too far behind, don't try to catch up.
+	if (al_get_time() > s_next_tick_time + 1.0)
+		s_next_tick_time = al_get_time();
+	s_next_tick_time += 1.0 / tick_rate;
+	return true;
+}
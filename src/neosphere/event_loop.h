@@ -35,17 +35,34 @@
 
 #include "sockets.h"
 
-void events_init           (void);
-void events_uninit         (void);
-bool events_exiting        (void);
-int  events_get_frame_rate (void);
-void events_set_frame_rate (int frame_rate);
-void events_accept_client  (server_t* server);
-void events_close_socket   (socket_t* socket);
-void events_connect_to     (socket_t* socket, const char* hostname, int port);
-void events_read_socket    (socket_t* socket, int num_bytes);
-bool events_run_main_loop  (void);
-void events_write_socket   (socket_t* socket, const void* data, int num_bytes);
-void events_tick           (int api_version, bool clear_screen, int framerate);
+typedef
+struct loop_stats
+{
+	double flip_time;
+	int    num_tasks;
+	double render_time;
+	double tick_time;
+	double update_time;
+} loop_stats_t;
+
+void events_init             (void);
+void events_uninit           (void);
+bool events_exiting          (void);
+int  events_get_frame_rate   (void);
+void events_get_stats        (loop_stats_t* out_stats);
+void events_set_frame_rate   (int frame_rate);
+int  events_get_tick_rate    (void);
+void events_set_tick_rate    (int tick_rate);
+void events_accept_client    (server_t* server);
+void events_close_socket     (socket_t* socket);
+void events_connect_to       (socket_t* socket, const char* hostname, int port);
+void events_load_font        (const char* filename, int size, bool kerning, bool antialiasing, uint32_t preload_first, uint32_t preload_last);
+void events_load_image       (const char* filename, int class_id, bool private_copy);
+void events_load_sample      (const char* filename);
+void events_read_socket      (socket_t* socket, int num_bytes);
+void events_read_socket_into (socket_t* socket, int buffer_index);
+bool events_run_main_loop    (void);
+void events_write_socket     (socket_t* socket, const void* data, int num_bytes);
+void events_tick             (int api_version, bool clear_screen, int framerate);
 
 #endif // !NEOSPHERE_EVENT_LOOP_H_INCLUDED
@@ -33,41 +33,109 @@
 #include "neosphere.h"
 #include "font.h"
 
+#include "asset_cache.h"
 #include "color.h"
 #include "image.h"
 #include "unicode.h"
 
-static bool do_multiline_text_line (int line_idx, const char* line, int size, void* userdata);
-static void update_font_metrics    (font_t* font);
+// number of laid-out strings each font keeps around for redrawing
+#define MAX_GLYPH_RUNS 64
+
+// word wrap results kept per font, bounded both by count and by total size
+#define MAX_WRAP_ENTRIES 64
+#define MAX_WRAP_BYTES   (256 * 1024)
+
+struct wrap_cache
+{
+	unsigned int clock;
+	vector_t*    entries;
+	size_t       num_bytes;
+};
+
+struct wrap_entry
+{
+	uint32_t     hash;
+	unsigned int last_used;
+	wraptext_t*  lines;
+	char*        open_line;
+	int          open_width;
+	int          resume_line;
+	size_t       size;
+	char*        text;
+	size_t       text_len;
+	int          width;
+};
 
 struct font
 {
-	unsigned int  refcount;
-	unsigned int  id;
-	color_t       color_mask;
-	int           height;
-	int           max_width;
-	int           min_width;
-	bool          modified;
-	char*         path;
-	uint32_t      num_glyphs;
-	struct glyph* glyphs;
+	unsigned int      refcount;
+	unsigned int      id;
+	image_t*          atlas;
+	color_t           color_mask;
+	int               height;
+	int               max_width;
+	int               min_width;
+	bool              modified;
+	char*             path;
+	unsigned int      run_clock;
+	vector_t*         runs;
+	uint32_t          num_glyphs;
+	struct glyph*     glyphs;
+	struct wrap_cache wraps;
 };
 
 struct glyph
 {
 	int      width, height;
+	int      atlas_x, atlas_y;
 	image_t* image;
 };
 
+struct glyph_run
+{
+	uint32_t          hash;
+	unsigned int      last_used;
+	int               num_glyphs;
+	struct run_glyph* glyphs;
+	char*             text;
+	int               width;
+};
+
+struct run_glyph
+{
+	uint32_t index;
+	int      x;
+};
+
 struct ttf
 {
-	unsigned int  refcount;
-	unsigned int  id;
-	int           height;
-	char*         path;
-	font_t*       rfn_font;
-	ALLEGRO_FONT* ttf_font;
+	unsigned int      refcount;
+	unsigned int      id;
+	void*             file_data;
+	int               height;
+	char*             path;
+	font_t*           rfn_font;
+	ALLEGRO_FONT*     ttf_font;
+	struct wrap_cache wraps;
+};
+
+struct textlayout
+{
+	unsigned int refcount;
+	color_t      color;
+	ttf_t*       font;
+	int          height;
+	wraptext_t*  lines;
+	vector_t*    pages;
+	int          width;
+};
+
+struct layout_page
+{
+	ALLEGRO_BITMAP* bitmap;
+	int             max_vertices;
+	int             num_vertices;
+	ALLEGRO_VERTEX* vertices;
 };
 
 struct wraptext
@@ -95,8 +163,22 @@ struct rfn_glyph_header
 };
 #pragma pack(pop)
 
-static unsigned int s_next_font_id = 1;
-static unsigned int s_next_ttf_id = 1;
+static bool                     add_layout_glyph       (textlayout_t* layout, const ALLEGRO_GLYPH* glyph, float x, float y);
+static wraptext_t*              cache_wrap             (struct wrap_cache* cache, struct wrap_entry* entry);
+static void                     clear_wrap_cache       (struct wrap_cache* cache);
+static bool                     do_multiline_text_line (int line_idx, const char* line, int size, void* userdata);
+static const struct wrap_entry* find_wrap              (struct wrap_cache* cache, const char* text, int width, uint32_t hash, const struct wrap_entry* *out_prefix);
+static void                     free_glyph_runs        (font_t* font);
+static struct glyph_run*        get_glyph_run          (font_t* font, const char* text);
+static uint32_t                 glyph_index            (const font_t* font, uint32_t cp);
+static uint32_t                 hash_text              (const char* text);
+static void                     rebuild_atlas          (font_t* font);
+static void                     update_font_metrics    (font_t* font);
+
+static unsigned int    s_next_font_id = 1;
+static unsigned int    s_next_ttf_id = 1;
+static int             s_max_vertices = 0;
+static ALLEGRO_VERTEX* s_vertices = NULL;
 
 font_t*
 font_load(const char* filename)
@@ -121,6 +203,11 @@ font_load(const char* filename)
 
 	int i, x, y;
 
+	if ((font = asset_cache_get(CACHE_FONT, filename, 0))) {
+		console_log(2, "using cached font #%u for '%s'", font->id, filename);
+		return font;
+	}
+
 	console_log(2, "loading font #%u from '%s'", s_next_font_id, filename);
 
 	memset(&rfn, 0, sizeof(struct rfn_header));
@@ -172,6 +259,8 @@ font_load(const char* filename)
 			goto on_error;
 		atlas_x = i % n_glyphs_per_row * max_x;
 		atlas_y = i / n_glyphs_per_row * max_y;
+		glyph->atlas_x = atlas_x;
+		glyph->atlas_y = atlas_y;
 		switch (rfn.version) {
 		case 1: // RFN v1: 8-bit grayscale glyphs
 			if (!(glyph->image = image_new_slice(atlas, atlas_x, atlas_y, glyph_hdr.width, glyph_hdr.height)))
@@ -198,12 +287,16 @@ font_load(const char* filename)
 	}
 	image_unlock(atlas, lock);
 	file_close(file);
-	image_unref(atlas);
 
 	font->id = s_next_font_id++;
+	font->atlas = atlas;
 	font->color_mask = mk_color(255, 255, 255, 255);
 	font->path = strdup(filename);
-	return font_ref(font);
+	font->runs = vector_new(sizeof(struct glyph_run));
+	font->wraps.entries = vector_new(sizeof(struct wrap_entry));
+	font_ref(font);
+	asset_cache_put(CACHE_FONT, filename, 0, font, atlas_size_x * atlas_size_y * 4);
+	return font;
 
 on_error:
 	console_log(2, "failed to load font #%u", s_next_font_id++);
@@ -257,7 +350,13 @@ font_clone(const font_t* it)
 		dolly->glyphs[i].image = image_ref(src_glyph->image);
 		dolly->glyphs[i].width = src_glyph->width;
 		dolly->glyphs[i].height = src_glyph->height;
+		dolly->glyphs[i].atlas_x = src_glyph->atlas_x;
+		dolly->glyphs[i].atlas_y = src_glyph->atlas_y;
 	}
+	dolly->atlas = image_ref(it->atlas);
+	dolly->modified = it->modified;
+	dolly->runs = vector_new(sizeof(struct glyph_run));
+	dolly->wraps.entries = vector_new(sizeof(struct wrap_entry));
 
 	dolly->id = s_next_font_id++;
 	return font_ref(dolly);
@@ -290,8 +389,13 @@ font_unref(font_t* it)
 		return;
 
 	console_log(3, "disposing font #%u no longer in use", it->id);
+	free_glyph_runs(it);
+	vector_free(it->runs);
+	clear_wrap_cache(&it->wraps);
+	vector_free(it->wraps.entries);
 	for (i = 0; i < it->num_glyphs; ++i)
 		image_unref(it->glyphs[i].image);
+	image_unref(it->atlas);
 	free(it->glyphs);
 	free(it);
 }
@@ -314,6 +418,12 @@ font_path(const font_t* it)
 	return it->path;
 }
 
+int
+font_refcount(const font_t* it)
+{
+	return it->refcount;
+}
+
 color_t
 font_get_mask(const font_t* it)
 {
@@ -340,66 +450,67 @@ font_set_mask(font_t* it, color_t color)
 void
 font_draw_text(font_t* it, int x, int y, text_align_t alignment, const char* text)
 {
-	uint32_t       cp;
-	utf8_ret_t     ret;
-	int            tab_width;
-	utf8_decode_t* utf8;
+	ALLEGRO_COLOR           color;
+	const struct glyph*     glyph;
+	int                     num_vertices;
+	struct glyph_run*       run;
+	const struct run_glyph* run_glyph;
+	ALLEGRO_VERTEX*         vertex;
+	float                   x1, x2, y1, y2;
+	float                   u1, u2, v1, v2;
+
+	int i;
 
 	if (it->modified)
 		update_font_metrics(it);
 
+	if (!(run = get_glyph_run(it, text)))
+		return;
+
 	if (alignment == TEXT_ALIGN_CENTER)
-		x -= font_get_width(it, text) / 2;
+		x -= run->width / 2;
 	else if (alignment == TEXT_ALIGN_RIGHT)
-		x -= font_get_width(it, text);
-
-	tab_width = it->glyphs[' '].width * 3;
-	al_hold_bitmap_drawing(true);
-	utf8 = utf8_decode_start(true);
-	do {
-		while ((ret = utf8_decode_next(utf8, *text++, &cp)) == UTF8_CONTINUE);
-		if (ret == UTF8_RETRY)
-			--text;
-		cp = cp == 0x20AC ? 128
-			: cp == 0x201A ? 130
-			: cp == 0x0192 ? 131
-			: cp == 0x201E ? 132
-			: cp == 0x2026 ? 133
-			: cp == 0x2020 ? 134
-			: cp == 0x2021 ? 135
-			: cp == 0x02C6 ? 136
-			: cp == 0x2030 ? 137
-			: cp == 0x0160 ? 138
-			: cp == 0x2039 ? 139
-			: cp == 0x0152 ? 140
-			: cp == 0x017D ? 142
-			: cp == 0x2018 ? 145
-			: cp == 0x2019 ? 146
-			: cp == 0x201C ? 147
-			: cp == 0x201D ? 148
-			: cp == 0x2022 ? 149
-			: cp == 0x2013 ? 150
-			: cp == 0x2014 ? 151
-			: cp == 0x02DC ? 152
-			: cp == 0x2122 ? 153
-			: cp == 0x0161 ? 154
-			: cp == 0x203A ? 155
-			: cp == 0x0153 ? 156
-			: cp == 0x017E ? 158
-			: cp == 0x0178 ? 159
-			: cp;
-		cp = ret == UTF8_CODEPOINT
-			? cp < it->num_glyphs ? cp : 0x1A
-			: 0x1A;
-		if (cp == '\t')
-			x += tab_width;
-		else if (cp != '\0') {
-			image_draw_masked(it->glyphs[cp].image, it->color_mask, x, y);
-			x += it->glyphs[cp].width;
+		x -= run->width;
+
+	if (it->atlas == NULL) {
+		// no atlas, fall back on drawing one glyph at a time
+		al_hold_bitmap_drawing(true);
+		for (i = 0; i < run->num_glyphs; ++i) {
+			run_glyph = &run->glyphs[i];
+			image_draw_masked(it->glyphs[run_glyph->index].image, it->color_mask, x + run_glyph->x, y);
 		}
-	} while (cp != '\0');
-	utf8_decode_end(utf8);
-	al_hold_bitmap_drawing(false);
+		al_hold_bitmap_drawing(false);
+		return;
+	}
+
+	// draw the entire string in one go straight from the atlas
+	num_vertices = run->num_glyphs * 6;
+	if (num_vertices == 0)
+		return;
+	if (num_vertices > s_max_vertices) {
+		if (!(vertex = realloc(s_vertices, num_vertices * sizeof(ALLEGRO_VERTEX))))
+			return;
+		s_vertices = vertex;
+		s_max_vertices = num_vertices;
+	}
+	color = nativecolor(it->color_mask);
+	vertex = s_vertices;
+	for (i = 0; i < run->num_glyphs; ++i) {
+		run_glyph = &run->glyphs[i];
+		glyph = &it->glyphs[run_glyph->index];
+		x1 = x + run_glyph->x; x2 = x1 + glyph->width;
+		y1 = y; y2 = y1 + glyph->height;
+		u1 = glyph->atlas_x; u2 = u1 + glyph->width;
+		v1 = glyph->atlas_y; v2 = v1 + glyph->height;
+		vertex[0] = (ALLEGRO_VERTEX) { x1, y1, 0.0f, u1, v1, color };
+		vertex[1] = (ALLEGRO_VERTEX) { x2, y1, 0.0f, u2, v1, color };
+		vertex[2] = (ALLEGRO_VERTEX) { x1, y2, 0.0f, u1, v2, color };
+		vertex[3] = (ALLEGRO_VERTEX) { x2, y1, 0.0f, u2, v1, color };
+		vertex[4] = (ALLEGRO_VERTEX) { x2, y2, 0.0f, u2, v2, color };
+		vertex[5] = (ALLEGRO_VERTEX) { x1, y2, 0.0f, u1, v2, color };
+		vertex += 6;
+	}
+	al_draw_prim(s_vertices, NULL, image_bitmap(it->atlas), 0, num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
 }
 
 void
@@ -426,37 +537,7 @@ font_get_width(const font_t* it, const char* text)
 		while ((ret = utf8_decode_next(utf8, *text++, &cp)) == UTF8_CONTINUE);
 		if (ret == UTF8_RETRY)
 			--text;
-		cp = cp == 0x20AC ? 128
-			: cp == 0x201A ? 130
-			: cp == 0x0192 ? 131
-			: cp == 0x201E ? 132
-			: cp == 0x2026 ? 133
-			: cp == 0x2020 ? 134
-			: cp == 0x2021 ? 135
-			: cp == 0x02C6 ? 136
-			: cp == 0x2030 ? 137
-			: cp == 0x0160 ? 138
-			: cp == 0x2039 ? 139
-			: cp == 0x0152 ? 140
-			: cp == 0x017D ? 142
-			: cp == 0x2018 ? 145
-			: cp == 0x2019 ? 146
-			: cp == 0x201C ? 147
-			: cp == 0x201D ? 148
-			: cp == 0x2022 ? 149
-			: cp == 0x2013 ? 150
-			: cp == 0x2014 ? 151
-			: cp == 0x02DC ? 152
-			: cp == 0x2122 ? 153
-			: cp == 0x0161 ? 154
-			: cp == 0x203A ? 155
-			: cp == 0x0153 ? 156
-			: cp == 0x017E ? 158
-			: cp == 0x0178 ? 159
-			: cp;
-		cp = ret == UTF8_CODEPOINT
-			? cp < it->num_glyphs ? cp : 0x1A
-			: 0x1A;
+		cp = ret == UTF8_CODEPOINT ? glyph_index(it, cp) : 0x1A;
 		if (cp != '\0')
 			width += it->glyphs[cp].width;
 	} while (cp != '\0');
@@ -465,29 +546,43 @@ font_get_width(const font_t* it, const char* text)
 }
 
 wraptext_t*
-font_wrap(const font_t* font, const char* text, int width)
+font_wrap(font_t* font, const char* text, int width)
 {
-	char*          buffer = NULL;
-	uint8_t        ch_byte;
-	char*          carry;
-	size_t         ch_size;
-	uint32_t       cp;
-	int            glyph_width;
-	bool           is_line_end = false;
-	int            line_idx;
-	int            line_width;
-	int            max_lines = 10;
-	char*          last_break;
-	char*          last_space;
-	char*          last_tab;
-	char*          line_buffer;
-	size_t         line_length;
-	char*          new_buffer;
-	size_t         pitch;
-	utf8_ret_t     ret;
-	utf8_decode_t* utf8;
-	wraptext_t*    wraptext;
-	const char     *p, *start;
+	char*                    buffer = NULL;
+	uint8_t                  ch_byte;
+	char*                    carry = NULL;
+	size_t                   ch_size;
+	uint32_t                 cp;
+	struct wrap_entry        entry;
+	int                      glyph_width;
+	uint32_t                 hash;
+	bool                     is_line_end = false;
+	int                      line_idx;
+	int                      line_width;
+	int                      max_lines = 10;
+	char*                    last_break;
+	char*                    last_space;
+	char*                    last_tab;
+	char*                    line_buffer;
+	size_t                   line_length;
+	const struct wrap_entry* match;
+	char*                    new_buffer;
+	size_t                   pitch;
+	const struct wrap_entry* prefix;
+	utf8_ret_t               ret;
+	utf8_decode_t*           utf8;
+	wraptext_t*              wraptext = NULL;
+	const char               *p, *start;
+
+	hash = hash_text(text);
+	if ((match = find_wrap(&font->wraps, text, width, hash, &prefix)))
+		return wraptext_dup(match->lines);
+
+	memset(&entry, 0, sizeof(struct wrap_entry));
+	entry.hash = hash;
+	entry.text = strdup(text);
+	entry.text_len = strlen(text);
+	entry.width = width;
 
 	if (!(wraptext = calloc(1, sizeof(wraptext_t))))
 		goto on_error;
@@ -495,53 +590,48 @@ font_wrap(const font_t* font, const char* text, int width)
 	// allocate initial buffer
 	font_get_metrics(font, &glyph_width, NULL, NULL);
 	pitch = 4 * (glyph_width > 0 ? width / glyph_width : width) + 3;
+	if (prefix != NULL && prefix->lines->pitch != pitch)
+		prefix = NULL;
+	if (prefix != NULL && prefix->resume_line >= max_lines)
+		max_lines = (prefix->resume_line + 1) * 2;
 	if (!(buffer = malloc(max_lines * pitch)))
 		goto on_error;
-	carry = malloc(pitch);
+	if (!(carry = malloc(pitch)))
+		goto on_error;
 
 	// run through one character at a time, carrying as necessary
 	line_buffer = buffer; line_buffer[0] = '\0';
 	line_idx = 0; line_width = 0; line_length = 0;
 	memset(line_buffer, 0, pitch);  // fill line with NULs
-	utf8 = utf8_decode_start(true);
 	p = text;
+	if (prefix != NULL) {
+		// the cache has a wrap for the start of this text, e.g. a textbox typing
+		// it out one character at a time.  pick up from where that one ran out of
+		// text rather than starting over.
+		memcpy(buffer, prefix->lines->buffer, prefix->resume_line * pitch);
+		line_idx = prefix->resume_line;
+		line_buffer = buffer + line_idx * pitch;
+		memset(line_buffer, 0, pitch);
+		strcpy(line_buffer, prefix->open_line);
+		line_length = strlen(line_buffer);
+		line_width = prefix->open_width;
+		p = text + prefix->text_len;
+	}
+	utf8 = utf8_decode_start(true);
 	do {
 		start = p;
 		while ((ret = utf8_decode_next(utf8, ch_byte = *p++, &cp)) == UTF8_CONTINUE);
 		if (ret == UTF8_RETRY)
 			--p;
 		ch_size = p - start;
-		cp = cp == 0x20AC ? 128
-			: cp == 0x201A ? 130
-			: cp == 0x0192 ? 131
-			: cp == 0x201E ? 132
-			: cp == 0x2026 ? 133
-			: cp == 0x2020 ? 134
-			: cp == 0x2021 ? 135
-			: cp == 0x02C6 ? 136
-			: cp == 0x2030 ? 137
-			: cp == 0x0160 ? 138
-			: cp == 0x2039 ? 139
-			: cp == 0x0152 ? 140
-			: cp == 0x017D ? 142
-			: cp == 0x2018 ? 145
-			: cp == 0x2019 ? 146
-			: cp == 0x201C ? 147
-			: cp == 0x201D ? 148
-			: cp == 0x2022 ? 149
-			: cp == 0x2013 ? 150
-			: cp == 0x2014 ? 151
-			: cp == 0x02DC ? 152
-			: cp == 0x2122 ? 153
-			: cp == 0x0161 ? 154
-			: cp == 0x203A ? 155
-			: cp == 0x0153 ? 156
-			: cp == 0x017E ? 158
-			: cp == 0x0178 ? 159
-			: cp;
-		cp = ret == UTF8_CODEPOINT
-			? cp < (uint32_t)font->num_glyphs ? cp : 0x1A
-			: 0x1A;
+		cp = ret == UTF8_CODEPOINT ? glyph_index(font, cp) : 0x1A;
+		if (cp == '\0') {
+			// remember the state going into the end of the text so a longer
+			// version of it can be wrapped incrementally later.
+			entry.open_line = strdup(line_buffer);
+			entry.open_width = line_width;
+			entry.resume_line = line_idx;
+		}
 		switch (cp) {
 		case '\n': case '\r':  // explicit newline
 			if (cp == '\r' && *p == '\n')
@@ -597,15 +687,21 @@ font_wrap(const font_t* font, const char* text, int width)
 			strcpy(line_buffer, carry);
 		}
 	} while (cp != '\0');
+	utf8_decode_end(utf8);
 	free(carry);
 	wraptext->num_lines = line_idx;
+	wraptext->max_lines = max_lines;
 	wraptext->buffer = buffer;
 	wraptext->pitch = pitch;
-	return wraptext;
+	entry.lines = wraptext;
+	return cache_wrap(&font->wraps, &entry);
 
 on_error:
+	free(carry);
 	free(buffer);
 	free(wraptext);
+	free(entry.open_line);
+	free(entry.text);
 	return NULL;
 }
 
@@ -634,7 +730,9 @@ ttf_open(const char* path, int size, bool kerning, bool antialiasing)
 			flags |= ALLEGRO_TTF_MONOCHROME;
 		if (!(font->ttf_font = al_load_ttf_font_f(memfile, NULL, size, flags)))
 			goto on_error;
+		font->file_data = slurp;
 		font->height = al_get_font_line_height(font->ttf_font);
+		font->wraps.entries = vector_new(sizeof(struct wrap_entry));
 	}
 	else {
 		font->rfn_font = rfn_font;
@@ -650,6 +748,45 @@ on_error:
 	return NULL;
 }
 
+ttf_t*
+ttf_from_data(const char* path, void* data, size_t data_size, int size, bool kerning, bool antialiasing)
+{
+	// note: this takes ownership of `data`, normally read in on a worker thread.
+	//       FreeType reads glyphs from it on demand, so it lives as long as the
+	//       font does.
+	int           flags = 0x0;
+	ttf_t*        font;
+	ALLEGRO_FILE* memfile;
+
+	if (data_size >= 4 && memcmp(data, ".rfn", 4) == 0) {
+		// RFN fonts are small enough that it's not worth special-casing them
+		free(data);
+		return ttf_open(path, size, kerning, antialiasing);
+	}
+
+	if (!(font = calloc(1, sizeof(ttf_t))))
+		goto on_error;
+	if (!(memfile = al_open_memfile(data, data_size, "rb")))
+		goto on_error;
+	if (!kerning)
+		flags |= ALLEGRO_TTF_NO_KERNING;
+	if (!antialiasing)
+		flags |= ALLEGRO_TTF_MONOCHROME;
+	if (!(font->ttf_font = al_load_ttf_font_f(memfile, NULL, size, flags)))
+		goto on_error;
+	font->file_data = data;
+	font->height = al_get_font_line_height(font->ttf_font);
+	font->wraps.entries = vector_new(sizeof(struct wrap_entry));
+	font->id = s_next_ttf_id++;
+	font->path = strdup(path);
+	return ttf_ref(font);
+
+on_error:
+	free(font);
+	free(data);
+	return NULL;
+}
+
 ttf_t*
 ttf_from_rfn(font_t* font)
 {
@@ -685,6 +822,9 @@ ttf_unref(ttf_t* it)
 		al_destroy_font(it->ttf_font);
 	else
 		font_unref(it->rfn_font);
+	free(it->file_data);
+	clear_wrap_cache(&it->wraps);
+	vector_free(it->wraps.entries);
 	free(it);
 }
 
@@ -700,6 +840,28 @@ ttf_path(const ttf_t* it)
 	return it->path;
 }
 
+int
+ttf_preload(ttf_t* it, uint32_t first_cp, uint32_t last_cp)
+{
+	// note: Allegro's TTF addon already packs glyphs into page bitmaps as they're
+	//       first used, so those pages serve as our atlas.  this just rasterizes
+	//       a range of glyphs ahead of time so text drawn later in the game
+	//       doesn't stall on FreeType mid-frame.
+	uint32_t      cp;
+	ALLEGRO_GLYPH glyph;
+	int           num_glyphs = 0;
+
+	if (it->ttf_font == NULL)
+		return 0;  // RFN glyphs are always in memory
+	for (cp = first_cp; cp <= last_cp && cp <= 0x10FFFF; ++cp) {
+		if (al_get_glyph(it->ttf_font, -1, (int)cp, &glyph) && glyph.bitmap != NULL)
+			++num_glyphs;
+	}
+	console_log(3, "preloaded %d glyphs [U+%04X-U+%04X] for TTF font #%u",
+		num_glyphs, (unsigned int)first_cp, (unsigned int)last_cp, it->id);
+	return num_glyphs;
+}
+
 void
 ttf_draw_text(const ttf_t* it, int x, int y, const char* text, color_t color)
 {
@@ -723,21 +885,196 @@ ttf_get_width(const ttf_t* it, const char* text)
 }
 
 wraptext_t*
-ttf_wrap(const ttf_t* it, const char* text, int width)
+ttf_wrap(ttf_t* it, const char* text, int width)
 {
-	wraptext_t* wraptext;
+	struct wrap_entry        entry;
+	uint32_t                 hash;
+	const struct wrap_entry* match;
+	wraptext_t*              wraptext;
 	
 	if (it->ttf_font != NULL) {
+		hash = hash_text(text);
+		if ((match = find_wrap(&it->wraps, text, width, hash, NULL)))
+			return wraptext_dup(match->lines);
 		if (!(wraptext = wraptext_new(256)))
 			return NULL;
 		al_do_multiline_text(it->ttf_font, width, text, do_multiline_text_line, wraptext);
-		return wraptext;
+		memset(&entry, 0, sizeof(struct wrap_entry));
+		entry.hash = hash;
+		entry.lines = wraptext;
+		entry.text = strdup(text);
+		entry.text_len = strlen(text);
+		entry.width = width;
+		return cache_wrap(&it->wraps, &entry);
 	}
 	else {
 		return font_wrap(it->rfn_font, text, width);
 	}
 }
 
+textlayout_t*
+textlayout_new(ttf_t* font, const char* text, int width)
+{
+	uint32_t       cp;
+	ALLEGRO_GLYPH  glyph;
+	int            line_width;
+	textlayout_t*  layout;
+	const char*    line;
+	int            prev_cp;
+	utf8_ret_t     ret;
+	utf8_decode_t* utf8;
+	float          x;
+	float          y;
+
+	int i;
+
+	if (!(layout = calloc(1, sizeof(textlayout_t))))
+		goto on_error;
+	if (width > 0) {
+		if (!(layout->lines = ttf_wrap(font, text, width)))
+			goto on_error;
+	}
+	else {
+		if (!(layout->lines = wraptext_new(strlen(text) + 1)))
+			goto on_error;
+		wraptext_add_line(layout->lines, text, strlen(text));
+	}
+	if (!(layout->pages = vector_new(sizeof(struct layout_page))))
+		goto on_error;
+
+	layout->color = mk_color(255, 255, 255, 255);
+	layout->height = wraptext_len(layout->lines) * ttf_height(font);
+	for (i = 0; i < wraptext_len(layout->lines); ++i) {
+		line = wraptext_line(layout->lines, i);
+		if (font->ttf_font == NULL) {
+			// legacy RFN font mode, lines are drawn using font_draw_text()
+			line_width = font_get_width(font->rfn_font, line);
+		}
+		else {
+			// shape the line up front.  each glyph is a quad sourced from whatever
+			// TTF cache page it lives on; drawing the layout later is then just
+			// one al_draw_prim() per page.
+			utf8 = utf8_decode_start(false);
+			prev_cp = -1;
+			x = 0.0f;
+			y = (float)(i * font->height);
+			do {
+				while ((ret = utf8_decode_next(utf8, *line++, &cp)) == UTF8_CONTINUE);
+				if (ret == UTF8_RETRY)
+					--line;
+				if (ret != UTF8_CODEPOINT)
+					cp = 0xFFFD;
+				if (cp == '\0')
+					break;
+				if (!al_get_glyph(font->ttf_font, prev_cp, (int)cp, &glyph))
+					continue;
+				x += glyph.kerning;
+				if (glyph.bitmap != NULL && !add_layout_glyph(layout, &glyph, x, y))
+					goto on_error;
+				x += glyph.advance;
+				prev_cp = (int)cp;
+			} while (cp != '\0');
+			utf8_decode_end(utf8);
+			line_width = (int)ceilf(x);
+		}
+		if (line_width > layout->width)
+			layout->width = line_width;
+	}
+
+	layout->font = ttf_ref(font);
+	return textlayout_ref(layout);
+
+on_error:
+	textlayout_unref(layout);
+	return NULL;
+}
+
+textlayout_t*
+textlayout_ref(textlayout_t* it)
+{
+	++it->refcount;
+	return it;
+}
+
+void
+textlayout_unref(textlayout_t* it)
+{
+	struct layout_page* page;
+
+	iter_t iter;
+
+	if (it == NULL || --it->refcount > 0)
+		return;
+
+	if (it->pages != NULL) {
+		iter = vector_enum(it->pages);
+		while ((page = iter_next(&iter)))
+			free(page->vertices);
+		vector_free(it->pages);
+	}
+	wraptext_free(it->lines);
+	ttf_unref(it->font);
+	free(it);
+}
+
+ttf_t*
+textlayout_font(const textlayout_t* it)
+{
+	return it->font;
+}
+
+int
+textlayout_height(const textlayout_t* it)
+{
+	return it->height;
+}
+
+int
+textlayout_width(const textlayout_t* it)
+{
+	return it->width;
+}
+
+void
+textlayout_draw(textlayout_t* it, int x, int y, color_t color)
+{
+	ALLEGRO_COLOR       native_color;
+	ALLEGRO_TRANSFORM   old_transform;
+	struct layout_page* page;
+	ALLEGRO_TRANSFORM   transform;
+
+	iter_t iter;
+	int    i;
+
+	if (it->font->ttf_font == NULL) {
+		for (i = 0; i < wraptext_len(it->lines); ++i)
+			ttf_draw_text(it->font, x, y + i * it->font->height, wraptext_line(it->lines, i), color);
+		return;
+	}
+
+	// the vertex colors are baked into the layout, so they only need to be
+	// rewritten when the text is drawn in a different color than last time.
+	if (memcmp(&color, &it->color, sizeof(color_t)) != 0) {
+		native_color = nativecolor(color);
+		iter = vector_enum(it->pages);
+		while ((page = iter_next(&iter))) {
+			for (i = 0; i < page->num_vertices; ++i)
+				page->vertices[i].color = native_color;
+		}
+		it->color = color;
+	}
+
+	al_copy_transform(&old_transform, al_get_current_transform());
+	al_identity_transform(&transform);
+	al_translate_transform(&transform, x, y);
+	al_compose_transform(&transform, &old_transform);
+	al_use_transform(&transform);
+	iter = vector_enum(it->pages);
+	while ((page = iter_next(&iter)))
+		al_draw_prim(page->vertices, NULL, page->bitmap, 0, page->num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+	al_use_transform(&old_transform);
+}
+
 wraptext_t*
 wraptext_new(size_t pitch)
 {
@@ -760,6 +1097,30 @@ on_error:
 	return NULL;
 }
 
+wraptext_t*
+wraptext_dup(const wraptext_t* it)
+{
+	char*       buffer;
+	int         max_lines;
+	wraptext_t* wraptext;
+
+	max_lines = it->num_lines > 0 ? it->num_lines : 1;
+	if (!(buffer = malloc(max_lines * it->pitch)))
+		goto on_error;
+	if (!(wraptext = calloc(1, sizeof(wraptext_t))))
+		goto on_error;
+	memcpy(buffer, it->buffer, it->num_lines * it->pitch);
+	wraptext->buffer = buffer;
+	wraptext->max_lines = max_lines;
+	wraptext->num_lines = it->num_lines;
+	wraptext->pitch = it->pitch;
+	return wraptext;
+
+on_error:
+	free(buffer);
+	return NULL;
+}
+
 void
 wraptext_free(wraptext_t* it)
 {
@@ -832,6 +1193,355 @@ do_multiline_text_line(int line_idx, const char* line, int size, void* userdata)
 	return true;
 }
 
+static bool
+add_layout_glyph(textlayout_t* layout, const ALLEGRO_GLYPH* glyph, float x, float y)
+{
+	ALLEGRO_COLOR       color;
+	int                 max_vertices;
+	struct layout_page  new_page;
+	ALLEGRO_VERTEX*     new_vertices;
+	struct layout_page* page = NULL;
+	float               x1, x2, y1, y2;
+	float               u1, u2, v1, v2;
+	ALLEGRO_VERTEX*     v;
+
+	iter_t iter;
+
+	iter = vector_enum(layout->pages);
+	while ((page = iter_next(&iter))) {
+		if (page->bitmap == glyph->bitmap)
+			break;
+	}
+	if (page == NULL) {
+		memset(&new_page, 0, sizeof(struct layout_page));
+		new_page.bitmap = glyph->bitmap;
+		if (!vector_push(layout->pages, &new_page))
+			return false;
+		page = vector_get(layout->pages, vector_len(layout->pages) - 1);
+	}
+	if (page->num_vertices + 6 > page->max_vertices) {
+		max_vertices = page->max_vertices * 2 + 96;
+		if (!(new_vertices = realloc(page->vertices, max_vertices * sizeof(ALLEGRO_VERTEX))))
+			return false;
+		page->vertices = new_vertices;
+		page->max_vertices = max_vertices;
+	}
+
+	color = nativecolor(layout->color);
+	x1 = x + glyph->offset_x; x2 = x1 + glyph->w;
+	y1 = y + glyph->offset_y; y2 = y1 + glyph->h;
+	u1 = glyph->x; u2 = u1 + glyph->w;
+	v1 = glyph->y; v2 = v1 + glyph->h;
+	v = &page->vertices[page->num_vertices];
+	v[0] = (ALLEGRO_VERTEX) { x1, y1, 0.0f, u1, v1, color };
+	v[1] = (ALLEGRO_VERTEX) { x2, y1, 0.0f, u2, v1, color };
+	v[2] = (ALLEGRO_VERTEX) { x1, y2, 0.0f, u1, v2, color };
+	v[3] = (ALLEGRO_VERTEX) { x2, y1, 0.0f, u2, v1, color };
+	v[4] = (ALLEGRO_VERTEX) { x2, y2, 0.0f, u2, v2, color };
+	v[5] = (ALLEGRO_VERTEX) { x1, y2, 0.0f, u1, v2, color };
+	page->num_vertices += 6;
+	return true;
+}
+
+static wraptext_t*
+cache_wrap(struct wrap_cache* cache, struct wrap_entry* entry)
+{
+	// note: the cache takes ownership of the entry and hands back a copy of the
+	//       wrapped lines for the caller to free.  if the text is too big to be
+	//       worth caching, the original is handed back instead.
+	struct wrap_entry* stale_entry;
+	int                stale_index;
+	wraptext_t*        wraptext;
+
+	iter_t iter;
+
+	entry->size = sizeof(struct wrap_entry) + entry->text_len + 1
+		+ entry->lines->num_lines * entry->lines->pitch;
+	if (entry->open_line != NULL)
+		entry->size += strlen(entry->open_line) + 1;
+	if (entry->text == NULL || entry->size > MAX_WRAP_BYTES / 4)
+		goto no_cache;
+
+	while (vector_len(cache->entries) >= MAX_WRAP_ENTRIES
+		|| cache->num_bytes + entry->size > MAX_WRAP_BYTES)
+	{
+		stale_entry = NULL;
+		stale_index = 0;
+		iter = vector_enum(cache->entries);
+		while (iter_next(&iter)) {
+			if (stale_entry == NULL || ((struct wrap_entry*)iter.ptr)->last_used < stale_entry->last_used) {
+				stale_entry = iter.ptr;
+				stale_index = iter.index;
+			}
+		}
+		cache->num_bytes -= stale_entry->size;
+		wraptext_free(stale_entry->lines);
+		free(stale_entry->open_line);
+		free(stale_entry->text);
+		vector_remove(cache->entries, stale_index);
+	}
+	if (!(wraptext = wraptext_dup(entry->lines)))
+		goto no_cache;
+	entry->last_used = cache->clock;
+	if (!vector_push(cache->entries, entry)) {
+		wraptext_free(wraptext);
+		goto no_cache;
+	}
+	cache->num_bytes += entry->size;
+	return wraptext;
+
+no_cache:
+	free(entry->open_line);
+	free(entry->text);
+	return entry->lines;
+}
+
+static void
+clear_wrap_cache(struct wrap_cache* cache)
+{
+	struct wrap_entry* entry;
+
+	iter_t iter;
+
+	if (cache->entries == NULL)
+		return;
+	iter = vector_enum(cache->entries);
+	while ((entry = iter_next(&iter))) {
+		wraptext_free(entry->lines);
+		free(entry->open_line);
+		free(entry->text);
+	}
+	vector_clear(cache->entries);
+	cache->num_bytes = 0;
+}
+
+static const struct wrap_entry*
+find_wrap(struct wrap_cache* cache, const char* text, int width, uint32_t hash, const struct wrap_entry* *out_prefix)
+{
+	struct wrap_entry* entry;
+	struct wrap_entry* prefix = NULL;
+	size_t             text_len;
+
+	iter_t iter;
+
+	if (out_prefix != NULL)
+		*out_prefix = NULL;
+	if (cache->entries == NULL)
+		return NULL;
+
+	text_len = strlen(text);
+	++cache->clock;
+	iter = vector_enum(cache->entries);
+	while ((entry = iter_next(&iter))) {
+		if (entry->width != width)
+			continue;
+		if (entry->hash == hash && strcmp(entry->text, text) == 0) {
+			entry->last_used = cache->clock;
+			return entry;
+		}
+
+		// a wrap of the start of this text can be resumed as long as it didn't end
+		// in the middle of a UTF-8 sequence.
+		if (out_prefix != NULL && entry->open_line != NULL
+			&& entry->text_len < text_len
+			&& (prefix == NULL || entry->text_len > prefix->text_len)
+			&& ((uint8_t)text[entry->text_len] & 0xC0) != 0x80
+			&& memcmp(entry->text, text, entry->text_len) == 0)
+		{
+			prefix = entry;
+		}
+	}
+	if (prefix != NULL) {
+		prefix->last_used = cache->clock;
+		*out_prefix = prefix;
+	}
+	return NULL;
+}
+
+static void
+free_glyph_runs(font_t* font)
+{
+	struct glyph_run* run;
+
+	iter_t iter;
+
+	iter = vector_enum(font->runs);
+	while ((run = iter_next(&iter))) {
+		free(run->glyphs);
+		free(run->text);
+	}
+	vector_clear(font->runs);
+}
+
+static struct glyph_run*
+get_glyph_run(font_t* font, const char* text)
+{
+	// note: laying out a string means decoding UTF-8 and mapping every character to
+	//       a glyph, so the result is cached and keyed by the string itself.  games
+	//       tend to draw the same strings every frame (menus, dialogue, HUD labels).
+
+	uint32_t          cp;
+	uint32_t          hash;
+	int               max_glyphs;
+	struct run_glyph* new_glyphs;
+	struct glyph_run  new_run;
+	utf8_ret_t        ret;
+	struct glyph_run* run;
+	struct glyph_run* stale_run = NULL;
+	int               tab_width;
+	utf8_decode_t*    utf8;
+	int               x = 0;
+
+	iter_t iter;
+
+	hash = hash_text(text);
+	++font->run_clock;
+	iter = vector_enum(font->runs);
+	while ((run = iter_next(&iter))) {
+		if (run->hash == hash && strcmp(run->text, text) == 0) {
+			run->last_used = font->run_clock;
+			return run;
+		}
+		if (stale_run == NULL || run->last_used < stale_run->last_used)
+			stale_run = run;
+	}
+
+	// cache miss, lay out the string
+	memset(&new_run, 0, sizeof(struct glyph_run));
+	max_glyphs = (int)strlen(text);
+	if (!(new_run.glyphs = malloc((max_glyphs > 0 ? max_glyphs : 1) * sizeof(struct run_glyph))))
+		goto on_error;
+	if (!(new_run.text = strdup(text)))
+		goto on_error;
+	tab_width = font->glyphs[' '].width * 3;
+	utf8 = utf8_decode_start(true);
+	do {
+		while ((ret = utf8_decode_next(utf8, *text++, &cp)) == UTF8_CONTINUE);
+		if (ret == UTF8_RETRY)
+			--text;
+		cp = ret == UTF8_CODEPOINT ? glyph_index(font, cp) : 0x1A;
+		if (cp == '\0')
+			break;
+		new_run.width += font->glyphs[cp].width;
+		if (cp == '\t') {
+			x += tab_width;
+		}
+		else {
+			if (new_run.num_glyphs >= max_glyphs) {
+				// invalid sequences can produce more glyphs than there are bytes
+				max_glyphs = max_glyphs * 2 + 8;
+				if (!(new_glyphs = realloc(new_run.glyphs, max_glyphs * sizeof(struct run_glyph)))) {
+					utf8_decode_end(utf8);
+					goto on_error;
+				}
+				new_run.glyphs = new_glyphs;
+			}
+			new_run.glyphs[new_run.num_glyphs].index = cp;
+			new_run.glyphs[new_run.num_glyphs].x = x;
+			++new_run.num_glyphs;
+			x += font->glyphs[cp].width;
+		}
+	} while (cp != '\0');
+	utf8_decode_end(utf8);
+	new_run.hash = hash;
+	new_run.last_used = font->run_clock;
+
+	if (vector_len(font->runs) < MAX_GLYPH_RUNS) {
+		if (!vector_push(font->runs, &new_run))
+			goto on_error;
+		return vector_get(font->runs, vector_len(font->runs) - 1);
+	}
+	else {
+		free(stale_run->glyphs);
+		free(stale_run->text);
+		*stale_run = new_run;
+		return stale_run;
+	}
+
+on_error:
+	free(new_run.glyphs);
+	free(new_run.text);
+	return NULL;
+}
+
+static uint32_t
+glyph_index(const font_t* font, uint32_t cp)
+{
+	// Sphere fonts are indexed by Windows-1252 code, so map Unicode characters in the
+	// 80-9F block of that code page back to their original slots.
+	if (cp >= 0x100) {
+		switch (cp) {
+		case 0x20AC: cp = 128; break;
+		case 0x201A: cp = 130; break;
+		case 0x0192: cp = 131; break;
+		case 0x201E: cp = 132; break;
+		case 0x2026: cp = 133; break;
+		case 0x2020: cp = 134; break;
+		case 0x2021: cp = 135; break;
+		case 0x02C6: cp = 136; break;
+		case 0x2030: cp = 137; break;
+		case 0x0160: cp = 138; break;
+		case 0x2039: cp = 139; break;
+		case 0x0152: cp = 140; break;
+		case 0x017D: cp = 142; break;
+		case 0x2018: cp = 145; break;
+		case 0x2019: cp = 146; break;
+		case 0x201C: cp = 147; break;
+		case 0x201D: cp = 148; break;
+		case 0x2022: cp = 149; break;
+		case 0x2013: cp = 150; break;
+		case 0x2014: cp = 151; break;
+		case 0x02DC: cp = 152; break;
+		case 0x2122: cp = 153; break;
+		case 0x0161: cp = 154; break;
+		case 0x203A: cp = 155; break;
+		case 0x0153: cp = 156; break;
+		case 0x017E: cp = 158; break;
+		case 0x0178: cp = 159; break;
+		}
+	}
+	return cp < font->num_glyphs ? cp : 0x1A;
+}
+
+static uint32_t
+hash_text(const char* text)
+{
+	uint32_t hash = 2166136261u;
+
+	const char* p;
+
+	for (p = text; *p != '\0'; ++p)
+		hash = (hash ^ (uint8_t)*p) * 16777619u;  // FNV-1a
+	return hash;
+}
+
+static void
+rebuild_atlas(font_t* font)
+{
+	image_t*      atlas;
+	struct glyph* glyph;
+	int           glyphs_per_row;
+
+	uint32_t i;
+
+	// glyphs replaced by the game won't be part of the existing atlas, so blit
+	// everything into a new one
+	image_unref(font->atlas);
+	font->atlas = NULL;
+	if (font->max_width <= 0 || font->height <= 0)
+		return;
+	glyphs_per_row = ceil(sqrt(font->num_glyphs));
+	if (!(atlas = image_new(font->max_width * glyphs_per_row, font->height * glyphs_per_row, NULL)))
+		return;
+	for (i = 0; i < font->num_glyphs; ++i) {
+		glyph = &font->glyphs[i];
+		glyph->atlas_x = i % glyphs_per_row * font->max_width;
+		glyph->atlas_y = i / glyphs_per_row * font->height;
+		image_blit(glyph->image, atlas, glyph->atlas_x, glyph->atlas_y);
+	}
+	font->atlas = atlas;
+}
+
 static void
 update_font_metrics(font_t* font)
 {
@@ -851,5 +1561,9 @@ update_font_metrics(font_t* font)
 	font->max_width = max_x;
 	font->height = max_y;
 
+	free_glyph_runs(font);
+	clear_wrap_cache(&font->wraps);
+	rebuild_atlas(font);
+
 	font->modified = false;
 }
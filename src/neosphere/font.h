@@ -36,9 +36,10 @@
 #include "color.h"
 #include "image.h"
 
-typedef struct font     font_t;
-typedef struct ttf      ttf_t;
-typedef struct wraptext wraptext_t;
+typedef struct font       font_t;
+typedef struct textlayout textlayout_t;
+typedef struct ttf        ttf_t;
+typedef struct wraptext   wraptext_t;
 
 typedef
 enum text_align
@@ -55,25 +56,37 @@ void        font_unref        (font_t* it);
 image_t*    font_glyph        (const font_t* it, uint32_t cp);
 int         font_height       (const font_t* it);
 const char* font_path         (const font_t* it);
+int         font_refcount     (const font_t* it);
 void        font_draw_text    (font_t* it, int x, int y, text_align_t alignment, const char* text);
 color_t     font_get_mask     (const font_t* it);
 void        font_get_metrics  (const font_t* it, int* min_width, int* max_width, int* out_line_height);
 int         font_get_width    (const font_t* it, const char* text);
 void        font_set_glyph    (font_t* it, uint32_t cp, image_t* image);
 void        font_set_mask     (font_t* it, color_t color);
-wraptext_t* font_wrap         (const font_t* font, const char* text, int width);
+wraptext_t* font_wrap         (font_t* font, const char* text, int width);
 
 ttf_t*      ttf_open          (const char* path, int size, bool kerning, bool antialiasing);
+ttf_t*      ttf_from_data     (const char* path, void* data, size_t data_size, int size, bool kerning, bool antialiasing);
 ttf_t*      ttf_from_rfn      (font_t* font);
 ttf_t*      ttf_ref           (ttf_t* it);
 void        ttf_unref         (ttf_t* it);
 int         ttf_height        (const ttf_t* it);
 const char* ttf_path          (const ttf_t* it);
+int         ttf_preload       (ttf_t* it, uint32_t first_cp, uint32_t last_cp);
 void        ttf_draw_text     (const ttf_t* it, int x, int y, const char* text, color_t color);
 int         ttf_get_width     (const ttf_t* it, const char* text);
-wraptext_t* ttf_wrap          (const ttf_t* it, const char* text, int width);
+wraptext_t* ttf_wrap          (ttf_t* it, const char* text, int width);
+
+textlayout_t* textlayout_new    (ttf_t* font, const char* text, int width);
+textlayout_t* textlayout_ref    (textlayout_t* it);
+void          textlayout_unref  (textlayout_t* it);
+ttf_t*        textlayout_font   (const textlayout_t* it);
+int           textlayout_height (const textlayout_t* it);
+int           textlayout_width  (const textlayout_t* it);
+void          textlayout_draw   (textlayout_t* it, int x, int y, color_t color);
 
 wraptext_t* wraptext_new      (size_t pitch);
+wraptext_t* wraptext_dup      (const wraptext_t* it);
 void        wraptext_free     (wraptext_t* it);
 int         wraptext_len      (const wraptext_t* it);
 const char* wraptext_line     (const wraptext_t* it, int line_index);
@@ -36,8 +36,10 @@
 #include "color.h"
 #include "vector.h"
 
-static void free_cached_uniform (shader_t* shader, const char* name);
-static void render_shape        (shape_t* shape);
+// shapes with more vertices than this are drawn straight from their own VBO, it's
+// cheaper than streaming them.  the batch itself is flushed when it fills up.
+#define MAX_BATCH_SHAPE_SIZE 256
+#define MAX_BATCH_VERTICES   65536
 
 enum uniform_type
 {
@@ -55,8 +57,11 @@ enum uniform_type
 struct uniform
 {
 	char              name[256];
+	uint32_t          hash;
+	bool              dirty;
 	enum uniform_type type;
 	int               num_values;
+	int               max_values;
 	union {
 		bool              bool_value;
 		int*              int_list;
@@ -73,6 +78,18 @@ struct uniform
 	};
 };
 
+struct batch
+{
+	int          draw_mode;
+	vector_t*    indices;
+	transform_t* modelview;
+	int          num_shapes;
+	shader_t*    shader;
+	image_t*     surface;
+	image_t*     texture;
+	vector_t*    vertices;
+};
+
 struct ibo
 {
 	unsigned int          refcount;
@@ -116,7 +133,20 @@ struct vbo
 	vector_t*              vertices;
 };
 
+static bool            batch_shape       (shape_t* shape, image_t* surface, shader_t* shader, transform_t* transform);
+static void            commit_uniform    (shader_t* shader, struct uniform* uniform);
+static void            free_uniform      (struct uniform* uniform);
+static struct uniform* get_uniform       (shader_t* shader, const char* name, enum uniform_type type, int num_values, bool *out_is_new);
+static void            render_shape      (shape_t* shape);
+static void            render_unbuffered (shape_t* shape, ALLEGRO_BITMAP* bitmap, int draw_mode);
+static void            reset_batch       (void);
+static void            upload_uniform    (struct uniform* uniform);
+
+static struct batch s_batch;
+static int          s_batch_draws = 0;
+static int          s_batch_shapes = 0;
 static shader_t*    s_def_shader;
+static int          s_draws_saved = 0;
 static shader_t*    s_last_shader;
 static unsigned int s_next_model_id = 1;
 static unsigned int s_next_shader_id = 1;
@@ -128,12 +158,24 @@ galileo_init(void)
 	console_log(1, "initializing Galileo subsystem");
 	s_def_shader = NULL;
 	s_last_shader = NULL;
+
+	memset(&s_batch, 0, sizeof(struct batch));
+	s_batch.vertices = vector_new(sizeof(ALLEGRO_VERTEX));
+	s_batch.indices = vector_new(sizeof(int));
+	vector_reserve(s_batch.vertices, 1024);
+	vector_reserve(s_batch.indices, 1536);
 }
 
 void
 galileo_uninit(void)
 {
 	console_log(1, "shutting down Galileo subsystem");
+
+	// anything still batched at this point will never be seen, so just drop it
+	reset_batch();
+	vector_free(s_batch.vertices);
+	vector_free(s_batch.indices);
+
 	shader_unref(s_def_shader);
 }
 
@@ -149,6 +191,40 @@ galileo_shader(void)
 	return s_def_shader;
 }
 
+int
+galileo_draws_saved(void)
+{
+	return s_draws_saved;
+}
+
+void
+galileo_end_frame(void)
+{
+	galileo_flush();
+	s_draws_saved = s_batch_shapes - s_batch_draws;
+	s_batch_draws = 0;
+	s_batch_shapes = 0;
+}
+
+void
+galileo_flush(void)
+{
+	ALLEGRO_BITMAP* bitmap;
+
+	// note: the render target and shader were set up when the batch was started and
+	//       anything that changes render state flushes first, so we can draw as-is.
+
+	if (s_batch.num_shapes == 0)
+		return;
+	bitmap = s_batch.texture != NULL ? image_bitmap(s_batch.texture) : NULL;
+	al_draw_indexed_prim(vector_get(s_batch.vertices, 0), NULL, bitmap,
+		vector_get(s_batch.indices, 0), vector_len(s_batch.indices),
+		s_batch.draw_mode);
+	++s_batch_draws;
+	s_batch_shapes += s_batch.num_shapes;
+	reset_batch();
+}
+
 void
 galileo_reset(void)
 {
@@ -225,6 +301,11 @@ ibo_upload(ibo_t* it)
 		it->buffer = NULL;
 	}
 
+	// in headless mode there's no GPU to upload to; the index list is kept on the
+	// CPU side and render_shape() draws from that instead.
+	if (g_headless)
+		return true;
+
 	// create the index buffer object
 	if (!(buffer = al_create_index_buffer(2, NULL, vector_len(it->indices), ALLEGRO_PRIM_BUFFER_STATIC)))
 		return false;
@@ -334,14 +415,21 @@ model_add_shape(model_t* it, shape_t* shape)
 void
 model_draw(const model_t* it, image_t* surface)
 {
-	iter_t iter;
+	shader_t* shader;
+	shape_t*  shape;
 
-	image_render_to(surface, it->transform);
-	shader_use(it->shader != NULL ? it->shader : galileo_shader(), false);
+	iter_t iter;
 
+	shader = it->shader != NULL ? it->shader : galileo_shader();
 	iter = vector_enum(it->shapes);
-	while (iter_next(&iter))
-		render_shape(*(shape_t**)iter.ptr);
+	while (iter_next(&iter)) {
+		shape = *(shape_t**)iter.ptr;
+		if (batch_shape(shape, surface, shader, it->transform))
+			continue;
+		image_render_to(surface, it->transform);
+		shader_use(shader, false);
+		render_shape(shape);
+	}
 }
 
 shader_t*
@@ -360,19 +448,26 @@ shader_new(const char* vert_filename, const char* frag_filename)
 		goto on_error;
 	if (!(frag_source = game_read_file(g_game, frag_filename, NULL)))
 		goto on_error;
-	if (!(shader->program = al_create_shader(ALLEGRO_SHADER_GLSL)))
-		goto on_error;
-	if (!al_attach_shader_source(shader->program, ALLEGRO_VERTEX_SHADER, vert_source)) {
-		fprintf(stderr, "\nvertex shader compile log:\n%s\n", al_get_shader_log(shader->program));
-		goto on_error;
+	if (g_headless) {
+		// note: shaders can't be compiled without a display.  the program is left
+		//       NULL, so anything drawn with this shader uses the fixed pipeline.
+		console_log(2, "    headless, not compiling shader program");
 	}
-	if (!al_attach_shader_source(shader->program, ALLEGRO_PIXEL_SHADER, frag_source)) {
-		fprintf(stderr, "\nfragment shader compile log:\n%s\n", al_get_shader_log(shader->program));
-		goto on_error;
-	}
-	if (!al_build_shader(shader->program)) {
-		fprintf(stderr, "\nerror building shader program:\n%s\n", al_get_shader_log(shader->program));
-		goto on_error;
+	else {
+		if (!(shader->program = al_create_shader(ALLEGRO_SHADER_GLSL)))
+			goto on_error;
+		if (!al_attach_shader_source(shader->program, ALLEGRO_VERTEX_SHADER, vert_source)) {
+			fprintf(stderr, "\nvertex shader compile log:\n%s\n", al_get_shader_log(shader->program));
+			goto on_error;
+		}
+		if (!al_attach_shader_source(shader->program, ALLEGRO_PIXEL_SHADER, frag_source)) {
+			fprintf(stderr, "\nfragment shader compile log:\n%s\n", al_get_shader_log(shader->program));
+			goto on_error;
+		}
+		if (!al_build_shader(shader->program)) {
+			fprintf(stderr, "\nerror building shader program:\n%s\n", al_get_shader_log(shader->program));
+			goto on_error;
+		}
 	}
 	free(vert_source);
 	free(frag_source);
@@ -425,21 +520,11 @@ shader_unref(shader_t* it)
 	console_log(3, "disposing shader program #%u no longer in use", it->id);
 
 	iter = vector_enum(it->uniforms);
-	while ((uniform = iter_next(&iter))) {
-		switch (uniform->type) {
-		case UNIFORM_SAMPLER:
-			image_unref(uniform->sampler.texture);
-			break;
-		case UNIFORM_FLOAT_ARR:
-			free(uniform->float_list);
-			break;
-		case UNIFORM_INT_ARR:
-			free(uniform->int_list);
-			break;
-		}
-	}
+	while ((uniform = iter_next(&iter)))
+		free_uniform(uniform);
 
-	al_destroy_shader(it->program);
+	if (it->program != NULL)
+		al_destroy_shader(it->program);
 	vector_free(it->uniforms);
 	free(it);
 }
@@ -453,181 +538,137 @@ shader_program(const shader_t* it)
 void
 shader_put_bool(shader_t* it, const char* name, bool value)
 {
-	struct uniform unif;
+	bool            is_new;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_bool(name, value);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_BOOL;
-		unif.bool_value = value;
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_BOOL, 1, &is_new)))
+		return;
+	if (!is_new && uniform->bool_value == value)
+		return;
+	uniform->bool_value = value;
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_float(shader_t* it, const char* name, float value)
 {
-	struct uniform unif;
+	bool            is_new;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_float(name, value);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_FLOAT;
-		unif.float_value = value;
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_FLOAT, 1, &is_new)))
+		return;
+	if (!is_new && uniform->float_value == value)
+		return;
+	uniform->float_value = value;
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_float_array(shader_t* it, const char* name, float values[], int size)
 {
-	struct uniform unif;
+	bool            is_new;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_float_vector(name, 1, values, size);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_FLOAT_ARR;
-		unif.float_list = malloc(size * sizeof(float));
-		unif.num_values = size;
-		memcpy(unif.float_list, values, size * sizeof(float));
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_FLOAT_ARR, size, &is_new)))
+		return;
+	if (!is_new && memcmp(uniform->float_list, values, size * sizeof(float)) == 0)
+		return;
+	memcpy(uniform->float_list, values, size * sizeof(float));
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_float_vector(shader_t* it, const char* name, float values[], int size)
 {
-	struct uniform unif;
+	bool            is_new;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_float_vector(name, size, values, 1);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_FLOAT_VEC;
-		unif.num_values = size;
-		memcpy(unif.float_vec, values, sizeof(float) * size);
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_FLOAT_VEC, size, &is_new)))
+		return;
+	if (!is_new && memcmp(uniform->float_vec, values, size * sizeof(float)) == 0)
+		return;
+	memcpy(uniform->float_vec, values, size * sizeof(float));
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_int(shader_t* it, const char* name, int value)
 {
-	struct uniform unif;
+	bool            is_new;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_int(name, value);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_INT;
-		unif.int_value = value;
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_INT, 1, &is_new)))
+		return;
+	if (!is_new && uniform->int_value == value)
+		return;
+	uniform->int_value = value;
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_int_array(shader_t* it, const char* name, int values[], int size)
 {
-	struct uniform unif;
+	bool            is_new;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_int_vector(name, 1, values, size);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_INT_ARR;
-		unif.int_list = malloc(size * sizeof(int));
-		unif.num_values = size;
-		memcpy(unif.int_list, values, size * sizeof(int));
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_INT_ARR, size, &is_new)))
+		return;
+	if (!is_new && memcmp(uniform->int_list, values, size * sizeof(int)) == 0)
+		return;
+	memcpy(uniform->int_list, values, size * sizeof(int));
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_int_vector(shader_t* it, const char* name, int values[], int size)
 {
-	struct uniform unif;
+	bool            is_new;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_int_vector(name, size, values, 1);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_INT_VEC;
-		unif.num_values = size;
-		memcpy(unif.int_vec, values, sizeof(int) * size);
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_INT_VEC, size, &is_new)))
+		return;
+	if (!is_new && memcmp(uniform->int_vec, values, size * sizeof(int)) == 0)
+		return;
+	memcpy(uniform->int_vec, values, size * sizeof(int));
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_matrix(shader_t* it, const char* name, const transform_t* matrix)
 {
-	struct uniform unif;
+	bool            is_new;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_matrix(name, transform_matrix(matrix));
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_MATRIX;
-		al_copy_transform(&unif.mat_value, transform_matrix(matrix));
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_MATRIX, 1, &is_new)))
+		return;
+	if (!is_new && memcmp(&uniform->mat_value, transform_matrix(matrix), sizeof(ALLEGRO_TRANSFORM)) == 0)
+		return;
+	al_copy_transform(&uniform->mat_value, transform_matrix(matrix));
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_sampler(shader_t* it, const char* name, image_t* texture, int texture_unit)
 {
-	struct uniform unif;
-	ALLEGRO_BITMAP* bitmap;
-
-	bitmap = image_bitmap(texture);
+	bool            is_new;
+	image_t*        old_texture;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_sampler(name, bitmap, texture_unit);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_SAMPLER;
-
-		unif.sampler.texture = image_ref(texture);
-		unif.sampler.texture_unit = texture_unit;
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_SAMPLER, 1, &is_new)))
+		return;
+	if (!is_new && uniform->sampler.texture == texture && uniform->sampler.texture_unit == texture_unit)
+		return;
+	old_texture = is_new ? NULL : uniform->sampler.texture;
+	uniform->sampler.texture = image_ref(texture);
+	uniform->sampler.texture_unit = texture_unit;
+	image_unref(old_texture);
+	commit_uniform(it, uniform);
 }
 
 bool
 shader_use(shader_t* it, bool force_set)
 {
 	ALLEGRO_SHADER* al_shader;
-	ALLEGRO_BITMAP* bitmap;
 
 	struct uniform* uniform;
 
@@ -636,55 +677,26 @@ shader_use(shader_t* it, bool force_set)
 	if (it == s_last_shader && !force_set)
 		return true;
 
+	galileo_flush();
+
 	if (it != NULL)
 		console_log(4, "activating shader program #%u", it->id);
 	else
 		console_log(4, "activating legacy shaders");
 
 	al_shader = it != NULL ? it->program : NULL;
-	if (!al_use_shader(al_shader))
+	if (!g_headless && !al_use_shader(al_shader))
 		return false;
 
-	// set any uniforms defined while we were inactive
-	if (it != NULL) {
+	// note: uniform values are part of the program object and survive it being switched
+	//       out, so only the ones changed while we were inactive need to be uploaded.
+	//       texture bindings are global state however, so samplers always get rebound.
+	if (al_shader != NULL) {
 		iter = vector_enum(it->uniforms);
 		while ((uniform = iter_next(&iter))) {
-			switch (uniform->type) {
-			case UNIFORM_BOOL:
-				al_set_shader_bool(uniform->name, uniform->bool_value);
-				break;
-			case UNIFORM_FLOAT:
-				al_set_shader_float(uniform->name, uniform->float_value);
-				break;
-			case UNIFORM_FLOAT_ARR:
-				al_set_shader_float_vector(uniform->name, 1, uniform->float_list, uniform->num_values);
-				free(uniform->float_list);
-				break;
-			case UNIFORM_FLOAT_VEC:
-				al_set_shader_float_vector(uniform->name, uniform->num_values, uniform->float_vec, 1);
-				break;
-			case UNIFORM_INT:
-				al_set_shader_int(uniform->name, uniform->int_value);
-				break;
-			case UNIFORM_INT_ARR:
-				al_set_shader_int_vector(uniform->name, 1, uniform->int_list, uniform->num_values);
-				free(uniform->int_list);
-				break;
-			case UNIFORM_INT_VEC:
-				al_set_shader_int_vector(uniform->name, uniform->num_values, uniform->int_vec, 1);
-				break;
-			case UNIFORM_MATRIX:
-				al_set_shader_matrix(uniform->name, &uniform->mat_value);
-				break;
-			case UNIFORM_SAMPLER:
-				bitmap = image_bitmap(uniform->sampler.texture);
-
-				al_set_shader_sampler(uniform->name, bitmap, uniform->sampler.texture_unit);
-				image_unref(uniform->sampler.texture);
-				break;
-			}
+			if (uniform->dirty || uniform->type == UNIFORM_SAMPLER)
+				upload_uniform(uniform);
 		}
-		vector_clear(it->uniforms);
 	}
 
 	s_last_shader = it;
@@ -788,8 +800,13 @@ shape_set_vbo(shape_t* it, vbo_t* vbo)
 void
 shape_draw(shape_t* it, image_t* surface, transform_t* transform)
 {
+	shader_t* shader;
+
+	shader = galileo_shader();
+	if (batch_shape(it, surface, shader, transform))
+		return;
 	image_render_to(surface, transform);
-	shader_use(galileo_shader(), false);
+	shader_use(shader, false);
 	render_shape(it);
 }
 
@@ -854,6 +871,10 @@ vbo_upload(vbo_t* it)
 		it->buffer = NULL;
 	}
 
+	// in headless mode there's no GPU to upload to, see ibo_upload().
+	if (g_headless)
+		return true;
+
 	// create the vertex buffer object
 	if (!(buffer = al_create_vertex_buffer(NULL, NULL, vector_len(it->vertices), ALLEGRO_PRIM_BUFFER_STATIC)))
 		return false;
@@ -879,31 +900,252 @@ vbo_upload(vbo_t* it)
 	return true;
 }
 
+static bool
+batch_shape(shape_t* shape, image_t* surface, shader_t* shader, transform_t* transform)
+{
+	// note: consecutive shapes sharing a render target, shader, texture and primitive
+	//       class are merged into a single draw call.  strips, fans and loops are
+	//       converted to lists so they can be mixed freely with plain lists.  when the
+	//       default shader is in use, vertices are transformed on the CPU so shapes with
+	//       different transforms can still share a batch; a custom shader may depend on
+	//       model-space positions, so those only batch under the same transform.
+
+	int                      base_index;
+	bool                     can_append;
+	int                      draw_mode;
+	const uint16_t*          ibo_indices = NULL;
+	int*                     indices;
+	const ALLEGRO_TRANSFORM* matrix = NULL;
+	transform_t*             modelview;
+	int                      num_indices;
+	int                      num_prims;
+	int                      num_vertices;
+	ALLEGRO_VERTEX*          out_vertex;
+	const vertex_t*          vertex;
+	int                      v1, v2, v3;
+
+	int i;
+
+	if (shape->vbo == NULL)
+		return false;
+	num_vertices = vbo_len(shape->vbo);
+	if (num_vertices == 0 || num_vertices > MAX_BATCH_SHAPE_SIZE)
+		return false;
+	if (shape->ibo != NULL) {
+		num_indices = ibo_len(shape->ibo);
+		ibo_indices = vector_get(shape->ibo->indices, 0);
+		for (i = 0; i < num_indices; ++i) {
+			if (ibo_indices[i] >= num_vertices)
+				return false;
+		}
+	}
+	else {
+		num_indices = num_vertices;
+	}
+
+	draw_mode = shape->type == SHAPE_LINES || shape->type == SHAPE_LINE_LOOP || shape->type == SHAPE_LINE_STRIP
+			? ALLEGRO_PRIM_LINE_LIST
+		: shape->type == SHAPE_TRIANGLES || shape->type == SHAPE_TRI_FAN || shape->type == SHAPE_TRI_STRIP
+			? ALLEGRO_PRIM_TRIANGLE_LIST
+		: ALLEGRO_PRIM_POINT_LIST;
+	modelview = transform;
+	if (shader == s_def_shader && transform != NULL) {
+		matrix = transform_matrix(transform);
+		if (matrix->m[0][3] == 0.0f && matrix->m[1][3] == 0.0f && matrix->m[2][3] == 0.0f
+			&& matrix->m[3][3] == 1.0f)
+		{
+			modelview = NULL;
+		}
+		else {
+			// projective modelview, w can't be carried through the batch
+			matrix = NULL;
+		}
+	}
+
+	can_append = s_batch.num_shapes > 0
+		&& surface == s_batch.surface
+		&& shader == s_batch.shader
+		&& shape->texture == s_batch.texture
+		&& draw_mode == s_batch.draw_mode
+		&& modelview == s_batch.modelview
+		&& (modelview == NULL || !transform_dirty(modelview))
+		&& !transform_dirty(image_get_transform(surface))
+		&& vector_len(s_batch.vertices) + num_vertices <= MAX_BATCH_VERTICES;
+	if (!can_append) {
+		galileo_flush();
+		image_render_to(surface, modelview);
+		if (!shader_use(shader, false))
+			return false;
+		s_batch.draw_mode = draw_mode;
+		s_batch.modelview = transform_ref(modelview);
+		s_batch.shader = shader_ref(shader);
+		s_batch.surface = image_ref(surface);
+		s_batch.texture = image_ref(shape->texture);
+	}
+
+	// copy the vertices into the streaming buffer, transforming as we go
+	base_index = vector_len(s_batch.vertices);
+	if (!vector_resize(s_batch.vertices, base_index + num_vertices))
+		return false;
+	vertex = vector_get(shape->vbo->vertices, 0);
+	out_vertex = vector_get(s_batch.vertices, base_index);
+	for (i = 0; i < num_vertices; ++i, ++vertex, ++out_vertex) {
+		out_vertex->x = vertex->x;
+		out_vertex->y = vertex->y;
+		out_vertex->z = vertex->z;
+		if (matrix != NULL)
+			al_transform_coordinates_3d(matrix, &out_vertex->x, &out_vertex->y, &out_vertex->z);
+		out_vertex->u = vertex->u;
+		out_vertex->v = vertex->v;
+		out_vertex->color = nativecolor(vertex->color);
+	}
+
+	// convert the shape's index list to the batch's primitive class
+	num_prims = shape->type == SHAPE_LINES ? num_indices / 2
+		: shape->type == SHAPE_LINE_LOOP ? num_indices >= 2 ? num_indices : 0
+		: shape->type == SHAPE_LINE_STRIP ? num_indices >= 2 ? num_indices - 1 : 0
+		: shape->type == SHAPE_TRIANGLES ? num_indices / 3
+		: shape->type == SHAPE_TRI_FAN || shape->type == SHAPE_TRI_STRIP
+			? num_indices >= 3 ? num_indices - 2 : 0
+		: num_indices;
+	i = vector_len(s_batch.indices);
+	if (!vector_resize(s_batch.indices, i + num_prims * (draw_mode == ALLEGRO_PRIM_TRIANGLE_LIST ? 3
+		: draw_mode == ALLEGRO_PRIM_LINE_LIST ? 2 : 1)))
+	{
+		vector_resize(s_batch.vertices, base_index);
+		return false;
+	}
+	indices = vector_get(s_batch.indices, i);
+	for (i = 0; i < num_prims; ++i) {
+		switch (shape->type) {
+		case SHAPE_LINES:
+			v1 = i * 2; v2 = i * 2 + 1;
+			break;
+		case SHAPE_LINE_LOOP:
+			v1 = i; v2 = (i + 1) % num_indices;
+			break;
+		case SHAPE_LINE_STRIP:
+			v1 = i; v2 = i + 1;
+			break;
+		case SHAPE_TRIANGLES:
+			v1 = i * 3; v2 = i * 3 + 1; v3 = i * 3 + 2;
+			break;
+		case SHAPE_TRI_FAN:
+			v1 = 0; v2 = i + 1; v3 = i + 2;
+			break;
+		case SHAPE_TRI_STRIP:
+			// every other triangle in a strip has reversed winding, preserve that
+			v1 = i % 2 == 0 ? i : i + 1;
+			v2 = i % 2 == 0 ? i + 1 : i;
+			v3 = i + 2;
+			break;
+		default:
+			v1 = i;
+			break;
+		}
+		*indices++ = base_index + (ibo_indices != NULL ? ibo_indices[v1] : v1);
+		if (draw_mode != ALLEGRO_PRIM_POINT_LIST)
+			*indices++ = base_index + (ibo_indices != NULL ? ibo_indices[v2] : v2);
+		if (draw_mode == ALLEGRO_PRIM_TRIANGLE_LIST)
+			*indices++ = base_index + (ibo_indices != NULL ? ibo_indices[v3] : v3);
+	}
+	++s_batch.num_shapes;
+	return true;
+}
+
+static void
+commit_uniform(shader_t* shader, struct uniform* uniform)
+{
+	if (shader->program == NULL)
+		return;
+	if (s_last_shader == shader) {
+		if (s_batch.shader == shader)
+			galileo_flush();
+		upload_uniform(uniform);
+	}
+	else {
+		uniform->dirty = true;
+	}
+}
+
 static void
-free_cached_uniform(shader_t* shader, const char* name)
+free_uniform(struct uniform* uniform)
+{
+	switch (uniform->type) {
+	case UNIFORM_SAMPLER:
+		image_unref(uniform->sampler.texture);
+		break;
+	case UNIFORM_FLOAT_ARR:
+		free(uniform->float_list);
+		break;
+	case UNIFORM_INT_ARR:
+		free(uniform->int_list);
+		break;
+	}
+}
+
+static struct uniform*
+get_uniform(shader_t* shader, const char* name, enum uniform_type type, int num_values, bool *out_is_new)
 {
+	// note: uniforms live in a flat per-shader slot array and are never removed, so
+	//       after the first time a name is set, updating it is just a hash comparison
+	//       (no strcmp() on mismatch) and a value check; array storage is reused as
+	//       long as it's big enough.
+
+	void*           buffer;
+	uint32_t        hash = 2166136261u;
+	const char*     p_name;
 	struct uniform* uniform;
+	struct uniform  new_uniform;
+	size_t          value_size;
 
 	iter_t iter;
 
+	for (p_name = name; *p_name != '\0'; ++p_name)
+		hash = (hash ^ (uint8_t)*p_name) * 16777619u;  // FNV-1a
+
+	*out_is_new = false;
 	iter = vector_enum(shader->uniforms);
 	while ((uniform = iter_next(&iter))) {
-		if (strcmp(uniform->name, name) == 0) {
-			switch (uniform->type) {
-			case UNIFORM_SAMPLER:
-				image_unref(uniform->sampler.texture);
-				break;
-			case UNIFORM_FLOAT_ARR:
-				free(uniform->float_list);
-				break;
-			case UNIFORM_INT_ARR:
-				free(uniform->int_list);
-				break;
-			}
-
-			iter_remove(&iter);
+		if (uniform->hash == hash && strncmp(uniform->name, name, 255) == 0)
+			break;
+	}
+	if (uniform == NULL) {
+		memset(&new_uniform, 0, sizeof(struct uniform));
+		strncpy(new_uniform.name, name, 255);
+		new_uniform.name[255] = '\0';
+		new_uniform.hash = hash;
+		new_uniform.type = type;
+		if (!vector_push(shader->uniforms, &new_uniform))
+			return NULL;
+		uniform = vector_get(shader->uniforms, vector_len(shader->uniforms) - 1);
+		*out_is_new = true;
+	}
+	else if (uniform->type != type || uniform->num_values != num_values) {
+		if (uniform->type != type) {
+			free_uniform(uniform);
+			uniform->float_list = NULL;
+			uniform->int_list = NULL;
+			uniform->max_values = 0;
 		}
+		uniform->type = type;
+		*out_is_new = true;
+	}
+	uniform->num_values = num_values;
+
+	if ((type == UNIFORM_FLOAT_ARR || type == UNIFORM_INT_ARR) && num_values > uniform->max_values) {
+		value_size = type == UNIFORM_FLOAT_ARR ? sizeof(float) : sizeof(int);
+		buffer = type == UNIFORM_FLOAT_ARR ? (void*)uniform->float_list : (void*)uniform->int_list;
+		if (!(buffer = realloc(buffer, num_values * value_size)))
+			return NULL;
+		if (type == UNIFORM_FLOAT_ARR)
+			uniform->float_list = buffer;
+		else
+			uniform->int_list = buffer;
+		uniform->max_values = num_values;
+		*out_is_new = true;
 	}
+	return uniform;
 }
 
 static void
@@ -928,8 +1170,111 @@ render_shape(shape_t* shape)
 		: ALLEGRO_PRIM_POINT_LIST;
 
 	bitmap = shape->texture != NULL ? image_bitmap(shape->texture) : NULL;
-	if (shape->ibo != NULL)
+	if (vbo_buffer(shape->vbo) == NULL)
+		render_unbuffered(shape, bitmap, draw_mode);
+	else if (shape->ibo != NULL)
 		al_draw_indexed_buffer(vbo_buffer(shape->vbo), bitmap, ibo_buffer(shape->ibo), 0, num_indices, draw_mode);
 	else
 		al_draw_vertex_buffer(vbo_buffer(shape->vbo), bitmap, 0, num_vertices, draw_mode);
 }
+
+static void
+render_unbuffered(shape_t* shape, ALLEGRO_BITMAP* bitmap, int draw_mode)
+{
+	// note: in headless mode nothing is uploaded to the GPU, so shapes are drawn
+	//       straight from their vertex and index lists instead.
+	int*            indices = NULL;
+	int             num_indices;
+	int             num_vertices;
+	const vertex_t* vertex;
+	ALLEGRO_VERTEX* vertices = NULL;
+
+	int i;
+
+	num_vertices = vbo_len(shape->vbo);
+	num_indices = ibo_len(shape->ibo);
+	if (num_vertices == 0)
+		return;
+	if (!(vertices = malloc(num_vertices * sizeof(ALLEGRO_VERTEX))))
+		goto on_error;
+	vertex = vector_get(shape->vbo->vertices, 0);
+	for (i = 0; i < num_vertices; ++i, ++vertex) {
+		vertices[i].x = vertex->x;
+		vertices[i].y = vertex->y;
+		vertices[i].z = vertex->z;
+		vertices[i].u = vertex->u;
+		vertices[i].v = vertex->v;
+		vertices[i].color = nativecolor(vertex->color);
+	}
+	if (shape->ibo != NULL) {
+		if (!(indices = malloc(num_indices * sizeof(int))))
+			goto on_error;
+		for (i = 0; i < num_indices; ++i)
+			indices[i] = *(uint16_t*)vector_get(shape->ibo->indices, i);
+		al_draw_indexed_prim(vertices, NULL, bitmap, indices, num_indices, draw_mode);
+	}
+	else {
+		al_draw_prim(vertices, NULL, bitmap, 0, num_vertices, draw_mode);
+	}
+	free(indices);
+	free(vertices);
+	return;
+
+on_error:
+	free(indices);
+	free(vertices);
+}
+
+static void
+reset_batch(void)
+{
+	image_unref(s_batch.surface);
+	image_unref(s_batch.texture);
+	shader_unref(s_batch.shader);
+	transform_unref(s_batch.modelview);
+	s_batch.modelview = NULL;
+	s_batch.shader = NULL;
+	s_batch.surface = NULL;
+	s_batch.texture = NULL;
+	s_batch.num_shapes = 0;
+	vector_resize(s_batch.vertices, 0);
+	vector_resize(s_batch.indices, 0);
+}
+
+static void
+upload_uniform(struct uniform* uniform)
+{
+	ALLEGRO_BITMAP* bitmap;
+
+	switch (uniform->type) {
+	case UNIFORM_BOOL:
+		al_set_shader_bool(uniform->name, uniform->bool_value);
+		break;
+	case UNIFORM_FLOAT:
+		al_set_shader_float(uniform->name, uniform->float_value);
+		break;
+	case UNIFORM_FLOAT_ARR:
+		al_set_shader_float_vector(uniform->name, 1, uniform->float_list, uniform->num_values);
+		break;
+	case UNIFORM_FLOAT_VEC:
+		al_set_shader_float_vector(uniform->name, uniform->num_values, uniform->float_vec, 1);
+		break;
+	case UNIFORM_INT:
+		al_set_shader_int(uniform->name, uniform->int_value);
+		break;
+	case UNIFORM_INT_ARR:
+		al_set_shader_int_vector(uniform->name, 1, uniform->int_list, uniform->num_values);
+		break;
+	case UNIFORM_INT_VEC:
+		al_set_shader_int_vector(uniform->name, uniform->num_values, uniform->int_vec, 1);
+		break;
+	case UNIFORM_MATRIX:
+		al_set_shader_matrix(uniform->name, &uniform->mat_value);
+		break;
+	case UNIFORM_SAMPLER:
+		bitmap = uniform->sampler.texture != NULL ? image_bitmap(uniform->sampler.texture) : NULL;
+		al_set_shader_sampler(uniform->name, bitmap, uniform->sampler.texture_unit);
+		break;
+	}
+	uniform->dirty = false;
+}
@@ -72,6 +72,9 @@ void                   galileo_init            (void);
 void                   galileo_uninit          (void);
 shader_t*              galileo_shader          (void);
 void                   galileo_reset           (void);
+int                    galileo_draws_saved     (void);
+void                   galileo_end_frame       (void);
+void                   galileo_flush           (void);
 ibo_t*                 ibo_new                 (void);
 ibo_t*                 ibo_ref                 (ibo_t* it);
 void                   ibo_unref               (ibo_t* it);
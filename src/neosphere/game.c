@@ -589,6 +589,43 @@ game_is_writable(const game_t* it, const char* pathname, bool v1_mode)
 		|| (strcmp(prefix, "@") == 0 && v1_mode);
 }
 
+bool
+game_locate_file(const game_t* it, const char* filename, path_t* *out_path, package_t* *out_package)
+{
+	// note: this resolves a SphereFS filename up front so the file can be read
+	//       on a worker thread later.  if the file lives in an SPK package,
+	//       `*out_package` receives a new reference to it, otherwise NULL.
+	path_t*      cache_path;
+	enum fs_type fs_type;
+	path_t*      path;
+
+	if (!resolve_pathname(it, filename, &path, &fs_type))
+		return false;
+	*out_package = NULL;
+	switch (fs_type) {
+	case FS_LOCAL:
+		break;
+	case FS_PACKAGE:
+		// files which were written to by the game are extracted to a local
+		// cache, and those take precedence over the packaged copy.
+		cache_path = package_cache_path(it->package, path_cstr(path));
+		if (al_filename_exists(path_cstr(cache_path))) {
+			path_free(path);
+			path = cache_path;
+		}
+		else {
+			path_free(cache_path);
+			*out_package = package_ref(it->package);
+		}
+		break;
+	default:
+		path_free(path);
+		return false;
+	}
+	*out_path = path;
+	return true;
+}
+
 bool
 game_mkdir(game_t* it, const char* dirname)
 {
@@ -607,6 +644,27 @@ game_mkdir(game_t* it, const char* dirname)
 	}
 }
 
+ALLEGRO_FILE*
+game_open_stream(const game_t* it, const char* filename)
+{
+	// note: unlike game_read_file(), this doesn't read the whole file into
+	//       memory, even if it's in an SPK package.  use it for large files
+	//       which are read sequentially, like music.
+	ALLEGRO_FILE* file;
+	package_t*    package;
+	path_t*       path;
+
+	if (!game_locate_file(it, filename, &path, &package))
+		return NULL;
+	if (package != NULL)
+		file = asset_fstream(package, path_cstr(path));
+	else
+		file = al_fopen(path_cstr(path), "rb");
+	package_unref(package);
+	path_free(path);
+	return file;
+}
+
 void*
 game_read_file(game_t* it, const char* filename, size_t *out_size)
 {
@@ -1050,21 +1108,21 @@ load_default_assets(game_t* game)
 	path = game_full_path(game,
 		kev_read_string(system_ini, "Arrow", "pointer.png"),
 		"#/", true);
-	game->default_arrow = image_load(path_cstr(path));
+	game->default_arrow = image_load(path_cstr(path), false);
 	path_free(path);
 
 	// system default up arrow image
 	path = game_full_path(game,
 		kev_read_string(system_ini, "UpArrow", "up_arrow.png"),
 		"#/", true);
-	game->default_arrow_up = image_load(path_cstr(path));
+	game->default_arrow_up = image_load(path_cstr(path), false);
 	path_free(path);
 
 	// system default down arrow image
 	path = game_full_path(game,
 		kev_read_string(system_ini, "DownArrow", "down_arrow.png"),
 		"#/", true);
-	game->default_arrow_down = image_load(path_cstr(path));
+	game->default_arrow_down = image_load(path_cstr(path), false);
 	path_free(path);
 
 	kev_close(system_ini);
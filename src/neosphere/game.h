@@ -37,6 +37,7 @@
 #include "geometry.h"
 #include "image.h"
 #include "jsal.h"
+#include "package.h"
 #include "windowstyle.h"
 
 typedef struct directory directory_t;
@@ -85,7 +86,9 @@ const char*     game_summary             (const game_t* it);
 int             game_version             (const game_t* it);
 bool            game_is_prefix_path      (const game_t* it, const char* pathname);
 bool            game_is_writable         (const game_t* it, const char* pathname, bool v1_mode);
+bool            game_locate_file         (const game_t* it, const char* filename, path_t* *out_path, package_t* *out_package);
 bool            game_mkdir               (game_t* it, const char* dirname);
+ALLEGRO_FILE*   game_open_stream         (const game_t* it, const char* filename);
 void*           game_read_file           (game_t* it, const char* filename, size_t *out_size);
 bool            game_rename              (game_t* it, const char* old_pathname, const char* new_pathname);
 bool            game_rmdir               (game_t* it, const char* dirname);
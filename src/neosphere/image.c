@@ -33,6 +33,7 @@
 #include "neosphere.h"
 #include "image.h"
 
+#include "asset_cache.h"
 #include "blend_op.h"
 #include "color.h"
 #include "galileo.h"
@@ -67,12 +68,24 @@ struct image
 	image_t*        parent;
 };
 
-static void cache_pixels     (image_t* image);
-static void compute_clipping (image_t* image);
-static void uncache_pixels   (image_t* image);
+static void            cache_pixels     (image_t* image);
+static void            compute_clipping (image_t* image);
+static ALLEGRO_BITMAP* decode_bitmap    (const void* data, size_t size, const char* filename);
+static void            uncache_pixels   (image_t* image);
 
 static image_t*     s_last_image = NULL;
 static unsigned int s_next_image_id = 0;
+static int          s_num_images = 0;
+static size_t       s_texture_bytes = 0;
+
+void
+images_get_usage(int* out_num_images, size_t* out_num_bytes)
+{
+	// note: this is an estimate of texture memory, assuming 4 bytes per pixel.
+	//       subimages share their parent's texture and aren't counted.
+	*out_num_images = s_num_images;
+	*out_num_bytes = s_texture_bytes;
+}
 
 image_t*
 image_new(int width, int height, const color_t* pixels)
@@ -89,6 +102,8 @@ image_new(int width, int height, const color_t* pixels)
 	image->id = s_next_image_id++;
 	image->width = al_get_bitmap_width(image->bitmap);
 	image->height = al_get_bitmap_height(image->bitmap);
+	++s_num_images;
+	s_texture_bytes += (size_t)image->width * image->height * 4;
 	image->clipping = mk_rect(0, 0, image->width, image->height);
 	image->transform = transform_new();
 	image->have_depth = true;
@@ -149,6 +164,7 @@ image_dup(const image_t* it)
 	console_log(3, "cloning image #%u from source image #%u",
 		s_next_image_id, it->id);
 
+	galileo_flush();
 	if (!(image = calloc(1, sizeof(image_t))))
 		goto on_error;
 	al_set_new_bitmap_depth(it->have_depth ? 16 : 0);
@@ -157,6 +173,8 @@ image_dup(const image_t* it)
 	image->id = s_next_image_id++;
 	image->width = al_get_bitmap_width(image->bitmap);
 	image->height = al_get_bitmap_height(image->bitmap);
+	++s_num_images;
+	s_texture_bytes += (size_t)image->width * image->height * 4;
 	image->clipping = mk_rect(0, 0, image->width, image->height);
 	image->transform = transform_new();
 	image->have_depth = it->have_depth;
@@ -171,14 +189,74 @@ on_error:
 }
 
 image_t*
-image_load(const char* filename)
+image_new_decoded(void* decoded, const char* filename, bool private_copy)
 {
-	ALLEGRO_FILE* al_file = NULL;
-	const char*   file_ext;
-	size_t        file_size;
-	uint8_t       first_16[16];
-	image_t*      image;
-	void*         slurp = NULL;
+	ALLEGRO_BITMAP* bitmap;
+	image_t*        image;
+
+	// note: `decoded` is a memory bitmap produced by image_decode(), normally on
+	//       a worker thread.  the only thing left to do is upload it to the GPU.
+	//       private copies are for images which will be modified, so they don't
+	//       go into the asset cache.
+	bitmap = decoded;
+	console_log(2, "uploading image #%u decoded from '%s'", s_next_image_id, filename);
+
+	if (!(image = calloc(1, sizeof(image_t))))
+		goto on_error;
+	al_set_new_bitmap_depth(0);
+	al_convert_bitmap(bitmap);
+	image->bitmap = bitmap;
+	image->width = al_get_bitmap_width(image->bitmap);
+	image->height = al_get_bitmap_height(image->bitmap);
+	image->clipping = mk_rect(0, 0, image->width, image->height);
+	image->transform = transform_new();
+	image->have_depth = false;
+	transform_orthographic(image->transform, 0.0f, 0.0f, image->width, image->height, -1.0f, 1.0f);
+
+	image->path = strdup(filename);
+	image->id = s_next_image_id++;
+	++s_num_images;
+	s_texture_bytes += (size_t)image->width * image->height * 4;
+	image_ref(image);
+	if (!private_copy)
+		asset_cache_put(CACHE_IMAGE, filename, 0, image, image->width * image->height * 4);
+	return image;
+
+on_error:
+	console_log(2, "    failed to upload image #%u", s_next_image_id++);
+	al_destroy_bitmap(bitmap);
+	return NULL;
+}
+
+void*
+image_decode(void* data, size_t size, const char* filename)
+{
+	// note: this is called on a worker thread and takes ownership of `data`.
+	//       new bitmap flags are per-thread in Allegro, so asking for a memory
+	//       bitmap here doesn't affect the main thread.
+	ALLEGRO_BITMAP* bitmap;
+
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	bitmap = decode_bitmap(data, size, filename);
+	free(data);
+	return bitmap;
+}
+
+image_t*
+image_load(const char* filename, bool private_copy)
+{
+	// note: images loaded from a file are normally shared with other loads of
+	//       the same file through the asset cache.  a private copy is never
+	//       shared, so it's safe to modify, e.g. to render to it.
+	ALLEGRO_BITMAP* bitmap;
+	size_t          file_size;
+	image_t*        image;
+	void*           slurp = NULL;
+
+	if (!private_copy && (image = asset_cache_get(CACHE_IMAGE, filename, 0))) {
+		console_log(2, "using cached image #%u for '%s'", image->id, filename);
+		return image;
+	}
 
 	console_log(2, "loading image #%u from '%s'", s_next_image_id, filename);
 
@@ -186,26 +264,10 @@ image_load(const char* filename)
 		goto on_error;
 	if (!(slurp = game_read_file(g_game, filename, &file_size)))
 		goto on_error;
-	al_file = al_open_memfile(slurp, file_size, "rb");
-
-	// look at the first 16 bytes of the file to determine its actual type.
-	// Allegro won't load it if the content doesn't match the file extension, so
-	// we have to inspect the file ourselves.
-	al_fread(al_file, first_16, 16);
-	al_fseek(al_file, 0, ALLEGRO_SEEK_SET);
-	file_ext = strrchr(filename, '.');
-	if (memcmp(first_16, "BM", 2) == 0)
-		file_ext = ".bmp";
-	if (memcmp(first_16, "\211PNG\r\n\032\n", 8) == 0)
-		file_ext = ".png";
-	if (memcmp(first_16, "\xFF\xD8", 2) == 0)
-		file_ext = ".jpg";
-
-	al_set_new_bitmap_depth(0);
-	if (!(image->bitmap = al_load_bitmap_flags_f(al_file, file_ext, ALLEGRO_NO_PREMULTIPLIED_ALPHA)))
+	if (!(bitmap = decode_bitmap(slurp, file_size, filename)))
 		goto on_error;
-	al_fclose(al_file);
 	free(slurp);
+	image->bitmap = bitmap;
 	image->width = al_get_bitmap_width(image->bitmap);
 	image->height = al_get_bitmap_height(image->bitmap);
 	image->clipping = mk_rect(0, 0, image->width, image->height);
@@ -215,12 +277,15 @@ image_load(const char* filename)
 
 	image->path = strdup(filename);
 	image->id = s_next_image_id++;
-	return image_ref(image);
+	++s_num_images;
+	s_texture_bytes += (size_t)image->width * image->height * 4;
+	image_ref(image);
+	if (!private_copy)
+		asset_cache_put(CACHE_IMAGE, filename, 0, image, image->width * image->height * 4);
+	return image;
 
 on_error:
 	console_log(2, "    failed to load image #%u", s_next_image_id++);
-	if (al_file != NULL)
-		al_fclose(al_file);
 	free(slurp);
 	free(image);
 	return NULL;
@@ -244,6 +309,10 @@ image_unref(image_t* it)
 	console_log(3, "disposing image #%u no longer in use",
 		it->id);
 	uncache_pixels(it);
+	if (it->parent == NULL) {
+		--s_num_images;
+		s_texture_bytes -= (size_t)it->width * it->height * 4;
+	}
 	al_destroy_bitmap(it->bitmap);
 	image_unref(it->parent);
 	free(it->path);
@@ -282,6 +351,12 @@ image_path(const image_t* it)
 	return it->path;
 }
 
+int
+image_refcount(const image_t* it)
+{
+	return it->refcount;
+}
+
 int
 image_width(const image_t* it)
 {
@@ -311,6 +386,7 @@ image_set_blend_op(image_t* it, blend_op_t* op)
 {
 	blend_op_t* prev_op;
 
+	galileo_flush();
 	prev_op = it->blend_op;
 	it->blend_op = blend_op_ref(op);
 	blend_op_unref(prev_op);
@@ -323,6 +399,7 @@ image_set_depth_op(image_t* it, depth_op_t op)
 {
 	int depth_func;
 	
+	galileo_flush();
 	it->depth_op = op;
 	if (it == s_last_image) {
 		depth_func = it->depth_op == DEPTH_PASS ? ALLEGRO_RENDER_ALWAYS
@@ -343,6 +420,7 @@ image_set_transform(image_t* it, transform_t* transform)
 {
 	transform_t* old_value;
 
+	galileo_flush();
 	old_value = it->transform;
 	it->transform = transform_ref(transform);
 	transform_unref(old_value);
@@ -439,6 +517,7 @@ image_blit(image_t* it, image_t* target_image, int x, int y)
 	int             blend_op;
 	ALLEGRO_BITMAP* old_target;
 
+	galileo_flush();
 	old_target = al_get_target_bitmap();
 	al_set_target_bitmap(image_bitmap(target_image));
 	al_get_blender(&blend_op, &blend_mode_src, &blend_mode_dest);
@@ -576,6 +655,7 @@ image_fill(image_t* it, color_t color, float depth)
 	int             clip_y;
 	ALLEGRO_BITMAP* old_target;
 
+	galileo_flush();
 	uncache_pixels(it);
 	al_get_clipping_rectangle(&clip_x, &clip_y, &clip_width, &clip_height);
 	al_reset_clipping_rectangle();
@@ -596,6 +676,7 @@ image_flip(image_t* it, bool is_h_flip, bool is_v_flip)
 
 	if (!is_h_flip && !is_v_flip)  // this really shouldn't happen...
 		return true;
+	galileo_flush();
 	uncache_pixels(it);
 	if (!(new_bitmap = al_create_bitmap(it->width, it->height)))
 		return false;
@@ -635,6 +716,7 @@ image_lock(image_t* it, bool uploading, bool downloading)
 	int                    lock_flag;
 
 	if (it->lock_count == 0) {
+		galileo_flush();
 		lock_flag = downloading && uploading ? ALLEGRO_LOCK_READWRITE
 			: downloading ? ALLEGRO_LOCK_READONLY
 			: uploading ? ALLEGRO_LOCK_WRITEONLY
@@ -657,6 +739,7 @@ image_render_to(image_t* it, transform_t* transform)
 	int               depth_func;
 	ALLEGRO_TRANSFORM matrix;
 
+	galileo_flush();
 	if (it != s_last_image) {
 		al_set_target_bitmap(it->bitmap);
 		shader_use(NULL, true);
@@ -737,6 +820,7 @@ image_rescale(image_t* it, int width, int height)
 
 	if (width == it->width && height == it->height)
 		return true;
+	galileo_flush();
 	if (!(new_bitmap = al_create_bitmap(width, height)))
 		return false;
 	uncache_pixels(it);
@@ -748,8 +832,12 @@ image_rescale(image_t* it, int width, int height)
 	al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
 	al_destroy_bitmap(it->bitmap);
 	it->bitmap = new_bitmap;
+	if (it->parent == NULL)
+		s_texture_bytes -= (size_t)it->width * it->height * 4;
 	it->width = al_get_bitmap_width(it->bitmap);
 	it->height = al_get_bitmap_height(it->bitmap);
+	if (it->parent == NULL)
+		s_texture_bytes += (size_t)it->width * it->height * 4;
 	return true;
 }
 
@@ -763,6 +851,7 @@ image_save(image_t* it, const char* filename)
 	size_t        next_buf_size;
 	bool          result;
 
+	galileo_flush();
 	next_buf_size = 65536;
 	do {
 		buffer = realloc(buffer, next_buf_size);
@@ -783,6 +872,7 @@ image_set_pixel(image_t* it, int x, int y, color_t color)
 {
 	ALLEGRO_BITMAP* old_target;
 
+	galileo_flush();
 	uncache_pixels(it);
 	old_target = al_get_target_bitmap();
 	al_set_target_bitmap(it->bitmap);
@@ -887,6 +977,7 @@ compute_clipping(image_t* image)
 		}
 	}
 	if (image == s_last_image) {
+		galileo_flush();
 		al_set_clipping_rectangle(image->clipping.x1,
 								  image->clipping.y1,
 								  image->clipping.x2 - image->clipping.x1,
@@ -897,6 +988,32 @@ compute_clipping(image_t* image)
 	}
 }
 
+static ALLEGRO_BITMAP*
+decode_bitmap(const void* data, size_t size, const char* filename)
+{
+	ALLEGRO_BITMAP* bitmap;
+	ALLEGRO_FILE*   file;
+	const char*     file_ext;
+
+	// look at the first few bytes of the file to determine its actual type.
+	// Allegro won't load it if the content doesn't match the file extension, so
+	// we have to inspect the file ourselves.
+	file_ext = strrchr(filename, '.');
+	if (size >= 2 && memcmp(data, "BM", 2) == 0)
+		file_ext = ".bmp";
+	if (size >= 8 && memcmp(data, "\211PNG\r\n\032\n", 8) == 0)
+		file_ext = ".png";
+	if (size >= 2 && memcmp(data, "\xFF\xD8", 2) == 0)
+		file_ext = ".jpg";
+
+	if (!(file = al_open_memfile((void*)data, size, "rb")))
+		return NULL;
+	al_set_new_bitmap_depth(0);
+	bitmap = al_load_bitmap_flags_f(file, file_ext, ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+	al_fclose(file);
+	return bitmap;
+}
+
 static void
 uncache_pixels(image_t* image)
 {
@@ -69,10 +69,13 @@ struct image_lock
 	ptrdiff_t pitch;
 } image_lock_t;
 
+void            images_get_usage         (int* out_num_images, size_t* out_num_bytes);
 image_t*        image_new                (int width, int height, const color_t* pixels);
+image_t*        image_new_decoded        (void* decoded, const char* filename, bool private_copy);
 image_t*        image_new_slice          (image_t* parent, int x, int y, int width, int height);
 image_t*        image_dup                (const image_t* it);
-image_t*        image_load               (const char* filename);
+void*           image_decode             (void* data, size_t size, const char* filename);
+image_t*        image_load               (const char* filename, bool private_copy);
 image_t*        image_ref                (image_t* it);
 void            image_unref              (image_t* it);
 ALLEGRO_BITMAP* image_bitmap             (image_t* it);
@@ -80,6 +83,7 @@ bool            image_can_unclip         (const image_t* it);
 rect_t          image_clipping           (const image_t* it);
 int             image_height             (const image_t* it);
 const char*     image_path               (const image_t* it);
+int             image_refcount           (const image_t* it);
 int             image_width              (const image_t* it);
 blend_op_t*     image_get_blend_op       (const image_t* it);
 depth_op_t      image_get_depth_op       (const image_t* it);
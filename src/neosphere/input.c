@@ -54,6 +54,7 @@ static int                  s_default_key_map[4][PLAYER_KEY_MAX];
 static ALLEGRO_EVENT_QUEUE* s_event_queue;
 static bool                 s_has_keymap_changed = false;
 static bool                 s_have_joystick;
+static bool                 s_have_keyboard;
 static bool                 s_have_mouse;
 static ALLEGRO_JOYSTICK*    s_joy_handles[MAX_JOYSTICKS];
 static int                  s_key_map[4][PLAYER_KEY_MAX];
@@ -91,13 +92,21 @@ initialize_input(void)
 
 	console_log(1, "initializing input subsystem");
 
-	al_install_keyboard();
-	if (!(s_have_mouse = al_install_mouse()))
-		console_log(1, "  mouse initialization failed");
-	if (!(s_have_joystick = al_install_joystick()))
-		console_log(1, "  joystick initialization failed");
+	// note: in headless mode there's no user to take input from.  the event queue
+	//       and key maps are still set up, they just never see anything.
+	s_have_keyboard = s_have_mouse = s_have_joystick = false;
+	if (g_headless) {
+		console_log(1, "  input is disabled in headless mode");
+	}
+	else {
+		s_have_keyboard = al_install_keyboard();
+		if (!(s_have_mouse = al_install_mouse()))
+			console_log(1, "  mouse initialization failed");
+		if (!(s_have_joystick = al_install_joystick()))
+			console_log(1, "  joystick initialization failed");
+	}
 
-	s_num_mouse_buttons = (int)al_get_mouse_num_buttons();
+	s_num_mouse_buttons = s_have_mouse ? (int)al_get_mouse_num_buttons() : 0;
 	if (s_num_mouse_buttons > MAX_MOUSE_BUTTONS)
 		s_num_mouse_buttons = MAX_MOUSE_BUTTONS;
 
@@ -105,7 +114,8 @@ initialize_input(void)
 	memset(s_was_button_down, 0, sizeof s_was_button_down);
 
 	s_event_queue = al_create_event_queue();
-	al_register_event_source(s_event_queue, al_get_keyboard_event_source());
+	if (s_have_keyboard)
+		al_register_event_source(s_event_queue, al_get_keyboard_event_source());
 	if (s_have_mouse)
 		al_register_event_source(s_event_queue, al_get_mouse_event_source());
 	if (s_have_joystick)
@@ -479,6 +489,8 @@ mouse_is_key_down(mouse_key_t key)
 	ALLEGRO_DISPLAY*    display;
 	ALLEGRO_MOUSE_STATE state;
 
+	if (!s_have_mouse)
+		return false;
 	display = screen_display(g_screen);
 	al_get_mouse_state(&state);
 	if (state.display != display)
@@ -0,0 +1,229 @@
+/**
+ *  Sphere: the JavaScript game platform
+ *  Copyright (c) 2015-2025, Where'd She Go?
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of Spherical nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+// the asset loader reads, unpacks and decodes files on a pool of worker threads
+// so that loading assets doesn't stall the frame loop.  each load has a decode
+// function which runs on the worker and turns the raw file data into something
+// CPU-side (a memory bitmap, a decoded audio sample, etc.); anything that has
+// to touch the GPU or JavaScript is left to the caller once load_done() returns
+// true.
+
+#include "neosphere.h"
+#include "loader.h"
+
+#include "package.h"
+#include "worker.h"
+
+#define MAX_LOADER_THREADS 4
+
+struct load
+{
+	bool          cancelled;
+	void*         data;
+	size_t        data_size;
+	load_decode_t decode;
+	bool          done;
+	char*         filename;
+	load_free_t   free_result;
+	package_t*    package;
+	path_t*       path;
+	void*         result;
+};
+
+static void  free_load       (load_t* load);
+static void  on_load_done    (void* udata);
+static void* read_local_file (const char* pathname, size_t *out_size);
+static void  run_load        (void* udata);
+
+static worker_t* s_worker;
+
+void
+loader_init(void)
+{
+	int num_threads;
+
+	num_threads = al_get_cpu_count() - 1;
+	if (num_threads < 1)
+		num_threads = 1;
+	if (num_threads > MAX_LOADER_THREADS)
+		num_threads = MAX_LOADER_THREADS;
+	console_log(1, "initializing asset loader (%d threads)", num_threads);
+	s_worker = worker_new("asset loader", num_threads);
+}
+
+void
+loader_uninit(void)
+{
+	console_log(1, "shutting down asset loader");
+	worker_free(s_worker);
+	s_worker = NULL;
+}
+
+void
+loader_update(void)
+{
+	if (s_worker != NULL)
+		worker_update(s_worker);
+}
+
+load_t*
+load_new(const char* filename, load_decode_t decode, load_free_t free_result)
+{
+	load_t* load;
+
+	console_log(3, "queueing '%s' for background loading", filename);
+
+	if (s_worker == NULL)
+		return NULL;
+	if (!(load = calloc(1, sizeof(load_t))))
+		return NULL;
+	if (!game_locate_file(g_game, filename, &load->path, &load->package)) {
+		free(load);
+		return NULL;
+	}
+	load->filename = strdup(filename);
+	load->decode = decode;
+	load->free_result = free_result;
+	worker_post(s_worker, run_load, on_load_done, load);
+	return load;
+}
+
+void
+load_free(load_t* it)
+{
+	if (it == NULL)
+		return;
+
+	// if the load is still in flight, the worker owns it.  mark it cancelled and
+	// let on_load_done() clean up once the worker is finished with it.
+	if (!it->done)
+		it->cancelled = true;
+	else
+		free_load(it);
+}
+
+bool
+load_done(const load_t* it)
+{
+	return it->done;
+}
+
+void*
+load_result(load_t* it, size_t *out_size)
+{
+	void* result;
+
+	// note: ownership of the result passes to the caller.
+	result = it->result;
+	if (out_size != NULL)
+		*out_size = it->data_size;
+	it->result = NULL;
+	return result;
+}
+
+static void
+free_load(load_t* load)
+{
+	if (load->result != NULL) {
+		if (load->free_result != NULL)
+			load->free_result(load->result);
+		else
+			free(load->result);
+	}
+	package_unref(load->package);
+	path_free(load->path);
+	free(load->filename);
+	free(load);
+}
+
+static void
+on_load_done(void* udata)
+{
+	load_t* load;
+
+	load = udata;
+	if (load->result == NULL)
+		console_log(2, "couldn't load '%s' in the background", load->filename);
+	load->done = true;
+	if (load->cancelled)
+		free_load(load);
+}
+
+static void*
+read_local_file(const char* pathname, size_t *out_size)
+{
+	uint8_t*      data = NULL;
+	ALLEGRO_FILE* file;
+	int64_t       file_size;
+
+	if (!(file = al_fopen(pathname, "rb")))
+		goto on_error;
+	if ((file_size = al_fsize(file)) < 0)
+		goto on_error;
+	if (!(data = malloc(file_size + 1)))
+		goto on_error;
+	if (al_fread(file, data, file_size) != file_size)
+		goto on_error;
+	al_fclose(file);
+	data[file_size] = '\0';  // nifty NUL terminator
+	*out_size = file_size;
+	return data;
+
+on_error:
+	if (file != NULL)
+		al_fclose(file);
+	free(data);
+	return NULL;
+}
+
+static void
+run_load(void* udata)
+{
+	// WARNING: this runs on a worker thread!  everything here must be
+	//          thread-safe; the load's path and package were resolved up front
+	//          on the main thread for that reason.
+	void*   data;
+	load_t* load;
+
+	load = udata;
+	if (load->package != NULL)
+		data = asset_fslurp(load->package, path_cstr(load->path), &load->data_size);
+	else
+		data = read_local_file(path_cstr(load->path), &load->data_size);
+	if (data == NULL)
+		return;
+	if (load->decode != NULL)
+		load->result = load->decode(data, load->data_size, load->filename);
+	else
+		load->result = data;
+}
@@ -38,7 +38,9 @@
 #include <zlib.h>
 
 #include "api.h"
+#include "asset_cache.h"
 #include "audio.h"
+#include "benchmark.h"
 #include "debugger.h"
 #include "dispatch.h"
 #include "dyad.h"
@@ -46,6 +48,7 @@
 #include "galileo.h"
 #include "input.h"
 #include "jsal.h"
+#include "loader.h"
 #include "map_engine.h"
 #include "module.h"
 #include "pegasus.h"
@@ -66,6 +69,7 @@
 #endif
 
 game_t*   g_game = NULL;
+bool      g_headless = false;
 double    g_idle_time = 0.0;
 js_ref_t* g_main_object = NULL;
 screen_t* g_screen = NULL;
@@ -84,12 +88,14 @@ static void on_socket_idle      (void);
 static bool initialize_engine   (void);
 static void shutdown_engine     (void);
 static bool find_startup_game   (path_t* *out_path);
-static bool parse_command_line  (int argc, char* argv[], path_t* *out_game_path, int *out_fullscreen, int *out_frameskip, int *out_verbosity, ssj_mode_t *out_ssj_mode, bool *out_retro_mode, int *out_extras_offset);
+static bool parse_command_line  (int argc, char* argv[], path_t* *out_game_path, int *out_fullscreen, int *out_frameskip, int *out_verbosity, ssj_mode_t *out_ssj_mode, bool *out_retro_mode, bool *out_vsync, int *out_cache_size, int *out_memory_limit, const char* *out_benchmark_path, const char* *out_capture_path, bool *out_capture_raw, int *out_tick_rate, int *out_extras_offset);
 static void print_banner        (bool want_copyright, bool want_deps);
 static void print_usage         (void);
 static void report_error        (const char* fmt, ...);
 static void show_error_screen   (const char* message);
 
+static size_t               s_cache_budget;
+static size_t               s_js_memory_limit;
 static int                  s_event_loop_version;
 static ALLEGRO_EVENT_QUEUE* s_event_queue = NULL;
 static path_t*              s_game_path = NULL;
@@ -132,19 +138,26 @@ main(int argc, char* argv[])
 	const char*          error_stack = NULL;
 	const char*          error_text;
 	const char*          error_url = NULL;
+	const char*          benchmark_path;
+	int                  cache_size;
+	const char*          capture_path;
+	bool                 capture_raw;
 	jmp_buf              exit_label;
 	ALLEGRO_FILECHOOSER* file_dialog;
 	int                  fullscreen_mode;
 	int                  game_args_offset;
 	image_t*             icon;
+	int                  memory_limit;
 	size2_t              resolution;
 	jmp_buf              restart_label;
 	bool                 retro_mode;
 	const path_t*        script_path;
 	ssj_mode_t           ssj_mode;
 	int                  target_api_level;
+	int                  tick_rate;
 	int                  use_frameskip;
 	int                  use_verbosity;
+	bool                 use_vsync;
 #if defined(_WIN32)
 	HANDLE               h_stdout;
 	DWORD                handle_mode;
@@ -163,9 +176,11 @@ main(int argc, char* argv[])
 	// parse the command line
 	if (parse_command_line(argc, argv, &s_game_path,
 		&fullscreen_mode, &use_frameskip, &use_verbosity, &ssj_mode, &retro_mode,
-		&game_args_offset))
+		&use_vsync, &cache_size, &memory_limit, &benchmark_path, &capture_path, &capture_raw, &tick_rate, &game_args_offset))
 	{
-		if (ssj_mode == SSJ_ACTIVE)
+		s_cache_budget = (size_t)cache_size * 1048576;
+		s_js_memory_limit = (size_t)memory_limit * 1048576;
+		if (ssj_mode == SSJ_ACTIVE || g_headless)
 			fullscreen_mode = FULLSCREEN_OFF;
 		console_init(use_verbosity);
 	}
@@ -185,17 +200,39 @@ main(int argc, char* argv[])
 			: fullscreen_mode == FULLSCREEN_OFF ? "off"
 			: "auto");
 	console_log(1, "    frameskip limit: %d frames", use_frameskip);
+	console_log(1, "    vsync: %s", use_vsync ? "on" : "off");
+	console_log(1, "    asset cache: %d MiB", cache_size);
+	if (memory_limit > 0)
+		console_log(1, "    JS memory limit: %d MiB", memory_limit);
+	else
+		console_log(1, "    JS memory limit: none");
 	console_log(1, "    console verbosity: V%d", use_verbosity);
 #if defined(NEOSPHERE_SPHERUN)
 	console_log(1, "    debugger mode: %s",
 		ssj_mode == SSJ_ACTIVE ? "active"
 			: ssj_mode == SSJ_PASSIVE ? "passive"
 			: "disabled");
+	console_log(1, "    headless: %s", g_headless ? "yes" : "no");
+	if (g_headless && tick_rate > 0)
+		console_log(1, "    tick rate: %d ticks/sec", tick_rate);
+	else if (g_headless && tick_rate == 0)
+		console_log(1, "    tick rate: unthrottled");
 #endif
 	console_log(1, "");
 
 	if (!initialize_engine())
 		return EXIT_FAILURE;
+	events_set_tick_rate(tick_rate);
+
+#if defined(NEOSPHERE_SPHERUN)
+	if (benchmark_path != NULL) {
+		// benchmark mode doesn't run a game or open a window, so it can be used
+		// headless, e.g. on a CI server.
+		i = benchmark_run(benchmark_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+		shutdown_engine();
+		return i;
+	}
+#endif
 
 	// set up jump points for script bailout
 	console_log(1, "setting up jump points for longjmp");
@@ -220,8 +257,10 @@ main(int argc, char* argv[])
 	}
 	if (setjmp(restart_label) != 0) {
 		// JS code called either RestartGame() or ExecuteGame()
-		fullscreen_mode = screen_get_fullscreen(g_screen)
-			? FULLSCREEN_ON : FULLSCREEN_OFF;
+		if (g_screen != NULL) {
+			fullscreen_mode = screen_get_fullscreen(g_screen)
+				? FULLSCREEN_ON : FULLSCREEN_OFF;
+		}
 		shutdown_engine();
 		console_log(1, "\nrestarting to launch new game");
 		console_log(1, "    path: %s", path_cstr(s_game_path));
@@ -287,23 +326,31 @@ main(int argc, char* argv[])
 		longjmp(exit_label, 1);
 	}
 
-	// set up the render context ("screen") so we can draw stuff
+	// set up the render context ("screen") so we can draw stuff.  in headless mode
+	// there's no window, but the game still gets an offscreen backbuffer.
 	resolution = game_resolution(g_game);
-	if (!(icon = image_load("@/icon.png")))
-		icon = image_load("#/icon.png");
-	g_screen = screen_new(game_name(g_game), icon, resolution, use_frameskip, game_default_font(g_game));
+	icon = NULL;
+	if (!g_headless && !(icon = image_load("@/icon.png", false)))
+		icon = image_load("#/icon.png", false);
+	g_screen = screen_new(game_name(g_game), icon, resolution, use_frameskip, use_vsync, game_default_font(g_game));
 	if (g_screen == NULL) {
-		al_show_native_message_box(NULL, "Unable to Create Render Context", "The engine couldn't create a render context.",
-			"Your hardware may be too old to run neoSphere, or there could be a problem with the drivers on this system.  Check that your graphics drivers in particular are fully installed and up-to-date.",
-			NULL, ALLEGRO_MESSAGEBOX_ERROR);
+		if (!g_headless) {
+			al_show_native_message_box(NULL, "Unable to Create Render Context", "The engine couldn't create a render context.",
+				"Your hardware may be too old to run neoSphere, or there could be a problem with the drivers on this system.  Check that your graphics drivers in particular are fully installed and up-to-date.",
+				NULL, ALLEGRO_MESSAGEBOX_ERROR);
+		}
 		return EXIT_FAILURE;
 	}
+	if (capture_path != NULL)
+		screen_start_capture(g_screen, capture_path, capture_raw);
 
 	al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
 	s_event_queue = al_create_event_queue();
-	al_register_event_source(s_event_queue,
-		al_get_display_event_source(screen_display(g_screen)));
-	attach_input_display();
+	if (!g_headless) {
+		al_register_event_source(s_event_queue,
+			al_get_display_event_source(screen_display(g_screen)));
+		attach_input_display();
+	}
 	kb_load_keymap();
 	
 	// in retrograde mode, only provide access to functions up to the targeted
@@ -331,7 +378,7 @@ main(int argc, char* argv[])
 
 	// enable the SSj debug server, wait for a connection if requested.
 #if defined(NEOSPHERE_SPHERUN)
-	if (ssj_mode == SSJ_ACTIVE) {
+	if (ssj_mode == SSJ_ACTIVE && !g_headless) {
 		al_clear_to_color(al_map_rgba(0, 0, 0, 255));
 		screen_draw_status(g_screen, "waiting for debugger...", mk_color(255, 255, 255, 255));
 		al_flip_display();
@@ -439,7 +486,9 @@ sphere_abort(const char* message)
 	//       disables the JavaScript VM so that control will fall through the event
 	//       loop naturally.
 
-	if (message != NULL)
+	if (message != NULL && g_headless)
+		fprintf(stderr, "ABORT: %s\n", message);
+	else if (message != NULL)
 		show_error_screen(message);
 	dispatch_cancel_all(true, true);
 	jsal_enable_vm(false);
@@ -652,6 +701,8 @@ initialize_engine(void)
 	console_log(1, "initializing JavaScript");
 	if (!jsal_init())
 		goto on_error;
+	if (s_js_memory_limit > 0)
+		jsal_set_memory_limit(s_js_memory_limit);
 	jsal_on_module_complete(on_module_complete);
 	jsal_on_enqueue_job(on_enqueue_js_job);
 	jsal_on_reject_promise(on_reject_promise);
@@ -659,6 +710,8 @@ initialize_engine(void)
 	// initialize engine components
 	dispatch_init();
 	events_init();
+	loader_init();
+	asset_cache_init(s_cache_budget);
 	galileo_init();
 	audio_init();
 	initialize_input();
@@ -670,6 +723,10 @@ initialize_engine(void)
 	return true;
 
 on_error:
+	if (g_headless) {
+		fprintf(stderr, "FATAL: unable to initialize one or more engine components\n");
+		return false;
+	}
 	al_show_native_message_box(NULL, "Unable to Start", "Does your car turn over in the morning?",
 		"neoSphere was unable to initialize one or more engine components.  The engine cannot continue in this state and will now close.",
 		NULL, ALLEGRO_MESSAGEBOX_ERROR);
@@ -701,10 +758,12 @@ shutdown_engine(void)
 	console_log(1, "shutting down Dyad");
 	dyad_shutdown();
 
+	asset_cache_uninit();
 	spritesets_uninit();
 	audio_uninit();
 	galileo_uninit();
 	events_uninit();
+	loader_uninit();
 	dispatch_uninit();
 
 	console_log(1, "shutting down Allegro");
@@ -782,20 +841,29 @@ parse_command_line(
 	int argc, char* argv[],
 	path_t* *out_game_path, int *out_fullscreen, int *out_frameskip,
 	int *out_verbosity, ssj_mode_t *out_ssj_mode, bool *out_retro_mode,
-	int *out_extras_offset)
+	bool *out_vsync, int *out_cache_size, int *out_memory_limit,
+	const char* *out_benchmark_path, const char* *out_capture_path,
+	bool *out_capture_raw, int *out_tick_rate, int *out_extras_offset)
 {
 	bool parse_options = true;
 
 	int i, j;
 
 	// establish default settings
+	*out_benchmark_path = NULL;
+	*out_cache_size = 64;
+	*out_capture_path = NULL;
+	*out_capture_raw = false;
 	*out_extras_offset = argc;
 	*out_fullscreen = FULLSCREEN_AUTO;
 	*out_frameskip = 20;
 	*out_game_path = NULL;
+	*out_memory_limit = 0;
 	*out_retro_mode = false;
 	*out_ssj_mode = SSJ_PASSIVE;
+	*out_tick_rate = -1;
 	*out_verbosity = 0;
+	*out_vsync = false;
 
 	// process command line arguments
 	for (i = 1; i < argc; ++i) {
@@ -813,6 +881,19 @@ parse_command_line(
 			else if (strcmp(argv[i], "--windowed") == 0) {
 				*out_fullscreen = FULLSCREEN_OFF;
 			}
+			else if (strcmp(argv[i], "--vsync") == 0) {
+				*out_vsync = true;
+			}
+			else if (strcmp(argv[i], "--cache-size") == 0) {
+				if (++i >= argc)
+					goto missing_argument;
+				*out_cache_size = fmax(atoi(argv[i]), 0);
+			}
+			else if (strcmp(argv[i], "--memory-limit") == 0) {
+				if (++i >= argc)
+					goto missing_argument;
+				*out_memory_limit = fmax(atoi(argv[i]), 0);
+			}
 #if defined(NEOSPHERE_SPHERUN)
 			else if (strcmp(argv[i], "--version") == 0) {
 				print_banner(true, true);
@@ -822,9 +903,28 @@ parse_command_line(
 				print_usage();
 				return false;
 			}
+			else if (strcmp(argv[i], "--benchmark") == 0) {
+				if (++i >= argc)
+					goto missing_argument;
+				*out_benchmark_path = argv[i];
+			}
+			else if (strcmp(argv[i], "--capture") == 0 || strcmp(argv[i], "--capture-raw") == 0) {
+				if (++i >= argc)
+					goto missing_argument;
+				*out_capture_path = argv[i];
+				*out_capture_raw = strcmp(argv[i - 1], "--capture-raw") == 0;
+			}
 			else if (strcmp(argv[i], "--debug") == 0) {
 				*out_ssj_mode = SSJ_ACTIVE;
 			}
+			else if (strcmp(argv[i], "--headless") == 0) {
+				g_headless = true;
+			}
+			else if (strcmp(argv[i], "--tick-rate") == 0) {
+				if (++i >= argc)
+					goto missing_argument;
+				*out_tick_rate = fmax(atoi(argv[i]), 0);
+			}
 			else if (strcmp(argv[i], "--retro") == 0) {
 				*out_retro_mode = true;
 			}
@@ -889,7 +989,7 @@ parse_command_line(
 	}
 
 #if defined(NEOSPHERE_SPHERUN)
-	if (*out_game_path == NULL) {
+	if (*out_game_path == NULL && *out_benchmark_path == NULL) {
 		print_usage();
 		return false;
 	}
@@ -935,13 +1035,28 @@ print_usage(void)
 	print_banner(true, false);
 	printf("\n");
 	printf("USAGE:\n");
-	printf("   spherun [--fullscreen | --windowed] [--frameskip <n>] [--debug | --profile]\n");
-	printf("           [--retro] [--verbose <n>] <game_path> [<game_args>]                \n");
+	printf("   spherun [--fullscreen | --windowed] [--frameskip <n>] [--vsync]            \n");
+	printf("           [--cache-size <MiB>] [--memory-limit <MiB>] [--debug | --profile]  \n");
+	printf("           [--retro] [--capture[-raw] <dir>] [--verbose <n>] <game_path>      \n");
+	printf("           [<game_args>]                                                      \n");
+	printf("   spherun --headless [--tick-rate <n>] [--cache-size <MiB>]                  \n");
+	printf("           [--memory-limit <MiB>] [--debug | --profile] [--verbose <n>]       \n");
+	printf("           <game_path> [<game_args>]                                          \n");
+	printf("   spherun [--verbose <n>] --benchmark <out_file>                             \n");
 	printf("\n");
 	printf("OPTIONS:\n");
 	printf("       --fullscreen   Start the game in fullscreen mode                       \n");
 	printf("       --windowed     Start the game in windowed mode (default for SpheRun)   \n");
 	printf("       --frameskip    Set the maximum number of consecutive frames to skip    \n");
+	printf("       --vsync        Align frames to the display's refresh (if supported)    \n");
+	printf("       --cache-size   Set the asset cache budget in MiB (default: 64)         \n");
+	printf("       --memory-limit Cap JavaScript memory use in MiB (default: no limit)    \n");
+	printf("       --capture      Save every frame to a directory as a PNG sequence       \n");
+	printf("       --capture-raw  Save every frame to a directory as raw PPM images       \n");
+	printf("       --benchmark    Time JS/native calls and write the results as JSON      \n");
+	printf("       --headless     Run without a window, audio or input, e.g. as a server  \n");
+	printf("       --tick-rate    Set the headless tick rate, 0 = unthrottled (default:   \n");
+	printf("                      the game's frame rate)                                  \n");
 	printf("   -d  --debug        Wait 30 seconds for an SSj/Ki debugger to connect       \n");
 	printf("   -p  --profile      Enable the profiler for this session (disables debugger)\n");
 	printf("   -r  --retro        Emulate the game's targeted API level (retrograde mode) \n");
@@ -996,6 +1111,11 @@ show_error_screen(const char* message)
 
 	int i;
 
+	// note: with no display, there's nobody to show the error screen to.  the
+	//       error has already been written to stderr by this point.
+	if (g_headless)
+		return;
+
 	title_index = rand() % (sizeof ERROR_TEXT / sizeof(const char*) / 2);
 	title = ERROR_TEXT[title_index][0];
 	subtitle = ERROR_TEXT[title_index][1];
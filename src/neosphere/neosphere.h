@@ -79,6 +79,7 @@
 // type of eaty pig.  they're a relic from the early stages of engine development; while
 // I've pared this list down over time, ideally all of them should disappear.
 extern game_t*   g_game;
+extern bool      g_headless;
 extern double    g_idle_time;
 extern js_ref_t* g_main_object;
 extern screen_t* g_screen;
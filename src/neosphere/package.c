@@ -33,9 +33,19 @@
 #include "neosphere.h"
 #include "package.h"
 
+#include <zlib.h>
+
 #include "compress.h"
 #include "vector.h"
 
+// amount of compressed data read from the package at a time when streaming
+#define STREAM_CHUNK_SIZE 16384
+
+// distance, in uncompressed bytes, between saved inflate states when streaming.
+// seeking backwards only has to re-inflate from the nearest one before the
+// target rather than from the start of the file.
+#define STREAM_CHECKPOINT_SPACING 1048576
+
 struct asset
 {
 	package_t*    package;
@@ -46,11 +56,12 @@ struct asset
 
 struct package
 {
-	unsigned int  refcount;
-	unsigned int  id;
-	path_t*       path;
-	ALLEGRO_FILE* file;
-	vector_t*     index;
+	unsigned int   refcount;
+	unsigned int   id;
+	path_t*        path;
+	ALLEGRO_FILE*  file;
+	vector_t*      index;
+	ALLEGRO_MUTEX* mutex;
 };
 
 struct spk_entry
@@ -61,6 +72,29 @@ struct spk_entry
 	long   offset;
 };
 
+struct checkpoint
+{
+	size_t   pack_offset;
+	int64_t  position;
+	z_stream zstream;
+};
+
+struct spk_stream
+{
+	bool       at_eof;
+	vector_t*  checkpoints;
+	bool       failed;
+	size_t     file_size;
+	bool       finished;
+	uint8_t*   in_buffer;
+	long       offset;
+	size_t     pack_offset;
+	size_t     pack_size;
+	package_t* package;
+	int64_t    position;
+	z_stream   zstream;
+};
+
 #pragma pack(push, 1)
 struct spk_header
 {
@@ -81,6 +115,38 @@ struct spk_entry_hdr
 };
 #pragma pack(pop)
 
+static struct spk_entry* find_entry       (const package_t* package, const char* path);
+static void              save_checkpoint  (struct spk_stream* stream, int64_t position);
+static bool              stream_fclose    (ALLEGRO_FILE* file);
+static void              stream_fclearerr (ALLEGRO_FILE* file);
+static const char*       stream_ferrmsg   (ALLEGRO_FILE* file);
+static int               stream_ferror    (ALLEGRO_FILE* file);
+static bool              stream_feof      (ALLEGRO_FILE* file);
+static bool              stream_fflush    (ALLEGRO_FILE* file);
+static size_t            stream_fread     (ALLEGRO_FILE* file, void* buf, size_t size);
+static bool              stream_fseek     (ALLEGRO_FILE* file, int64_t offset, int whence);
+static off_t             stream_fsize     (ALLEGRO_FILE* file);
+static int64_t           stream_ftell     (ALLEGRO_FILE* file);
+static int               stream_fungetc   (ALLEGRO_FILE* file, int ch);
+static size_t            stream_fwrite    (ALLEGRO_FILE* file, const void* buf, size_t size);
+
+static const ALLEGRO_FILE_INTERFACE STREAM_INTERFACE =
+{
+	NULL,
+	stream_fclose,
+	stream_fread,
+	stream_fwrite,
+	stream_fflush,
+	stream_ftell,
+	stream_fseek,
+	stream_feof,
+	stream_ferror,
+	stream_ferrmsg,
+	stream_fclearerr,
+	stream_fungetc,
+	stream_fsize,
+};
+
 static unsigned int s_next_package_id = 1;
 
 package_t*
@@ -108,6 +174,7 @@ package_open(const char* path)
 		goto on_error;
 
 	package->path = path_new(path);
+	package->mutex = al_create_mutex();
 
 	// load the package index
 	console_log(4, "reading package index for package #%u", s_next_package_id);
@@ -134,6 +201,8 @@ on_error:
 	console_log(2, "failed to open package #%u", s_next_package_id++);
 	if (package != NULL) {
 		path_free(package->path);
+		if (package->mutex != NULL)
+			al_destroy_mutex(package->mutex);
 		if (package->file != NULL)
 			al_fclose(package->file);
 		vector_free(package->index);
@@ -157,10 +226,26 @@ package_unref(package_t* it)
 
 	console_log(4, "disposing package #%u no longer in use", it->id);
 	vector_free(it->index);
+	al_destroy_mutex(it->mutex);
 	al_fclose(it->file);
 	free(it);
 }
 
+path_t*
+package_cache_path(const package_t* it, const char* pathname)
+{
+	// note: files opened for writing are extracted from the package into a
+	//       local cache; this returns where such a file would live.
+	path_t* cache_path;
+	path_t* local_path;
+
+	cache_path = path_rebase(path_new("assetCache"), app_data_path());
+	path_append_dir(cache_path, path_filename(it->path));
+	local_path = path_rebase(path_new(pathname), cache_path);
+	path_free(cache_path);
+	return local_path;
+}
+
 bool
 package_dir_exists(const package_t* it, const char* dirname)
 {
@@ -293,7 +378,6 @@ asset_fopen(package_t* package, const char* pathname, const char* mode)
 	ALLEGRO_FILE* al_file = NULL;
 	asset_t*      asset = NULL;
 	void*         buffer = NULL;
-	path_t*       cache_path;
 	size_t        file_size;
 	const char*   local_filename;
 	path_t*       local_path;
@@ -301,10 +385,7 @@ asset_fopen(package_t* package, const char* pathname, const char* mode)
 	console_log(4, "opening '%s' (%s) from package #%u", pathname, mode, package->id);
 
 	// get path to local cache file
-	cache_path = path_rebase(path_new("assetCache"), app_data_path());
-	path_append_dir(cache_path, path_filename(package->path));
-	local_path = path_rebase(path_new(pathname), cache_path);
-	path_free(cache_path);
+	local_path = package_cache_path(package, pathname);
 
 	// ensure all subdirectories exist
 	local_filename = path_cstr(local_path);
@@ -403,26 +484,26 @@ asset_fseek(asset_t* file, long long offset, spk_seek_origin_t origin)
 void*
 asset_fslurp(package_t* package, const char* path, size_t *out_size)
 {
+	size_t            bytes_read;
 	struct spk_entry* entry;
 	void*             packdata = NULL;
 	void*             unpacked = NULL;
 	size_t            unpack_size;
 
-	iter_t iter;
-
 	console_log(3, "unpacking '%s' from package #%u", path, package->id);
 
-	iter = vector_enum(package->index);
-	while ((entry = iter_next(&iter))) {
-		if (strcasecmp(path, entry->file_path) == 0)
-			break;
-	}
-	if (entry == NULL)
+	if (!(entry = find_entry(package, path)))
 		goto on_error;
 	if (!(packdata = malloc(entry->pack_size)))
 		goto on_error;
+
+	// note: assets may be unpacked on a worker thread, so the seek and read have
+	//       to happen as a unit.  decompression can safely run unlocked.
+	al_lock_mutex(package->mutex);
 	al_fseek(package->file, entry->offset, ALLEGRO_SEEK_SET);
-	if (al_fread(package->file, packdata, entry->pack_size) < entry->pack_size)
+	bytes_read = al_fread(package->file, packdata, entry->pack_size);
+	al_unlock_mutex(package->mutex);
+	if (bytes_read < entry->pack_size)
 		goto on_error;
 	if (!(unpacked = z_inflate(packdata, entry->pack_size, entry->file_size, &unpack_size)))
 		goto on_error;
@@ -438,6 +519,51 @@ on_error:
 	return NULL;
 }
 
+ALLEGRO_FILE*
+asset_fstream(package_t* package, const char* path)
+{
+	// note: unlike asset_fopen(), this doesn't unpack the whole file up front.
+	//       data is inflated as it's read, so memory use stays bounded no matter
+	//       how big the file is.  this is meant for audio streams and the like,
+	//       which mostly read front to back.  the inflate state is saved every so
+	//       often as the file is read, so seeking backwards only has to re-inflate
+	//       from the closest saved state rather than from the start of the file.
+	struct spk_entry*  entry;
+	ALLEGRO_FILE*      file;
+	struct spk_stream* stream = NULL;
+
+	console_log(3, "streaming '%s' from package #%u", path, package->id);
+
+	if (!(entry = find_entry(package, path)))
+		goto on_error;
+	if (!(stream = calloc(1, sizeof(struct spk_stream))))
+		goto on_error;
+	if (!(stream->in_buffer = malloc(STREAM_CHUNK_SIZE)))
+		goto on_error;
+	if (!(stream->checkpoints = vector_new(sizeof(struct checkpoint))))
+		goto on_error;
+	if (inflateInit(&stream->zstream) != Z_OK)
+		goto on_error;
+	stream->offset = entry->offset;
+	stream->pack_size = entry->pack_size;
+	stream->file_size = entry->file_size;
+	if (!(file = al_create_file_handle(&STREAM_INTERFACE, stream))) {
+		inflateEnd(&stream->zstream);
+		goto on_error;
+	}
+	stream->package = package_ref(package);
+	return file;
+
+on_error:
+	console_log(3, "couldn't stream '%s' from package #%u", path, package->id);
+	if (stream != NULL) {
+		vector_free(stream->checkpoints);
+		free(stream->in_buffer);
+	}
+	free(stream);
+	return NULL;
+}
+
 long long
 asset_ftell(asset_t* file)
 {
@@ -449,3 +575,265 @@ asset_fwrite(const void* buf, size_t size, size_t count, asset_t* file)
 {
 	return al_fwrite(file->handle, buf, size * count) / size;
 }
+
+static struct spk_entry*
+find_entry(const package_t* package, const char* path)
+{
+	struct spk_entry* entry;
+
+	iter_t iter;
+
+	iter = vector_enum(package->index);
+	while ((entry = iter_next(&iter))) {
+		if (strcasecmp(path, entry->file_path) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+static void
+save_checkpoint(struct spk_stream* stream, int64_t position)
+{
+	struct checkpoint checkpoint;
+
+	// note: inflateCopy() keeps any input bits inflate has already taken in, so
+	//       resuming from a checkpoint picks up reading the package right where
+	//       the unconsumed input starts.
+	checkpoint.pack_offset = stream->pack_offset - stream->zstream.avail_in;
+	checkpoint.position = position;
+	if (inflateCopy(&checkpoint.zstream, &stream->zstream) != Z_OK)
+		return;
+	if (!vector_push(stream->checkpoints, &checkpoint))
+		inflateEnd(&checkpoint.zstream);
+}
+
+static bool
+stream_fclose(ALLEGRO_FILE* file)
+{
+	struct checkpoint* checkpoint;
+	struct spk_stream* stream;
+
+	iter_t iter;
+
+	stream = al_get_file_userdata(file);
+	iter = vector_enum(stream->checkpoints);
+	while ((checkpoint = iter_next(&iter)))
+		inflateEnd(&checkpoint->zstream);
+	vector_free(stream->checkpoints);
+	inflateEnd(&stream->zstream);
+	package_unref(stream->package);
+	free(stream->in_buffer);
+	free(stream);
+	return true;
+}
+
+static void
+stream_fclearerr(ALLEGRO_FILE* file)
+{
+	struct spk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	stream->at_eof = false;
+	stream->failed = false;
+}
+
+static const char*
+stream_ferrmsg(ALLEGRO_FILE* file)
+{
+	struct spk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return stream->failed ? "error reading from SPK package" : "";
+}
+
+static int
+stream_ferror(ALLEGRO_FILE* file)
+{
+	struct spk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return stream->failed ? 1 : 0;
+}
+
+static bool
+stream_feof(ALLEGRO_FILE* file)
+{
+	struct spk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return stream->at_eof;
+}
+
+static bool
+stream_fflush(ALLEGRO_FILE* file)
+{
+	return true;
+}
+
+static size_t
+stream_fread(ALLEGRO_FILE* file, void* buf, size_t size)
+{
+	size_t             bytes_read;
+	size_t             chunk_size;
+	struct checkpoint* last_checkpoint;
+	int64_t            next_checkpoint;
+	int64_t            position;
+	int                result;
+	struct spk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	last_checkpoint = vector_len(stream->checkpoints) > 0
+		? vector_get(stream->checkpoints, vector_len(stream->checkpoints) - 1)
+		: NULL;
+	next_checkpoint = (last_checkpoint != NULL ? last_checkpoint->position : 0)
+		+ STREAM_CHECKPOINT_SPACING;
+	stream->zstream.next_out = buf;
+	stream->zstream.avail_out = (uInt)size;
+	while (stream->zstream.avail_out > 0 && !stream->finished && !stream->failed) {
+		if (stream->zstream.avail_in == 0) {
+			// refill the input buffer.  the package file handle is shared with
+			// other readers, some of which may be on other threads, so the seek
+			// and read need to happen together.
+			chunk_size = stream->pack_size - stream->pack_offset;
+			if (chunk_size > STREAM_CHUNK_SIZE)
+				chunk_size = STREAM_CHUNK_SIZE;
+			al_lock_mutex(stream->package->mutex);
+			al_fseek(stream->package->file, stream->offset + stream->pack_offset, ALLEGRO_SEEK_SET);
+			bytes_read = al_fread(stream->package->file, stream->in_buffer, chunk_size);
+			al_unlock_mutex(stream->package->mutex);
+			if (chunk_size == 0 || bytes_read < chunk_size) {
+				stream->failed = true;
+				break;
+			}
+			stream->pack_offset += chunk_size;
+			stream->zstream.next_in = stream->in_buffer;
+			stream->zstream.avail_in = (uInt)chunk_size;
+		}
+		result = inflate(&stream->zstream, Z_NO_FLUSH);
+		if (result == Z_STREAM_END)
+			stream->finished = true;
+		else if (result != Z_OK && result != Z_BUF_ERROR)
+			stream->failed = true;
+		position = stream->position + (int64_t)(size - stream->zstream.avail_out);
+		if (result == Z_OK && position >= next_checkpoint) {
+			save_checkpoint(stream, position);
+			next_checkpoint = position + STREAM_CHECKPOINT_SPACING;
+		}
+	}
+	bytes_read = size - stream->zstream.avail_out;
+	stream->position += bytes_read;
+	if (bytes_read < size)
+		stream->at_eof = true;
+	return bytes_read;
+}
+
+static bool
+stream_fseek(ALLEGRO_FILE* file, int64_t offset, int whence)
+{
+	struct checkpoint* checkpoint;
+	uint8_t            discard[4096];
+	size_t             num_bytes;
+	struct checkpoint* resume_point = NULL;
+	struct spk_stream* stream;
+	int64_t            target;
+
+	iter_t iter;
+
+	stream = al_get_file_userdata(file);
+	switch (whence) {
+	case ALLEGRO_SEEK_SET:
+		target = offset;
+		break;
+	case ALLEGRO_SEEK_CUR:
+		target = stream->position + offset;
+		break;
+	case ALLEGRO_SEEK_END:
+		target = (int64_t)stream->file_size + offset;
+		break;
+	default:
+		return false;
+	}
+	if (target < 0 || target > (int64_t)stream->file_size)
+		return false;
+
+	// deflate streams can't be read backwards, so find the closest saved inflate
+	// state at or before the target.  this also speeds up skipping forward past
+	// a part of the file which was already read once.
+	iter = vector_enum(stream->checkpoints);
+	while ((checkpoint = iter_next(&iter))) {
+		if (checkpoint->position > target)
+			break;
+		resume_point = checkpoint;
+	}
+	if (resume_point != NULL
+		&& (target < stream->position || resume_point->position > stream->position))
+	{
+		inflateEnd(&stream->zstream);
+		if (inflateCopy(&stream->zstream, &resume_point->zstream) != Z_OK) {
+			// couldn't restore the checkpoint, start over from the top
+			if (inflateInit(&stream->zstream) != Z_OK)
+				return false;
+			stream->zstream.avail_in = 0;
+			stream->pack_offset = 0;
+			stream->position = 0;
+		}
+		else {
+			stream->zstream.avail_in = 0;
+			stream->pack_offset = resume_point->pack_offset;
+			stream->position = resume_point->position;
+		}
+		stream->finished = false;
+		stream->failed = false;
+	}
+	else if (target < stream->position) {
+		// no checkpoint before the target, start over from the top
+		if (inflateReset(&stream->zstream) != Z_OK)
+			return false;
+		stream->zstream.avail_in = 0;
+		stream->pack_offset = 0;
+		stream->position = 0;
+		stream->finished = false;
+		stream->failed = false;
+	}
+	while (stream->position < target) {
+		num_bytes = target - stream->position;
+		if (num_bytes > sizeof discard)
+			num_bytes = sizeof discard;
+		if (stream_fread(file, discard, num_bytes) < num_bytes)
+			return false;
+	}
+	stream->at_eof = false;
+	return true;
+}
+
+static off_t
+stream_fsize(ALLEGRO_FILE* file)
+{
+	struct spk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return (off_t)stream->file_size;
+}
+
+static int64_t
+stream_ftell(ALLEGRO_FILE* file)
+{
+	struct spk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return stream->position;
+}
+
+static int
+stream_fungetc(ALLEGRO_FILE* file, int ch)
+{
+	// note: pushing back a character means backing up one byte, which only
+	//       needs a seek since the data read is always the same.
+	return stream_fseek(file, -1, ALLEGRO_SEEK_CUR) ? ch : EOF;
+}
+
+static size_t
+stream_fwrite(ALLEGRO_FILE* file, const void* buf, size_t size)
+{
+	return 0;
+}
@@ -44,20 +44,22 @@ enum spk_seek_origin
 	SPK_SEEK_END
 } spk_seek_origin_t;
 
-package_t*  package_open        (const char* filename);
-package_t*  package_ref         (package_t* it);
-void        package_unref       (package_t* it);
-bool        package_dir_exists  (const package_t* it, const char* dirname);
-bool        package_file_exists (const package_t* it, const char* filename);
-vector_t*   package_list_dir    (package_t* it, const char* dirname, bool want_dirs, bool recursive);
-asset_t*    asset_fopen         (package_t* package, const char* path, const char* mode);
-void        asset_fclose        (asset_t* file);
-int         asset_fputc         (int ch, asset_t* file);
-int         asset_fputs         (const char* string, asset_t* file);
-size_t      asset_fread         (void* buf, size_t size, size_t count, asset_t* file);
-bool        asset_fseek         (asset_t* file, long long offset, spk_seek_origin_t origin);
-void*       asset_fslurp        (package_t* it, const char* path, size_t *out_size);
-long long   asset_ftell         (asset_t* file);
-size_t      asset_fwrite        (const void* buf, size_t size, size_t count, asset_t* file);
+package_t*    package_open        (const char* filename);
+package_t*    package_ref         (package_t* it);
+void          package_unref       (package_t* it);
+path_t*       package_cache_path  (const package_t* it, const char* pathname);
+bool          package_dir_exists  (const package_t* it, const char* dirname);
+bool          package_file_exists (const package_t* it, const char* filename);
+vector_t*     package_list_dir    (package_t* it, const char* dirname, bool want_dirs, bool recursive);
+asset_t*      asset_fopen         (package_t* package, const char* path, const char* mode);
+void          asset_fclose        (asset_t* file);
+int           asset_fputc         (int ch, asset_t* file);
+int           asset_fputs         (const char* string, asset_t* file);
+size_t        asset_fread         (void* buf, size_t size, size_t count, asset_t* file);
+bool          asset_fseek         (asset_t* file, long long offset, spk_seek_origin_t origin);
+void*         asset_fslurp        (package_t* it, const char* path, size_t *out_size);
+ALLEGRO_FILE* asset_fstream       (package_t* package, const char* path);
+long long     asset_ftell         (asset_t* file);
+size_t        asset_fwrite        (const void* buf, size_t size, size_t count, asset_t* file);
 
 #endif // !NEOSPHERE_PACKAGE_H_INCLUDED
@@ -34,6 +34,7 @@
 #include "pegasus.h"
 
 #include "api.h"
+#include "asset_cache.h"
 #include "audio.h"
 #include "blend_op.h"
 #include "color.h"
@@ -269,6 +270,7 @@ static bool js_Sphere_get_Game               (int num_args, bool is_ctor, intptr
 static bool js_Sphere_get_Version            (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_frameRate          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_frameSkip          (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Sphere_get_frameStats         (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_fullScreen         (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_get_main               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sphere_set_frameRate          (int num_args, bool is_ctor, intptr_t magic);
@@ -367,7 +369,10 @@ static bool js_Keyboard_getKey               (int num_args, bool is_ctor, intptr
 static bool js_Keyboard_isPressed            (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Mixer_get_Default             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_Mixer                     (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Mixer_get_maxVoices           (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Mixer_get_voiceStats          (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Mixer_get_volume              (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Mixer_set_maxVoices           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Mixer_set_volume              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_Model                     (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Model_get_shader              (int num_args, bool is_ctor, intptr_t magic);
@@ -436,6 +441,7 @@ static bool js_Socket_connectTo              (int num_args, bool is_ctor, intptr
 static bool js_Socket_disconnect             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Socket_peek                   (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Socket_read                   (int num_args, bool is_ctor, intptr_t magic);
+static bool js_Socket_readInto               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Socket_write                  (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_Sound                     (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Sound_get_fileName            (int num_args, bool is_ctor, intptr_t magic);
@@ -481,6 +487,10 @@ static bool js_TextDecoder_decode            (int num_args, bool is_ctor, intptr
 static bool js_new_TextEncoder               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_TextEncoder_get_encoding      (int num_args, bool is_ctor, intptr_t magic);
 static bool js_TextEncoder_encode            (int num_args, bool is_ctor, intptr_t magic);
+static bool js_new_TextLayout                (int num_args, bool is_ctor, intptr_t magic);
+static bool js_TextLayout_get_height         (int num_args, bool is_ctor, intptr_t magic);
+static bool js_TextLayout_get_width          (int num_args, bool is_ctor, intptr_t magic);
+static bool js_TextLayout_draw               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Texture_fromFile              (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_Texture                   (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Texture_get_fileName          (int num_args, bool is_ctor, intptr_t magic);
@@ -529,6 +539,7 @@ static void js_Sound_finalize           (void* host_ptr);
 static void js_SoundStream_finalize     (void* host_ptr);
 static void js_TextDecoder_finalize     (void* host_ptr);
 static void js_TextEncoder_finalize     (void* host_ptr);
+static void js_TextLayout_finalize      (void* host_ptr);
 static void js_Texture_finalize         (void* host_ptr);
 static void js_Transform_finalize       (void* host_ptr);
 static void js_VertexList_finalize      (void* host_ptr);
@@ -737,7 +748,9 @@ pegasus_init(int api_level, int target_api_level)
 	api_define_method("Socket", "close", js_Socket_close, 0);
 	api_define_method("Socket", "connectTo", js_Socket_connectTo, 0);
 	api_define_method("Socket", "read", js_Socket_read, 0);
+	api_define_method("Socket", "readInto", js_Socket_readInto, 0);
 	api_define_method("Socket", "write", js_Socket_write, 0);
+	api_define_method_async("Socket", "asyncReadInto", js_Socket_readInto, 0);
 	api_define_class("Sound", PEGASUS_SOUND, js_new_Sound, js_Sound_finalize, 0);
 	api_define_prop("Sound", "fileName", false, js_Sound_get_fileName, NULL);
 	api_define_prop("Sound", "length", false, js_Sound_get_length, NULL);
@@ -1006,6 +1019,9 @@ pegasus_init(int api_level, int target_api_level)
 		api_define_prop_static("Transform", "Identity", js_Transform_get_Identity, NULL, 0);
 		api_define_func("Color", "fromRGBA", js_Color_fromRGBA, 0);
 		api_define_func("Dispatch", "onExit", js_Dispatch_onExit, 0);
+		api_define_prop_static("Sphere", "frameStats", js_Sphere_get_frameStats, NULL, 0);
+		api_define_prop("Mixer", "maxVoices", false, js_Mixer_get_maxVoices, js_Mixer_set_maxVoices);
+		api_define_prop("Mixer", "voiceStats", false, js_Mixer_get_voiceStats, NULL);
 		api_define_func_async("File", "exists", js_File_exists, 0);
 		api_define_func_async("File", "load", js_File_load, 0);
 		api_define_func_async("File", "remove", js_File_remove, 0);
@@ -1020,6 +1036,10 @@ pegasus_init(int api_level, int target_api_level)
 		api_define_func("Transform", "translate", js_Transform_translate, 1);
 		api_define_func("Z", "deflate", js_Z_deflate, 0);
 		api_define_func("Z", "inflate", js_Z_inflate, 0);
+		api_define_class("TextLayout", PEGASUS_TEXT_LAYOUT, js_new_TextLayout, js_TextLayout_finalize, 0);
+		api_define_prop("TextLayout", "height", false, js_TextLayout_get_height, NULL);
+		api_define_prop("TextLayout", "width", false, js_TextLayout_get_width, NULL);
+		api_define_method("TextLayout", "draw", js_TextLayout_draw, 0);
 		api_define_prop("Surface", "depthOp", false, js_Surface_get_depthOp, js_Surface_set_depthOp);
 		api_define_method("Shader", "setSampler", js_Shader_setSampler, 0);
 		api_define_method("Surface", "clear", js_Surface_clear, 0);
@@ -1220,6 +1240,26 @@ js_Sphere_get_frameSkip(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_Sphere_get_frameStats(int num_args, bool is_ctor, intptr_t magic)
+{
+	double max_time;
+	double mean_time;
+	double stddev;
+
+	screen_get_frame_stats(g_screen, &mean_time, &stddev, &max_time);
+	jsal_push_new_object();
+	jsal_push_number(mean_time * 1000.0);
+	jsal_put_prop_string(-2, "mean");
+	jsal_push_number(stddev * 1000.0);
+	jsal_put_prop_string(-2, "stdDev");
+	jsal_push_number(max_time * 1000.0);
+	jsal_put_prop_string(-2, "max");
+	jsal_push_boolean(screen_get_vsync(g_screen));
+	jsal_put_prop_string(-2, "vsync");
+	return true;
+}
+
 static bool
 js_Sphere_get_fullScreen(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -2536,6 +2576,8 @@ js_new_Font(int num_args, bool is_ctor, intptr_t magic)
 	ttf_t*      font;
 	bool        kerning = true;
 	const char* pathname;
+	uint32_t    preload_first = 0x20;
+	uint32_t    preload_last = 0x7E;
 	int         size = 12;
 
 	pathname = jsal_require_pathname(0, NULL, false, false);
@@ -2549,13 +2591,29 @@ js_new_Font(int num_args, bool is_ctor, intptr_t magic)
 			antialiasing = jsal_require_boolean(-1);
 		if (jsal_get_prop_string(2, "kern"))
 			kerning = jsal_require_boolean(-1);
+		if (jsal_get_prop_string(2, "preload")) {
+			if (!jsal_is_array(-1) || jsal_get_length(-1) != 2)
+				jsal_error(JS_TYPE_ERROR, "'preload' must be a [first, last] codepoint pair");
+			jsal_get_prop_index(-1, 0);
+			jsal_get_prop_index(-2, 1);
+			preload_first = jsal_require_uint(-2);
+			preload_last = jsal_require_uint(-1);
+			if (preload_first > preload_last || preload_last > 0x10FFFF)
+				jsal_error(JS_RANGE_ERROR, "Invalid preload range [U+%04X-U+%04X]", preload_first, preload_last);
+		}
 	}
 
 	if (is_ctor && s_target_api_level >= 4)
 		jsal_error(JS_ERROR, "'new Font' can't be used when targeting API 4 or higher.");
 
+	if (!is_ctor) {
+		// Font.fromFile(): read the file on a worker thread
+		events_load_font(pathname, -size, kerning, antialiasing, preload_first, preload_last);
+		return true;
+	}
 	if (!(font = ttf_open(pathname, -size, kerning, antialiasing)))
 		jsal_error(JS_ERROR, "Unable to load a font from file '%s'.", pathname);
+	ttf_preload(font, preload_first, preload_last);
 	jsal_push_class_obj(PEGASUS_FONT, font, is_ctor);
 	return true;
 }
@@ -3124,6 +3182,48 @@ js_Mixer_finalize(void* host_ptr)
 	mixer_unref(host_ptr);
 }
 
+static bool
+js_Mixer_get_maxVoices(int num_args, bool is_ctor, intptr_t magic)
+{
+	mixer_t* mixer;
+
+	jsal_push_this();
+	mixer = jsal_require_class_obj(-1, PEGASUS_MIXER);
+
+	jsal_push_int(mixer_get_max_voices(mixer));
+	return true;
+}
+
+static bool
+js_Mixer_get_voiceStats(int num_args, bool is_ctor, intptr_t magic)
+{
+	mixer_t*      mixer;
+	voice_stats_t stats;
+
+	jsal_push_this();
+	mixer = jsal_require_class_obj(-1, PEGASUS_MIXER);
+
+	mixer_get_voice_stats(mixer, &stats);
+	jsal_push_new_object();
+	jsal_push_int(stats.num_active);
+	jsal_put_prop_string(-2, "active");
+	jsal_push_int(stats.num_voices);
+	jsal_put_prop_string(-2, "allocated");
+	jsal_push_int(stats.max_voices);
+	jsal_put_prop_string(-2, "max");
+	jsal_push_int(stats.peak_active);
+	jsal_put_prop_string(-2, "peak");
+	jsal_push_uint(stats.num_plays);
+	jsal_put_prop_string(-2, "played");
+	jsal_push_uint(stats.num_reuses);
+	jsal_put_prop_string(-2, "reused");
+	jsal_push_uint(stats.num_steals);
+	jsal_put_prop_string(-2, "stolen");
+	jsal_push_uint(stats.num_drops);
+	jsal_put_prop_string(-2, "dropped");
+	return true;
+}
+
 static bool
 js_Mixer_get_volume(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -3150,6 +3250,22 @@ js_Mixer_set_volume(int num_args, bool is_ctor, intptr_t magic)
 	return false;
 }
 
+static bool
+js_Mixer_set_maxVoices(int num_args, bool is_ctor, intptr_t magic)
+{
+	int max_voices = jsal_require_int(0);
+
+	mixer_t* mixer;
+
+	jsal_push_this();
+	mixer = jsal_require_class_obj(-1, PEGASUS_MIXER);
+
+	if (max_voices < 1)
+		jsal_error(JS_RANGE_ERROR, "Invalid voice count '%d'", max_voices);
+	mixer_set_max_voices(mixer, max_voices);
+	return false;
+}
+
 static bool
 js_new_Model(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -3665,6 +3781,15 @@ js_new_Sample(int num_args, bool is_ctor, intptr_t magic)
 	if (is_ctor && s_target_api_level >= 4)
 		jsal_error(JS_ERROR, "'new Sample' can't be used when targeting API 4 or higher.");
 
+	if (!is_ctor) {
+		// Sample.fromFile(): decode on a worker thread, unless it's cached already
+		if ((sample = asset_cache_get(CACHE_SAMPLE, filename, true))) {
+			jsal_push_class_obj(PEGASUS_SAMPLE, sample, false);
+			return true;
+		}
+		events_load_sample(filename);
+		return true;
+	}
 	if (!(sample = sample_new(filename, true)))
 		jsal_error(JS_ERROR, "Unable to load an audio sample from file '%s'.", filename);
 	jsal_push_class_obj(PEGASUS_SAMPLE, sample, is_ctor);
@@ -3694,6 +3819,7 @@ js_Sample_play(int num_args, bool is_ctor, intptr_t magic)
 {
 	mixer_t*  mixer;
 	float     pan = 0.0;
+	int       priority = 0;
 	sample_t* sample;
 	float     speed = 1.0;
 	float     volume = 1.0;
@@ -3712,10 +3838,14 @@ js_Sample_play(int num_args, bool is_ctor, intptr_t magic)
 		jsal_get_prop_string(1, "speed");
 		if (!jsal_is_undefined(-1))
 			speed = jsal_require_number(-1);
+		jsal_get_prop_string(1, "priority");
+		if (!jsal_is_undefined(-1))
+			priority = jsal_require_int(-1);
 	}
 
 	sample_set_gain(sample, volume);
 	sample_set_pan(sample, pan);
+	sample_set_priority(sample, priority);
 	sample_set_speed(sample, speed);
 	sample_play(sample, mixer);
 	return false;
@@ -4569,6 +4699,36 @@ js_Socket_read(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_Socket_readInto(int num_args, bool is_ctor, intptr_t magic)
+{
+	void*     buffer;
+	int       num_bytes;
+	size_t    size;
+	socket_t* socket;
+
+	jsal_push_this();
+	socket = jsal_require_class_obj(-1, PEGASUS_SOCKET);
+	buffer = jsal_require_buffer_ptr(0, &size);
+
+	if (jsal_is_async_call()) {
+		if (!socket_connected(socket) && (int)size > socket_bytes_avail(socket))
+			jsal_error(JS_ERROR, "Cannot read from disconnected Socket");
+		events_read_socket_into(socket, 0);
+	}
+	else {
+		// note: only take what's already buffered.  this never blocks, even for
+		//       a sync-mode socket, and still works after a disconnect as long as
+		//       there's data left to read.
+		num_bytes = socket_bytes_avail(socket);
+		if (num_bytes > (int)size)
+			num_bytes = (int)size;
+		num_bytes = socket_read(socket, buffer, num_bytes);
+		jsal_push_int(num_bytes);
+	}
+	return true;
+}
+
 static bool
 js_Socket_write(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -5287,12 +5447,89 @@ js_TextEncoder_encode(int num_args, bool is_ctor, intptr_t magic)
 	return true;
 }
 
+static bool
+js_new_TextLayout(int num_args, bool is_ctor, intptr_t magic)
+{
+	ttf_t*        font;
+	textlayout_t* layout;
+	const char*   text;
+	int           width = 0;
+
+	font = jsal_require_class_obj(0, PEGASUS_FONT);
+	text = jsal_to_string(1);
+	if (num_args >= 3)
+		width = jsal_require_int(2);
+
+	if (!(layout = textlayout_new(font, text, width)))
+		jsal_error(JS_ERROR, "Couldn't lay out text for drawing");
+	jsal_push_class_obj(PEGASUS_TEXT_LAYOUT, layout, true);
+	return true;
+}
+
+static void
+js_TextLayout_finalize(void* host_ptr)
+{
+	textlayout_unref(host_ptr);
+}
+
+static bool
+js_TextLayout_get_height(int num_args, bool is_ctor, intptr_t magic)
+{
+	textlayout_t* layout;
+
+	jsal_push_this();
+	layout = jsal_require_class_obj(-1, PEGASUS_TEXT_LAYOUT);
+
+	jsal_push_int(textlayout_height(layout));
+	cache_value_to_this("height");
+	return true;
+}
+
+static bool
+js_TextLayout_get_width(int num_args, bool is_ctor, intptr_t magic)
+{
+	textlayout_t* layout;
+
+	jsal_push_this();
+	layout = jsal_require_class_obj(-1, PEGASUS_TEXT_LAYOUT);
+
+	jsal_push_int(textlayout_width(layout));
+	cache_value_to_this("width");
+	return true;
+}
+
+static bool
+js_TextLayout_draw(int num_args, bool is_ctor, intptr_t magic)
+{
+	color_t       color;
+	textlayout_t* layout;
+	image_t*      surface;
+	int           x;
+	int           y;
+
+	jsal_push_this();
+	layout = jsal_require_class_obj(-1, PEGASUS_TEXT_LAYOUT);
+	surface = jsal_require_class_obj(0, PEGASUS_SURFACE);
+	x = jsal_require_int(1);
+	y = jsal_require_int(2);
+	color = num_args >= 4 ? jsal_pegasus_require_color(3)
+		: mk_color(255, 255, 255, 255);
+
+	if (surface == screen_backbuffer(g_screen) && screen_skipping_frame(g_screen))
+		return false;
+	image_render_to(surface, NULL);
+	shader_use(galileo_shader(), false);
+	textlayout_draw(layout, x, y, color);
+	return false;
+}
+
 static bool
 js_Texture_fromFile(int num_args, bool is_ctor, intptr_t magic)
 {
 	int         class_id;
 	const char* filename;
 	image_t*    image;
+	bool        private_copy;
 
 	class_id = (int)magic;
 	filename = jsal_require_pathname(0, NULL, false, false);
@@ -5300,8 +5537,20 @@ js_Texture_fromFile(int num_args, bool is_ctor, intptr_t magic)
 	if (class_id == PEGASUS_SURFACE && s_target_api_level >= 4)
 		jsal_error(JS_ERROR, "'Surface.fromFile' is not supported when targeting API 4 or higher.");
 
-	if (!(image = image_load(filename)))
+	// note: images loaded from a file are shared through the asset cache, but a
+	//       Surface can be rendered to and, from API 4 on, a Texture can be
+	//       uploaded to, so those get their own copy which bypasses the cache.
+	private_copy = class_id == PEGASUS_SURFACE || s_target_api_level >= 4;
+	if (jsal_is_async_call()) {
+		// decode on a worker thread; the promise settles once it's uploaded
+		if (private_copy || !(image = asset_cache_get(CACHE_IMAGE, filename, 0))) {
+			events_load_image(filename, class_id, private_copy);
+			return true;
+		}
+	}
+	else if (!(image = image_load(filename, private_copy))) {
 		jsal_error(JS_ERROR, "Unable to load an image from file '%s'.", filename);
+	}
 	jsal_push_class_obj(class_id, image, false);
 	return true;
 }
@@ -5353,7 +5602,7 @@ js_new_Texture(int num_args, bool is_ctor, intptr_t magic)
 			jsal_error(JS_RANGE_ERROR, "'new Texture' from a file is not supported when targeting API 4 or higher.");
 
 		// create a new texture from the content of an image file
-		if (!(image = image_load(filename)))
+		if (!(image = image_load(filename, class_id == PEGASUS_SURFACE)))
 			jsal_error(JS_ERROR, "Couldn't load an image from file '%s'.", filename);
 	}
 	jsal_push_class_obj(class_id, image, true);
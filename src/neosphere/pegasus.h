@@ -59,6 +59,7 @@ enum pegasus_type
 	PEGASUS_SURFACE,
 	PEGASUS_TEXT_DEC,
 	PEGASUS_TEXT_ENC,
+	PEGASUS_TEXT_LAYOUT,
 	PEGASUS_TEXTURE,
 	PEGASUS_TRANSFORM,
 	PEGASUS_VERTEX_LIST,
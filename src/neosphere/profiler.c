@@ -50,8 +50,9 @@ struct record
 
 static bool js_instrumentedWrapper (int num_args, bool is_ctor, intptr_t magic);
 
-static int  order_records (const void* a_ptr, const void* b_ptr);
-static void print_results (double running_time);
+static int  order_records       (const void* a_ptr, const void* b_ptr);
+static void print_memory_report (void);
+static void print_results       (double running_time);
 
 bool      s_initialized = false;
 vector_t* s_records;
@@ -84,6 +85,7 @@ profiler_uninit(void)
 	vector_push(s_records, &record_obj);
 
 	print_results(runtime);
+	print_memory_report();
 
 	iter = vector_enum(s_records);
 	while ((record = iter_next(&iter))) {
@@ -131,6 +133,43 @@ order_records(const void* a_ptr, const void* b_ptr)
 		: 0;
 }
 
+static void
+print_memory_report(void)
+{
+	js_gc_stats_t gc_stats;
+	size_t        limit;
+	table_t*      table;
+
+	jsal_get_gc_stats(&gc_stats);
+	limit = jsal_get_memory_limit();
+
+	// note: ChakraCore only reports when a collection starts, so pause times
+	//       cover explicit collections (e.g. GarbageCollect()) only.
+	table = table_new("JavaScript memory", false);
+	table_add_column(table, "statistic");
+	table_add_column(table, "value");
+	table_add_text(table, 0, "heap usage (KiB)");
+	table_add_number(table, 1, jsal_get_memory_usage() / 1024);
+	table_add_text(table, 0, "memory limit (KiB)");
+	if (limit > 0)
+		table_add_number(table, 1, limit / 1024);
+	else
+		table_add_text(table, 1, "none");
+	table_add_text(table, 0, "collections");
+	table_add_number(table, 1, gc_stats.num_collections);
+	table_add_text(table, 0, "explicit collections");
+	table_add_number(table, 1, gc_stats.num_explicit);
+	table_add_text(table, 0, "explicit GC time (" UNIT_NAME ")");
+	table_add_number(table, 1, gc_stats.total_pause * TIME_PRECISION);
+	table_add_text(table, 0, "longest GC pause (" UNIT_NAME ")");
+	table_add_number(table, 1, gc_stats.max_pause * TIME_PRECISION);
+	table_add_text(table, 0, "failed allocations");
+	table_add_number(table, 1, gc_stats.num_alloc_failures);
+	printf("\n");
+	table_print(table);
+	table_free(table);
+}
+
 static void
 print_results(double running_time)
 {
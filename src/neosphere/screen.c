@@ -38,19 +38,47 @@
 #include "neosphere.h"
 #include "screen.h"
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
 #include "debugger.h"
 #include "font.h"
+#include "galileo.h"
 #include "image.h"
+#include "worker.h"
+
+// if this many captured frames are still waiting to be written out, new frames
+// are dropped rather than stalling the game.
+#define MAX_QUEUED_CAPTURES 8
+
+// frame pacing: the engine sleeps until it's within this many seconds (plus the
+// measured sleep overshoot) of the next frame, then spins for the remainder.
+#define MAX_OVERSHOOT 0.004
+#define MIN_SPIN_TIME 0.0005
 
 struct screen
 {
 	image_t*         backbuffer;
+	int              capture_frame;
+	path_t*          capture_path;
+	bool             capture_raw;
+	worker_t*        capture_worker;
 	rect_t           clip_rect;
 	ALLEGRO_DISPLAY* display;
 	font_t*          font;
 	int              fps_flips;
 	int              fps_frames;
 	double           fps_poll_time;
+	double           frame_max;
+	double           frame_mean;
+	double           frame_peak;
+	int              frame_samples;
+	double           frame_stddev;
+	double           frame_sum;
+	double           frame_sum_sq;
 	bool             fullscreen;
 	double           last_flip_time;
 	int              max_skips;
@@ -59,11 +87,15 @@ struct screen
 	double           notify_alpha;
 	double           notify_timer;
 	int              num_flips;
+	int              num_dropped;
 	int              num_frames;
 	int              num_skips;
 	bool             show_fps;
 	bool             skipping_frame;
+	double           sleep_overshoot;
 	bool             take_screenshot;
+	double           vblank_interval;
+	bool             vsync;
 	int              x_offset;
 	float            x_scale;
 	int              x_size;
@@ -72,14 +104,35 @@ struct screen
 	int              y_size;
 };
 
-static void refresh_display (screen_t* screen);
+struct capture
+{
+	ALLEGRO_BITMAP* bitmap;
+	char*           filename;
+	path_t*         path;
+	bool            raw;
+	screen_t*       screen;
+	bool            succeeded;
+};
+
+static void            finish_screenshot (void* udata);
+static void            free_capture      (void* udata);
+static struct capture* new_capture       (screen_t* screen);
+static void            present_frame     (screen_t* screen, int framerate);
+static ALLEGRO_BITMAP* read_backbuffer   (screen_t* screen);
+static void            refresh_display   (screen_t* screen);
+static bool            save_ppm          (const char* filename, ALLEGRO_BITMAP* bitmap);
+static void            wait_until        (screen_t* screen, double deadline);
+static void            write_capture     (void* udata);
+static void            write_screenshot  (void* udata);
+static void            yield_cpu         (void);
 
 screen_t*
-screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip, font_t* font)
+screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip, bool vsync, font_t* font)
 {
 	image_t*             backbuffer = NULL;
 	int                  bitmap_flags;
 	ALLEGRO_DISPLAY*     display = NULL;
+	int                  refresh_rate;
 	ALLEGRO_BITMAP*      icon_bitmap;
 	ALLEGRO_MONITOR_INFO desktop_info;
 	ALLEGRO_STATE        old_state;
@@ -94,21 +147,33 @@ screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip,
 
 	console_log(1, "initializing render context at %dx%d", resolution.width, resolution.height);
 
-	al_set_new_window_title(title);
-	al_set_new_display_flags(ALLEGRO_OPENGL | ALLEGRO_PROGRAMMABLE_PIPELINE);
-	if (al_get_monitor_info(0, &desktop_info)) {
-		x_scale = ((desktop_info.x2 - desktop_info.x1) * 2 / 3) / resolution.width;
-		y_scale = ((desktop_info.y2 - desktop_info.y1) * 2 / 3) / resolution.height;
-		x_scale = y_scale = fmax(fmin(x_scale, y_scale), 1.0);
+	if (!g_headless) {
+		al_set_new_window_title(title);
+		al_set_new_display_flags(ALLEGRO_OPENGL | ALLEGRO_PROGRAMMABLE_PIPELINE);
+		if (vsync)
+			al_set_new_display_option(ALLEGRO_VSYNC, 1, ALLEGRO_SUGGEST);
+		if (al_get_monitor_info(0, &desktop_info)) {
+			x_scale = ((desktop_info.x2 - desktop_info.x1) * 2 / 3) / resolution.width;
+			y_scale = ((desktop_info.y2 - desktop_info.y1) * 2 / 3) / resolution.height;
+			x_scale = y_scale = fmax(fmin(x_scale, y_scale), 1.0);
+		}
+		display = al_create_display(resolution.width * x_scale, resolution.height * y_scale);
+	}
+	else {
+		// headless mode: there's no display, so the backbuffer lives in system
+		// memory.  games still render to it as usual, it just never gets shown.
+		console_log(1, "    headless, rendering offscreen");
+		vsync = false;
 	}
-	display = al_create_display(resolution.width * x_scale, resolution.height * y_scale);
 
 	// using a custom backbuffer allows pixel-perfect rendering regardless of
 	// actual viewport size.
-	if (display != NULL) {
+	if (display != NULL || g_headless) {
 		// no alpha channel.  this sidesteps a few edge cases involving alpha blending
 		// and the screen-grab functions.
 		al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+		if (display == NULL)
+			al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
 		al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ANY_24_NO_ALPHA);
 		backbuffer = image_new(resolution.width, resolution.height, NULL);
 		al_restore_state(&old_state);
@@ -118,7 +183,7 @@ screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip,
 		goto on_error;
 	}
 
-	if (icon != NULL) {
+	if (icon != NULL && display != NULL) {
 		bitmap_flags = al_get_new_bitmap_flags() | ALLEGRO_NO_PRESERVE_TEXTURE;
 		al_set_new_bitmap_flags(
 			ALLEGRO_NO_PREMULTIPLIED_ALPHA | ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR
@@ -136,6 +201,20 @@ screen_new(const char* title, image_t* icon, size2_t resolution, int frameskip,
 	screen->x_size = resolution.width;
 	screen->y_size = resolution.height;
 	screen->max_skips = frameskip;
+	if (!(screen->capture_worker = worker_new("screen capture", 1)))
+		goto on_error;
+
+	// note: the driver is free to ignore the vsync setting, so check whether we
+	//       actually got it before relying on al_flip_display() to block.
+	if (vsync && al_get_display_option(display, ALLEGRO_VSYNC) == 1) {
+		refresh_rate = al_get_display_refresh_rate(display);
+		screen->vsync = true;
+		screen->vblank_interval = 1.0 / (refresh_rate > 0 ? refresh_rate : 60);
+		console_log(1, "    vsync-aligned frame pacing at %.2f Hz", 1.0 / screen->vblank_interval);
+	}
+	else if (vsync) {
+		console_warn(1, "vsync unavailable, falling back on timed frame pacing");
+	}
 
 	screen->fps_poll_time = al_get_time() + 1.0;
 	screen->next_frame_time = al_get_time();
@@ -163,8 +242,11 @@ screen_free(screen_t* it)
 		return;
 
 	console_log(1, "shutting down render context");
+	screen_stop_capture(it);
+	worker_free(it->capture_worker);
 	image_unref(it->backbuffer);
-	al_destroy_display(it->display);
+	if (it->display != NULL)
+		al_destroy_display(it->display);
 	free(it);
 }
 
@@ -198,6 +280,15 @@ screen_skipping_frame(const screen_t* it)
 	return it->skipping_frame;
 }
 
+void
+screen_get_frame_stats(const screen_t* it, double *out_mean, double *out_stddev, double *out_max)
+{
+	// note: these cover the most recent one-second FPS polling window.
+	*out_mean = it->frame_mean;
+	*out_stddev = it->frame_stddev;
+	*out_max = it->frame_max;
+}
+
 int
 screen_get_frameskip(const screen_t* it)
 {
@@ -215,11 +306,21 @@ screen_get_mouse_xy(const screen_t* it, int* o_x, int* o_y)
 {
 	ALLEGRO_MOUSE_STATE mouse_state;
 
+	if (it->display == NULL) {
+		*o_x = *o_y = 0;
+		return;
+	}
 	al_get_mouse_state(&mouse_state);
 	*o_x = (mouse_state.x - it->x_offset) / it->x_scale;
 	*o_y = (mouse_state.y - it->y_offset) / it->y_scale;
 }
 
+bool
+screen_get_vsync(const screen_t* it)
+{
+	return it->vsync;
+}
+
 void
 screen_set_frameskip(screen_t* it, int max_skips)
 {
@@ -244,6 +345,8 @@ screen_set_fullscreen(screen_t* it, bool fullscreen)
 void
 screen_set_mouse_xy(screen_t* it, int x, int y)
 {
+	if (it->display == NULL)
+		return;
 	x = x * it->x_scale + it->x_offset;
 	y = y * it->y_scale + it->y_offset;
 	al_set_mouse_xy(it->display, x, y);
@@ -259,7 +362,7 @@ screen_draw_status(screen_t* it, const char* text, color_t color)
 	int               width;
 	int               height;
 
-	if (it->font == NULL)
+	if (it->font == NULL || it->display == NULL)
 		return;
 
 	screen_cx = al_get_display_width(it->display);
@@ -293,23 +396,13 @@ screen_fix_mouse_xy(const screen_t* it, int *inout_x, int *inout_y)
 void
 screen_flip(screen_t* it, int framerate, bool need_clear)
 {
+	struct capture*   capture;
 	time_t            datetime;
-	char*             filename;
-	char              fps_text[20];
+	double            frame_time;
 	const char*       game_filename;
 	const path_t*     game_root;
 	bool              is_backbuffer_valid;
-	ALLEGRO_STATE     old_state;
-	ALLEGRO_BITMAP*   old_target;
-	path_t*           path;
-	const char*       pathname;
-	int               screen_cx;
-	int               screen_cy;
-	int               serial = 1;
-	ALLEGRO_BITMAP*   snapshot;
 	char              timestamp[100];
-	int               width;
-	int               x, y;
 #if defined(NEOSPHERE_SPHERUN)
 	double            start_time;
 #endif
@@ -318,18 +411,30 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 	start_time = al_get_time();
 #endif
 
+	// get any batched Galileo draws onto the backbuffer before we present it
+	galileo_end_frame();
+
+	// pick up any screenshots which finished saving since the last frame
+	worker_update(it->capture_worker);
+
 	// update FPS with 1s granularity
 	if (al_get_time() >= it->fps_poll_time) {
 		it->fps_flips = it->num_flips;
 		it->fps_frames = it->num_frames;
 		it->num_frames = it->num_flips = 0;
 		it->fps_poll_time = al_get_time() + 1.0;
+		if (it->frame_samples > 0) {
+			it->frame_mean = it->frame_sum / it->frame_samples;
+			it->frame_stddev = sqrt(fmax(it->frame_sum_sq / it->frame_samples
+				- it->frame_mean * it->frame_mean, 0.0));
+			it->frame_max = it->frame_peak;
+		}
+		it->frame_peak = it->frame_sum = it->frame_sum_sq = 0.0;
+		it->frame_samples = 0;
 	}
 
 	// flip the backbuffer, unless the preceeding frame was skipped
 	is_backbuffer_valid = !it->skipping_frame;
-	screen_cx = al_get_display_width(it->display);
-	screen_cy = al_get_display_height(it->display);
 	if (it->notify_timer > 0.0) {
 		it->notify_timer = fmax(it->notify_timer - 1.0 / framerate, 0.0);
 		it->notify_alpha = fmin(it->notify_alpha + 2.0 / framerate, 1.0);
@@ -339,66 +444,52 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 	}
 	if (is_backbuffer_valid) {
 		if (it->take_screenshot) {
-			al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
-			al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ANY_24_NO_ALPHA);
-			snapshot = al_clone_bitmap(image_bitmap(it->backbuffer));
-			al_restore_state(&old_state);
+			// note: only the readback happens here; the PNG is encoded and saved
+			//       on the capture worker.
 			game_root = game_path(g_game);
 			game_filename = path_is_file(game_root)
 				? path_filename(game_root)
 				: path_hop(game_root, path_num_hops(game_root) - 1);
-			path = path_rebase(path_new("Sphere Saves/"), home_path());
-			path_mkdir(path);
 			time(&datetime);
 			strftime(timestamp, 100, "%Y%m%d", localtime(&datetime));
-			do {
-				filename = strnewf("%s-%s-%d.png", game_filename, timestamp, serial++);
-				path_strip(path);
-				sprintf(it->message, "screenshot saved in '%s'", path_cstr(path));
-				path_append(path, filename);
-				pathname = path_cstr(path);
-				free(filename);
-			} while (al_filename_exists(pathname));
-			al_save_bitmap(pathname, snapshot);
-			al_destroy_bitmap(snapshot);
-			path_free(path);
-			it->notify_timer = 5.0;
+			if ((capture = new_capture(it))) {
+				capture->path = path_rebase(path_new("Sphere Saves/"), home_path());
+				capture->filename = strnewf("%s-%s", game_filename, timestamp);
+				worker_post(it->capture_worker, write_screenshot, finish_screenshot, capture);
+			}
+			else {
+				console_warn(0, "couldn't read back the frame for a screenshot");
+			}
 			it->take_screenshot = false;
 		}
-		old_target = al_get_target_bitmap();
-		al_set_target_backbuffer(it->display);
-		al_clear_to_color(al_map_rgba(0, 0, 0, 255));
-		al_draw_scaled_bitmap(image_bitmap(it->backbuffer), 0, 0, it->x_size, it->y_size,
-			it->x_offset, it->y_offset, it->x_size * it->x_scale, it->y_size * it->y_scale,
-			0x0);
-		if (debugger_attached())
-			screen_draw_status(it, debugger_name(), debugger_color());
-		if (it->notify_alpha > 0.0 && it->font != NULL) {
-			width = font_get_width(it->font, it->message) + 20;
-			x = (screen_cx - width) / 2;
-			y = screen_cy - it->y_offset - 32;
-			al_draw_filled_rounded_rectangle(x, y, x + width, y + 24, 4, 4, al_map_rgba(16, 16, 16, 192 * it->notify_alpha));
-			font_set_mask(it->font, mk_color(0, 0, 0, 255 * it->notify_alpha));
-			font_draw_text(it->font, x + 11, y + 7, TEXT_ALIGN_LEFT, it->message);
-			font_set_mask(it->font, mk_color(192, 192, 192, 255 * it->notify_alpha));
-			font_draw_text(it->font, x + 10, y + 6, TEXT_ALIGN_LEFT, it->message);
-		}
-		if (it->show_fps && it->font != NULL) {
-			if (framerate > 0)
-				sprintf(fps_text, "%d/%d fps", it->fps_flips, it->fps_frames);
-			else
-				sprintf(fps_text, "%d fps", it->fps_flips);
-			x = screen_cx - it->x_offset - 108;
-			y = screen_cy - it->y_offset - 24;
-			al_draw_filled_rounded_rectangle(x, y, x + 100, y + 16, 4, 4, al_map_rgba(16, 16, 16, 192));
-			font_set_mask(it->font, mk_color(0, 0, 0, 255));
-			font_draw_text(it->font, x + 51, y + 3, TEXT_ALIGN_CENTER, fps_text);
-			font_set_mask(it->font, mk_color(255, 255, 255, 255));
-			font_draw_text(it->font, x + 50, y + 2, TEXT_ALIGN_CENTER, fps_text);
+		if (it->capture_path != NULL) {
+			if (worker_pending(it->capture_worker) >= MAX_QUEUED_CAPTURES) {
+				++it->num_dropped;
+			}
+			else if (!(capture = new_capture(it))) {
+				console_warn(0, "couldn't read back frame %d for capture", it->capture_frame);
+			}
+			else {
+				capture->raw = it->capture_raw;
+				capture->path = path_dup(it->capture_path);
+				capture->filename = strnewf("%06d.%s", it->capture_frame,
+					it->capture_raw ? "ppm" : "png");
+				worker_post(it->capture_worker, write_capture, free_capture, capture);
+			}
 		}
-		al_set_target_bitmap(old_target);
-		al_flip_display();
-		it->last_flip_time = al_get_time();
+		if (it->display != NULL)
+			present_frame(it, framerate);
+		frame_time = al_get_time() - it->last_flip_time;
+		it->last_flip_time += frame_time;
+		it->frame_peak = fmax(it->frame_peak, frame_time);
+		it->frame_sum += frame_time;
+		it->frame_sum_sq += frame_time * frame_time;
+		++it->frame_samples;
+
+		// with vsync, the flip lands on a vblank which may not line up exactly
+		// with our own schedule.  lock onto the display's timing to avoid drift.
+		if (it->vsync && fabs(it->last_flip_time - it->next_frame_time) < it->vblank_interval / 2)
+			it->next_frame_time = it->last_flip_time;
 		it->num_skips = 0;
 		++it->num_flips;
 	}
@@ -412,7 +503,11 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 	// that we lag instead of never rendering anything at all.
 	if (framerate > 0) {
 		it->skipping_frame = it->last_flip_time > it->next_frame_time && it->num_skips < it->max_skips;
-		sphere_sleep(it->next_frame_time - al_get_time());
+		// with vsync, wake up half a refresh early so the next flip blocks
+		// until the vblank closest to when the frame is due.
+		wait_until(it, it->vsync
+			? it->next_frame_time - it->vblank_interval / 2
+			: it->next_frame_time);
 		if (it->num_skips >= it->max_skips)  // did we skip too many frames?
 			it->next_frame_time = al_get_time() + 1.0 / framerate;
 		else
@@ -423,6 +518,7 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 		it->next_frame_time = al_get_time();
 	}
 	++it->num_frames;
+	++it->capture_frame;
 	if (!it->skipping_frame && need_clear) {
 		// disable clipping so we can clear the whole backbuffer.
 		image_clip_to(it->backbuffer, mk_rect(0, 0, it->x_size, it->y_size), CLIP_OVERRIDE);
@@ -471,12 +567,50 @@ screen_resize(screen_t* it, int x_size, int y_size)
 void
 screen_show_mouse(screen_t* it, bool visible)
 {
+	if (it->display == NULL)
+		return;
 	if (visible)
 		al_show_mouse_cursor(it->display);
 	else
 		al_hide_mouse_cursor(it->display);
 }
 
+bool
+screen_start_capture(screen_t* it, const char* dirname, bool raw)
+{
+	path_t* path;
+
+	screen_stop_capture(it);
+	path = path_new_dir(dirname);
+	if (!path_mkdir(path)) {
+		console_error("couldn't create capture directory '%s'", path_cstr(path));
+		path_free(path);
+		return false;
+	}
+	console_log(1, "capturing frames to '%s' as %s", path_cstr(path), raw ? "PPM" : "PNG");
+	it->capture_path = path;
+	it->capture_raw = raw;
+	it->capture_frame = 0;
+	it->num_dropped = 0;
+	return true;
+}
+
+void
+screen_stop_capture(screen_t* it)
+{
+	if (it->capture_path == NULL)
+		return;
+
+	worker_wait(it->capture_worker);
+	console_log(1, "stopped capturing frames to '%s'", path_cstr(it->capture_path));
+	if (it->num_dropped > 0) {
+		console_warn(0, "%d frame(s) were dropped while capturing, the disk couldn't keep up",
+			it->num_dropped);
+	}
+	path_free(it->capture_path);
+	it->capture_path = NULL;
+}
+
 void
 screen_toggle_fps(screen_t* it)
 {
@@ -496,6 +630,117 @@ screen_unskip_frame(screen_t* it)
 	al_clear_to_color(al_map_rgba(0, 0, 0, 255));
 }
 
+static void
+finish_screenshot(void* udata)
+{
+	struct capture* capture;
+	screen_t*       screen;
+
+	capture = udata;
+	screen = capture->screen;
+	if (capture->succeeded) {
+		path_strip(capture->path);
+		sprintf(screen->message, "screenshot saved in '%s'", path_cstr(capture->path));
+		screen->notify_timer = 5.0;
+	}
+	else {
+		console_warn(0, "couldn't save screenshot '%s'", path_cstr(capture->path));
+	}
+	free_capture(capture);
+}
+
+static void
+free_capture(void* udata)
+{
+	struct capture* capture;
+
+	capture = udata;
+	if (capture->bitmap != NULL)
+		al_destroy_bitmap(capture->bitmap);
+	path_free(capture->path);
+	free(capture->filename);
+	free(capture);
+}
+
+static struct capture*
+new_capture(screen_t* screen)
+{
+	struct capture* capture;
+
+	if (!(capture = calloc(1, sizeof(struct capture))))
+		return NULL;
+	if (!(capture->bitmap = read_backbuffer(screen))) {
+		free(capture);
+		return NULL;
+	}
+	capture->screen = screen;
+	return capture;
+}
+
+static void
+present_frame(screen_t* screen, int framerate)
+{
+	char            fps_text[20];
+	ALLEGRO_BITMAP* old_target;
+	int             screen_cx;
+	int             screen_cy;
+	int             width;
+	int             x, y;
+
+	screen_cx = al_get_display_width(screen->display);
+	screen_cy = al_get_display_height(screen->display);
+	old_target = al_get_target_bitmap();
+	al_set_target_backbuffer(screen->display);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 255));
+	al_draw_scaled_bitmap(image_bitmap(screen->backbuffer), 0, 0, screen->x_size, screen->y_size,
+		screen->x_offset, screen->y_offset, screen->x_size * screen->x_scale, screen->y_size * screen->y_scale,
+		0x0);
+	if (debugger_attached())
+		screen_draw_status(screen, debugger_name(), debugger_color());
+	if (screen->notify_alpha > 0.0 && screen->font != NULL) {
+		width = font_get_width(screen->font, screen->message) + 20;
+		x = (screen_cx - width) / 2;
+		y = screen_cy - screen->y_offset - 32;
+		al_draw_filled_rounded_rectangle(x, y, x + width, y + 24, 4, 4, al_map_rgba(16, 16, 16, 192 * screen->notify_alpha));
+		font_set_mask(screen->font, mk_color(0, 0, 0, 255 * screen->notify_alpha));
+		font_draw_text(screen->font, x + 11, y + 7, TEXT_ALIGN_LEFT, screen->message);
+		font_set_mask(screen->font, mk_color(192, 192, 192, 255 * screen->notify_alpha));
+		font_draw_text(screen->font, x + 10, y + 6, TEXT_ALIGN_LEFT, screen->message);
+	}
+	if (screen->show_fps && screen->font != NULL) {
+		if (framerate > 0)
+			sprintf(fps_text, "%d/%d fps", screen->fps_flips, screen->fps_frames);
+		else
+			sprintf(fps_text, "%d fps", screen->fps_flips);
+		x = screen_cx - screen->x_offset - 108;
+		y = screen_cy - screen->y_offset - 24;
+		al_draw_filled_rounded_rectangle(x, y, x + 100, y + 16, 4, 4, al_map_rgba(16, 16, 16, 192));
+		font_set_mask(screen->font, mk_color(0, 0, 0, 255));
+		font_draw_text(screen->font, x + 51, y + 3, TEXT_ALIGN_CENTER, fps_text);
+		font_set_mask(screen->font, mk_color(255, 255, 255, 255));
+		font_draw_text(screen->font, x + 50, y + 2, TEXT_ALIGN_CENTER, fps_text);
+	}
+	al_set_target_bitmap(old_target);
+	al_flip_display();
+}
+
+static ALLEGRO_BITMAP*
+read_backbuffer(screen_t* screen)
+{
+	// note: cloning to a memory bitmap does the GPU readback up front, so the
+	//       capture worker never has to touch the display.  the clone has no
+	//       alpha channel so screenshots are opaque, like the screen itself.
+	ALLEGRO_BITMAP* bitmap;
+	ALLEGRO_STATE   old_state;
+
+	al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_BGR_888);
+	bitmap = al_clone_bitmap(image_bitmap(screen->backbuffer));
+	al_restore_state(&old_state);
+	return bitmap;
+}
+
 static void
 refresh_display(screen_t* screen)
 {
@@ -503,6 +748,14 @@ refresh_display(screen_t* screen)
 	int                  real_width;
 	int                  real_height;
 
+	if (screen->display == NULL) {
+		screen->fullscreen = false;
+		screen->x_scale = screen->y_scale = 1.0;
+		screen->x_offset = screen->y_offset = 0;
+		image_render_to(screen->backbuffer, NULL);
+		return;
+	}
+
 	al_set_display_flag(screen->display, ALLEGRO_FULLSCREEN_WINDOW, screen->fullscreen);
 	if (screen->fullscreen) {
 		real_width = al_get_display_width(screen->display);
@@ -540,3 +793,116 @@ refresh_display(screen_t* screen)
 
 	image_render_to(screen->backbuffer, NULL);
 }
+
+static bool
+save_ppm(const char* filename, ALLEGRO_BITMAP* bitmap)
+{
+	// note: BGR_888 is stored in memory as R, G, B, which is exactly the layout
+	//       of a binary PPM, so rows can be written out as-is.
+	FILE*                  file = NULL;
+	int                    height;
+	ALLEGRO_LOCKED_REGION* lock = NULL;
+	const uint8_t*         src;
+	int                    width;
+
+	int y;
+
+	width = al_get_bitmap_width(bitmap);
+	height = al_get_bitmap_height(bitmap);
+	if (!(lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_BGR_888, ALLEGRO_LOCK_READONLY)))
+		goto on_error;
+	if (!(file = fopen(filename, "wb")))
+		goto on_error;
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	for (y = 0; y < height; ++y) {
+		src = (const uint8_t*)lock->data + y * lock->pitch;
+		if (fwrite(src, 3, width, file) != width)
+			goto on_error;
+	}
+	fclose(file);
+	al_unlock_bitmap(bitmap);
+	return true;
+
+on_error:
+	if (file != NULL)
+		fclose(file);
+	if (lock != NULL)
+		al_unlock_bitmap(bitmap);
+	return false;
+}
+
+static void
+wait_until(screen_t* screen, double deadline)
+{
+	// sleeping is only accurate to a millisecond or two depending on the OS
+	// scheduler, which is enough to cause visible stutter at high refresh rates.
+	// to compensate, sleep until we're within the measured overshoot of the
+	// deadline and spin for whatever's left.
+	double margin;
+	double overshoot;
+	double sleep_time;
+	double start_time;
+
+	margin = screen->sleep_overshoot + MIN_SPIN_TIME;
+	start_time = al_get_time();
+	sleep_time = deadline - start_time - margin;
+	if (sleep_time > 0.0) {
+		sphere_sleep(sleep_time);
+
+		// keep track of the worst recent overshoot, decaying it over time so
+		// one bad sleep doesn't make us spin indefinitely.
+		overshoot = al_get_time() - start_time - sleep_time;
+		screen->sleep_overshoot = fmin(fmax(overshoot, screen->sleep_overshoot * 0.95), MAX_OVERSHOOT);
+	}
+	while (al_get_time() < deadline)
+		yield_cpu();
+	sphere_heartbeat(false, 0);
+}
+
+static void
+write_capture(void* udata)
+{
+	struct capture* capture;
+	const char*     pathname;
+
+	capture = udata;
+	if (capture->bitmap == NULL)
+		return;
+	path_append(capture->path, capture->filename);
+	pathname = path_cstr(capture->path);
+	capture->succeeded = capture->raw
+		? save_ppm(pathname, capture->bitmap)
+		: al_save_bitmap(pathname, capture->bitmap);
+}
+
+static void
+write_screenshot(void* udata)
+{
+	struct capture* capture;
+	char*           filename;
+	const char*     pathname;
+	int             serial = 1;
+
+	capture = udata;
+	if (capture->bitmap == NULL)
+		return;
+	path_mkdir(capture->path);
+	do {
+		filename = strnewf("%s-%d.png", capture->filename, serial++);
+		path_strip(capture->path);
+		path_append(capture->path, filename);
+		pathname = path_cstr(capture->path);
+		free(filename);
+	} while (al_filename_exists(pathname));
+	capture->succeeded = al_save_bitmap(pathname, capture->bitmap);
+}
+
+static void
+yield_cpu(void)
+{
+#if defined(_WIN32)
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
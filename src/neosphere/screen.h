@@ -39,16 +39,18 @@
 
 typedef struct screen screen_t;
 
-screen_t*        screen_new               (const char* title, image_t* icon, size2_t resolution, int frameskip, font_t* font);
+screen_t*        screen_new               (const char* title, image_t* icon, size2_t resolution, int frameskip, bool vsync, font_t* font);
 void             screen_free              (screen_t* it);
 image_t*         screen_backbuffer        (const screen_t* it);
 rect_t           screen_bounds            (const screen_t* it);
 ALLEGRO_DISPLAY* screen_display           (const screen_t* it);
 size2_t          screen_size              (const screen_t* it);
 bool             screen_skipping_frame    (const screen_t* it);
+void             screen_get_frame_stats   (const screen_t* it, double *out_mean, double *out_stddev, double *out_max);
 int              screen_get_frameskip     (const screen_t* it);
 bool             screen_get_fullscreen    (const screen_t* it);
 void             screen_get_mouse_xy      (const screen_t* it, int* o_x, int* o_y);
+bool             screen_get_vsync         (const screen_t* it);
 void             screen_set_frameskip     (screen_t* it, int max_skips);
 void             screen_set_fullscreen    (screen_t* it, bool fullscreen);
 void             screen_set_mouse_xy      (screen_t* it, int x, int y);
@@ -59,6 +61,8 @@ image_t*         screen_grab              (screen_t* it, int x, int y, int width
 void             screen_queue_screenshot  (screen_t* it);
 void             screen_resize            (screen_t* it, int x_size, int y_size);
 void             screen_show_mouse        (screen_t* it, bool visible);
+bool             screen_start_capture     (screen_t* it, const char* dirname, bool raw);
+void             screen_stop_capture      (screen_t* it);
 void             screen_toggle_fps        (screen_t* it);
 void             screen_toggle_fullscreen (screen_t* it);
 void             screen_unskip_frame      (screen_t* it);
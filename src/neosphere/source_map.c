@@ -41,11 +41,22 @@ struct alias
 	char* url;
 };
 
+struct line
+{
+	int       offset;
+	vector_t* segments;
+	int       start_values[4];
+};
+
 struct map
 {
 	wraptext_t* filenames;
+	uint32_t    hash;
 	wraptext_t* identifiers;
-	vector_t*   segments;
+	vector_t*   lines;
+	char*       mappings;
+	int         num_scanned;
+	vector_t*   reverse;
 	char*       url;
 };
 
@@ -64,8 +75,14 @@ struct source
 	char* text;
 };
 
-static int compare_segments (const void* a, const void* b);
-static int vlq_decode_next  (const char* start, int* out_array, int max_values);
+static int         compare_segments     (const void* a, const void* b);
+static int         compare_src_segments (const void* a, const void* b);
+static void        decode_line          (struct map* map, int line_index, vector_t* segments);
+static struct map* find_map             (const char* url);
+static vector_t*   get_line_segments    (struct map* map, int line_index);
+static uint32_t    hash_url             (const char* url);
+static int         search_segments      (vector_t* segments, const struct segment* key, int (*comparer)(const void* a, const void* b));
+static int         vlq_decode_next      (const char* start, int* out_array, int max_values);
 
 static vector_t* s_aliases;
 static bool      s_enabled;
@@ -85,10 +102,12 @@ void
 source_map_uninit(void)
 {
 	struct alias*  alias;
+	struct line*   line;
 	struct map*    map;
 	struct source* source;
 
 	iter_t iter;
+	iter_t iter2;
 
 	if (!s_enabled)
 		return;
@@ -104,7 +123,12 @@ source_map_uninit(void)
 	while ((map = iter_next(&iter))) {
 		wraptext_free(map->filenames);
 		wraptext_free(map->identifiers);
-		vector_free(map->segments);
+		iter2 = vector_enum(map->lines);
+		while ((line = iter_next(&iter2)))
+			vector_free(line->segments);
+		vector_free(map->lines);
+		vector_free(map->reverse);
+		free(map->mappings);
 		free(map->url);
 	}
 	vector_free(s_maps);
@@ -201,23 +225,14 @@ source_map_add_map(const char* url, js_ref_t* content)
 	//       best if all source text is provided first (using `source_map_add_source`).
 
 	const char*    filename;
-	int            line = 0;
+	struct line    line;
 	struct map     map;
-	int            num_values;
 	path_t*        path;
-	struct segment segment;
 	int            stack_top;
-	int            values[5];
 	const char*    p_in;
-	struct map*    p_map;
 
-	iter_t iter;
-
-	iter = vector_enum(s_maps);
-	while ((p_map = iter_next(&iter))) {
-		if (strcmp(url, p_map->url) == 0)
-			return true;
-	}
+	if (find_map(url) != NULL)
+		return true;
 
 	stack_top = jsal_get_top();
 
@@ -225,6 +240,7 @@ source_map_add_map(const char* url, js_ref_t* content)
 
 	memset(&map, 0, sizeof(struct map));
 	map.url = strdup(url);
+	map.hash = hash_url(url);
 
 	map.filenames = wraptext_new(256);
 	jsal_get_prop_string(-1, "sources");
@@ -260,36 +276,36 @@ source_map_add_map(const char* url, js_ref_t* content)
 		jsal_pop(1);
 	}
 
-	map.segments = vector_new(sizeof(struct segment));
+	// note: the mappings are decoded lazily, one line at a time, the first time a lookup
+	//       touches them.  most maps are never queried at all, so here we only make a copy
+	//       of the mappings string and note where each generated line begins.
 	jsal_get_prop_string(-2, "mappings");
-	p_in = jsal_get_string(-1);
-	if (p_in == NULL)
+	if (!(p_in = jsal_get_string(-1)))
+		goto on_error;
+	if (!(map.mappings = strdup(p_in)))
 		goto on_error;
-	memset(values, 0, sizeof values);
+	if (!(map.lines = vector_new(sizeof(struct line))))
+		goto on_error;
+	memset(&line, 0, sizeof(struct line));
+	p_in = map.mappings;
 	while (p_in != NULL) {
-		num_values = vlq_decode_next(p_in, values, 5);
-		if (num_values == 1 || num_values == 4 || num_values == 5) {
-			segment.line = line;
-			segment.column = values[0];
-			segment.file_index = values[1];
-			segment.src_line = values[2];
-			segment.src_column = values[3];
-			if (!vector_push(map.segments, &segment))
-				goto on_error;
-		}
-		p_in = strpbrk(p_in, ",;");
-		if (p_in != NULL && *p_in++ == ';') {
-			++line;
-			values[0] = 0;
-		}
+		line.offset = (int)(p_in - map.mappings);
+		if (!vector_push(map.lines, &line))
+			goto on_error;
+		if ((p_in = strchr(p_in, ';')))
+			++p_in;
 	}
-	vector_sort(map.segments, compare_segments);
 
-	vector_push(s_maps, &map);
+	if (!vector_push(s_maps, &map))
+		goto on_error;
 	jsal_set_top(stack_top);
 	return true;
 
 on_error:
+	wraptext_free(map.filenames);
+	vector_free(map.lines);
+	free(map.mappings);
+	free(map.url);
 	jsal_set_top(stack_top);
 	return false;
 }
@@ -324,38 +340,35 @@ on_error:
 mapping_t
 source_map_lookup(const char* url, int line, int column)
 {
-	int             file_index = -1;
+	int             index;
+	struct segment  key;
+	int             line_index;
 	struct map*     map;
-	int             mapped_column = column;
-	int             mapped_line = line;
 	mapping_t       retval;
-	struct segment* segment;
-
-	iter_t iter;
-
-	iter = vector_enum(s_maps);
-	while ((map = iter_next(&iter))) {
-		if (strcmp(map->url, url) == 0)
-			break;
-	}
+	struct segment* segment = NULL;
+	vector_t*       segments;
 
 	retval.filename = url;
 	retval.line = line;
 	retval.column = column;
-	if (map != NULL) {
-		iter = vector_enum(map->segments);
-		while ((segment = iter_next(&iter))) {
-			if (segment->line > line || (segment->line == line && segment->column > column))
+	if ((map = find_map(url)) != NULL) {
+		// find the last segment at or before the given position, searching backwards
+		// through previous lines if there isn't one on the same line.
+		key.line = line;
+		key.column = column;
+		line_index = line < vector_len(map->lines) ? line : vector_len(map->lines) - 1;
+		for (; line_index >= 0 && segment == NULL; --line_index) {
+			if (!(segments = get_line_segments(map, line_index)))
 				break;
-			file_index = segment->file_index;
-			mapped_line = segment->src_line;
-			mapped_column = segment->src_column;
+			if ((index = search_segments(segments, &key, compare_segments)) >= 0)
+				segment = vector_get(segments, index);
+		}
+		retval.filename = NULL;
+		if (segment != NULL) {
+			retval.filename = wraptext_line(map->filenames, segment->file_index);
+			retval.line = segment->src_line;
+			retval.column = segment->src_column;
 		}
-		retval.filename = file_index >= 0
-			? wraptext_line(map->filenames, file_index)
-			: NULL;
-		retval.line = mapped_line;
-		retval.column = mapped_column;
 	}
 	return retval;
 }
@@ -364,10 +377,9 @@ mapping_t
 source_map_reverse(const char* filename, int line, int column)
 {
 	int             file_index = -1;
-	bool            found_file = false;
+	int             index;
+	struct segment  key;
 	struct map*     map;
-	int             mapped_column = column;
-	int             mapped_line = line;
 	mapping_t       retval;
 	struct segment* segment;
 
@@ -378,9 +390,9 @@ source_map_reverse(const char* filename, int line, int column)
 	while ((map = iter_next(&iter))) {
 		for (i = 0; i < wraptext_len(map->filenames); ++i) {
 			if (strcmp(wraptext_line(map->filenames, i), filename) == 0)
-				found_file = true;
+				file_index = i;
 		}
-		if (found_file)
+		if (file_index >= 0)
 			break;
 	}
 
@@ -388,17 +400,25 @@ source_map_reverse(const char* filename, int line, int column)
 	retval.line = line;
 	retval.column = column;
 	if (map != NULL) {
-		iter = vector_enum(map->segments);
-		while ((segment = iter_next(&iter))) {
-			if (segment->src_line > line || (segment->src_line == line && segment->src_column > column))
-				break;
-			file_index = segment->file_index;
-			mapped_line = segment->line;
-			mapped_column = segment->column;
+		// note: the reverse index is only built the first time it's needed, since most maps
+		//       are never used for anything but stack traces.
+		if (map->reverse == NULL) {
+			if (!(map->reverse = vector_new(sizeof(struct segment))))
+				return retval;
+			for (i = 0; i < vector_len(map->lines); ++i)
+				decode_line(map, i, map->reverse);
+			vector_sort(map->reverse, compare_src_segments);
 		}
+		key.file_index = file_index;
+		key.src_line = line;
+		key.src_column = column;
 		retval.filename = map->url;
-		retval.line = mapped_line;
-		retval.column = mapped_column;
+		index = search_segments(map->reverse, &key, compare_src_segments);
+		segment = index >= 0 ? vector_get(map->reverse, index) : NULL;
+		if (segment != NULL && segment->file_index == file_index) {
+			retval.line = segment->line;
+			retval.column = segment->column;
+		}
 	}
 	return retval;
 }
@@ -409,12 +429,135 @@ compare_segments(const void* in_a, const void* in_b)
 	const struct segment* seg_a = in_a;
 	const struct segment* seg_b = in_b;
 
-	return seg_a->file_index < seg_b->file_index ? -1 : seg_a->file_index > seg_b->file_index ? +1
-		: seg_a->line < seg_b->line ? -1 : seg_a->line > seg_b->line ? +1
+	return seg_a->line < seg_b->line ? -1 : seg_a->line > seg_b->line ? +1
 		: seg_a->column < seg_b->column ? -1 : seg_a->column > seg_b->column ? +1
 		: 0;
 }
 
+static int
+compare_src_segments(const void* in_a, const void* in_b)
+{
+	const struct segment* seg_a = in_a;
+	const struct segment* seg_b = in_b;
+
+	return seg_a->file_index < seg_b->file_index ? -1 : seg_a->file_index > seg_b->file_index ? +1
+		: seg_a->src_line < seg_b->src_line ? -1 : seg_a->src_line > seg_b->src_line ? +1
+		: seg_a->src_column < seg_b->src_column ? -1 : seg_a->src_column > seg_b->src_column ? +1
+		: 0;
+}
+
+static void
+decode_line(struct map* map, int line_index, vector_t* segments)
+{
+	// note: apart from the generated column, the values in a segment are relative to the
+	//       previous segment, even across lines.  so a line can only be decoded once all the
+	//       lines before it have been scanned.
+
+	struct line*   line;
+	struct line*   next_line;
+	int            num_values;
+	struct segment segment;
+	int            values[5];
+	const char*    p_in;
+
+	line = vector_get(map->lines, line_index);
+	values[0] = 0;
+	memcpy(&values[1], line->start_values, sizeof line->start_values);
+	p_in = map->mappings + line->offset;
+	while (*p_in != ';' && *p_in != '\0') {
+		num_values = vlq_decode_next(p_in, values, 5);
+		if (segments != NULL && (num_values == 1 || num_values == 4 || num_values == 5)) {
+			segment.line = line_index;
+			segment.column = values[0];
+			segment.file_index = values[1];
+			segment.src_line = values[2];
+			segment.src_column = values[3];
+			vector_push(segments, &segment);
+		}
+		p_in += strcspn(p_in, ",;");
+		if (*p_in == ',')
+			++p_in;
+	}
+	if (line_index + 1 < vector_len(map->lines)) {
+		next_line = vector_get(map->lines, line_index + 1);
+		memcpy(next_line->start_values, &values[1], sizeof next_line->start_values);
+	}
+	if (map->num_scanned == line_index)
+		++map->num_scanned;
+}
+
+static struct map*
+find_map(const char* url)
+{
+	uint32_t    hash;
+	struct map* map;
+
+	iter_t iter;
+
+	hash = hash_url(url);
+	iter = vector_enum(s_maps);
+	while ((map = iter_next(&iter))) {
+		if (map->hash == hash && strcmp(map->url, url) == 0)
+			return map;
+	}
+	return NULL;
+}
+
+static vector_t*
+get_line_segments(struct map* map, int line_index)
+{
+	struct line* line;
+	vector_t*    segments;
+
+	if (line_index < 0 || line_index >= vector_len(map->lines))
+		return NULL;
+	line = vector_get(map->lines, line_index);
+	if (line->segments != NULL)
+		return line->segments;
+
+	// catch up on any lines we haven't seen yet, without keeping their segments
+	while (map->num_scanned < line_index)
+		decode_line(map, map->num_scanned, NULL);
+	if (!(segments = vector_new(sizeof(struct segment))))
+		return NULL;
+	decode_line(map, line_index, segments);
+	vector_sort(segments, compare_segments);
+	line->segments = segments;
+	return segments;
+}
+
+static uint32_t
+hash_url(const char* url)
+{
+	uint32_t    hash = 2166136261u;
+	const char* p;
+
+	for (p = url; *p != '\0'; ++p)
+		hash = (hash ^ (uint8_t)*p) * 16777619u;  // FNV-1a
+	return hash;
+}
+
+static int
+search_segments(vector_t* segments, const struct segment* key, int (*comparer)(const void* a, const void* b))
+{
+	// returns the index of the last segment which sorts at or before `key`, or -1 if
+	// there isn't one.  `segments` must already be sorted using `comparer`.
+
+	int hi;
+	int lo = 0;
+	int mid;
+
+	hi = vector_len(segments);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (comparer(vector_get(segments, mid), key) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo - 1;
+}
+
 static int
 vlq_decode_next(const char* start, int* values, int max_values)
 {
@@ -445,11 +588,11 @@ vlq_decode_next(const char* start, int* values, int max_values)
 			value >>= 1;  // shift out the sign bit
 			if (negative)
 				value = value == 0 ? INT32_MIN : -(value);
+			if (count >= max_values)
+				return 0;  // too many values
 			values[count++] += value;
 			value = 0;
 			shift = 0;
-			if (count >= max_values)
-				return 0;  // too many values
 		}
 	}
 	if (shift != 0)
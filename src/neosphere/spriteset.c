@@ -33,6 +33,7 @@
 #include "neosphere.h"
 #include "spriteset.h"
 
+#include "asset_cache.h"
 #include "atlas.h"
 #include "image.h"
 #include "vector.h"
@@ -105,33 +106,19 @@ struct spriteset
 
 static struct pose* find_pose_by_name (const spriteset_t* spriteset, const char* pose_name);
 
-static vector_t*    s_load_cache;
 static unsigned int s_next_spriteset_id = 0;
-static unsigned int s_num_cache_hits = 0;
 
 void
 spritesets_init(void)
 {
 	console_log(1, "initializing spriteset manager");
-	s_load_cache = vector_new(sizeof(spriteset_t*));
 }
 
 void
 spritesets_uninit(void)
 {
-	spriteset_t** spriteset_ptr;
-
-	iter_t        iter;
-
 	console_log(1, "shutting down spriteset manager");
 	console_log(2, "    objects created: %u", s_next_spriteset_id);
-	console_log(2, "    cache hits: %u", s_num_cache_hits);
-	if (s_load_cache != NULL) {
-		iter = vector_enum(s_load_cache);
-		while ((spriteset_ptr = iter_next(&iter)))
-			spriteset_unref(*spriteset_ptr);
-		vector_free(s_load_cache);
-	}
 }
 
 spriteset_t*
@@ -170,6 +157,7 @@ spriteset_load(const char* filename)
 	};
 
 	atlas_t*            atlas = NULL;
+	spriteset_t*        cached;
 	struct rss_dir_v2   dir_v2;
 	struct rss_dir_v3   dir_v3;
 	char                extra_pose_name[32];
@@ -186,27 +174,22 @@ spriteset_load(const char* filename)
 	struct rss_header   rss;
 	long                skip_size;
 	spriteset_t*        spriteset = NULL;
-	spriteset_t**       spriteset_ptr;
+	size_t              total_size = 0;
 	long                v2_data_offset;
 
-	iter_t iter;
 	int i, j;
 
-	// check load cache to see if we loaded this file once already
-	if (s_load_cache != NULL) {
-		iter = vector_enum(s_load_cache);
-		while ((spriteset_ptr = iter_next(&iter))) {
-			if (strcmp(filename, (*spriteset_ptr)->filename) == 0) {
-				console_log(2, "using cached spriteset #%u for '%s'", (*spriteset_ptr)->id, filename);
-				++s_num_cache_hits;
-				return spriteset_clone(*spriteset_ptr);
-			}
-		}
+	// check the asset cache to see if we loaded this file once already.
+	// note: spritesets can be modified after loading, so the caller gets a clone
+	//       rather than the cached spriteset itself.  the images are still shared.
+	if ((cached = asset_cache_get(CACHE_SPRITESET, filename, 0))) {
+		console_log(2, "using cached spriteset #%u for '%s'", cached->id, filename);
+		spriteset = spriteset_clone(cached);
+		spriteset_unref(cached);
+		return spriteset;
 	}
-	else
-		s_load_cache = vector_new(sizeof(spriteset_t*));
 
-	// filename not in load cache, load the spriteset
+	// filename not in cache, load the spriteset
 	console_log(2, "loading spriteset #%u from '%s'", s_next_spriteset_id, filename);
 	spriteset = spriteset_new();
 	if (!(file = file_open(g_game, filename, "rb")))
@@ -322,15 +305,11 @@ spriteset_load(const char* filename)
 	}
 	file_close(file);
 
-	if (s_load_cache != NULL) {
-		while (vector_len(s_load_cache) >= 10) {
-			spriteset_ptr = vector_get(s_load_cache, 0);
-			spriteset_unref(*spriteset_ptr);
-			vector_remove(s_load_cache, 0);
-		}
-		spriteset_ref(spriteset);
-		vector_push(s_load_cache, &spriteset);
+	for (i = 0; i < spriteset_num_images(spriteset); ++i) {
+		image = spriteset_image(spriteset, i);
+		total_size += image_width(image) * image_height(image) * 4;
 	}
+	asset_cache_put(CACHE_SPRITESET, filename, 0, spriteset, total_size);
 	return spriteset;
 
 on_error:
@@ -476,6 +455,12 @@ spriteset_pathname(const spriteset_t* it)
 	return it->filename;
 }
 
+int
+spriteset_refcount(const spriteset_t* it)
+{
+	return it->refcount;
+}
+
 const char*
 spriteset_pose_name(const spriteset_t* it, int index)
 {
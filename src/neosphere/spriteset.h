@@ -52,6 +52,7 @@ int          spriteset_num_frames        (const spriteset_t* it, const char* pos
 int          spriteset_num_images        (const spriteset_t* it);
 int          spriteset_num_poses         (const spriteset_t* it);
 const char*  spriteset_pathname          (const spriteset_t* it);
+int          spriteset_refcount          (const spriteset_t* it);
 const char*  spriteset_pose_name         (const spriteset_t* it, int index);
 int          spriteset_width             (const spriteset_t* it);
 rect_t       spriteset_get_base          (const spriteset_t* it);
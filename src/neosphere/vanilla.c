@@ -4492,8 +4492,12 @@ js_IsMouseButtonPressed(int num_args, bool is_ctor, intptr_t magic)
 	button_id = button == MOUSE_BUTTON_RIGHT ? 2
 		: button == MOUSE_BUTTON_MIDDLE ? 3
 		: 1;
+	if (!(display = screen_display(g_screen))) {
+		// headless, no mouse
+		jsal_push_boolean(false);
+		return true;
+	}
 	al_get_mouse_state(&mouse_state);
-	display = screen_display(g_screen);
 	jsal_push_boolean(mouse_state.display == display && al_mouse_button_down(&mouse_state, button_id));
 	return true;
 }
@@ -4677,14 +4681,23 @@ js_LoadAnimation(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_LoadFont(int num_args, bool is_ctor, intptr_t magic)
 {
+	font_t*     dolly;
 	const char* filename;
 	font_t*     font;
 
 	filename = jsal_require_pathname(0, "fonts", true, false);
 	if (!(font = font_load(filename)))
 		jsal_error(JS_ERROR, "couldn't load font '%s'", filename);
-	jsal_push_sphere_font(font);
+
+	// note: v1 fonts can be modified, so clone the loaded font in case it's
+	//       shared with other loads through the asset cache.  clones share their
+	//       glyph images, so this is cheap.
+	dolly = font_clone(font);
 	font_unref(font);
+	if (dolly == NULL)
+		jsal_error(JS_ERROR, "couldn't load font '%s'", filename);
+	jsal_push_sphere_font(dolly);
+	font_unref(dolly);
 	return true;
 }
 
@@ -4695,7 +4708,7 @@ js_LoadImage(int num_args, bool is_ctor, intptr_t magic)
 	image_t*    image;
 
 	filename = jsal_require_pathname(0, "images", true, false);
-	if (!(image = image_load(filename)))
+	if (!(image = image_load(filename, false)))
 		jsal_error(JS_ERROR, "couldn't load image '%s'", filename);
 	jsal_push_class_obj(SV1_IMAGE, image, false);
 	return true;
@@ -4718,6 +4731,7 @@ js_LoadSound(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_LoadSoundEffect(int num_args, bool is_ctor, intptr_t magic)
 {
+	sample_t*   dolly;
 	const char* filename;
 	int         mode;
 	sample_t*   sample;
@@ -4727,7 +4741,14 @@ js_LoadSoundEffect(int num_args, bool is_ctor, intptr_t magic)
 
 	if (!(sample = sample_new(filename, mode == SE_MULTIPLE)))
 		jsal_error(JS_ERROR, "Couldn't load sound effect '%s'", filename);
-	jsal_push_class_obj(SV1_SOUND_EFFECT, sample, false);
+
+	// note: a SoundEffect's volume, pan and pitch can be changed, so it gets its
+	//       own clone of the (possibly shared) sample.
+	dolly = sample_clone(sample);
+	sample_unref(sample);
+	if (dolly == NULL)
+		jsal_error(JS_ERROR, "Couldn't load sound effect '%s'", filename);
+	jsal_push_class_obj(SV1_SOUND_EFFECT, dolly, false);
 	return true;
 }
 
@@ -4752,7 +4773,7 @@ js_LoadSurface(int num_args, bool is_ctor, intptr_t magic)
 	image_t*    image;
 
 	filename = jsal_require_pathname(0, "images", true, false);
-	if (!(image = image_load(filename)))
+	if (!(image = image_load(filename, true)))
 		jsal_error(JS_ERROR, "couldn't load image '%s'", filename);
 	jsal_push_class_obj(SV1_SURFACE, image, false);
 	return true;
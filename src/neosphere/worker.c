@@ -0,0 +1,216 @@
+/**
+ *  Sphere: the JavaScript game platform
+ *  Copyright (c) 2015-2025, Where'd She Go?
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of Spherical nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+// a worker runs jobs on one or more background threads.  each job has a `work`
+// function, which runs on a worker thread, and an optional `finish` function
+// which is called on the main thread by worker_update() once the work is done.
+// as work functions run concurrently with the engine, they must not touch
+// JavaScript, the display or any other engine state that isn't thread-safe.
+
+#include "neosphere.h"
+#include "worker.h"
+
+struct job
+{
+	worker_func_t finish;
+	void*         udata;
+	worker_func_t work;
+};
+
+struct worker
+{
+	ALLEGRO_COND*    all_done;
+	vector_t*        done_jobs;
+	ALLEGRO_COND*    has_work;
+	ALLEGRO_MUTEX*   mutex;
+	char*            name;
+	int              num_busy;
+	int              num_threads;
+	vector_t*        pending_jobs;
+	bool             stopping;
+	ALLEGRO_THREAD** threads;
+};
+
+static void* worker_thread (ALLEGRO_THREAD* thread, void* udata);
+
+worker_t*
+worker_new(const char* name, int num_threads)
+{
+	worker_t* worker;
+
+	int i;
+
+	console_log(2, "starting worker '%s' with %d thread(s)", name, num_threads);
+
+	if (!(worker = calloc(1, sizeof(worker_t))))
+		goto on_error;
+	if (!(worker->threads = calloc(num_threads, sizeof(ALLEGRO_THREAD*))))
+		goto on_error;
+	worker->name = strdup(name);
+	worker->mutex = al_create_mutex();
+	worker->has_work = al_create_cond();
+	worker->all_done = al_create_cond();
+	worker->pending_jobs = vector_new(sizeof(struct job));
+	worker->done_jobs = vector_new(sizeof(struct job));
+	if (worker->mutex == NULL || worker->has_work == NULL || worker->all_done == NULL)
+		goto on_error;
+	for (i = 0; i < num_threads; ++i) {
+		if (!(worker->threads[i] = al_create_thread(worker_thread, worker)))
+			goto on_error;
+		++worker->num_threads;
+		al_start_thread(worker->threads[i]);
+	}
+	return worker;
+
+on_error:
+	console_error("couldn't start worker '%s'", name);
+	worker_free(worker);
+	return NULL;
+}
+
+void
+worker_free(worker_t* it)
+{
+	int i;
+
+	if (it == NULL)
+		return;
+
+	console_log(2, "shutting down worker '%s'", it->name);
+
+	// note: any jobs still queued are run to completion first; callers rely on
+	//       this to make sure everything they posted gets cleaned up.
+	if (it->mutex != NULL) {
+		al_lock_mutex(it->mutex);
+		it->stopping = true;
+		al_broadcast_cond(it->has_work);
+		al_unlock_mutex(it->mutex);
+	}
+	for (i = 0; i < it->num_threads; ++i)
+		al_destroy_thread(it->threads[i]);
+	if (it->done_jobs != NULL)
+		worker_update(it);
+	vector_free(it->done_jobs);
+	vector_free(it->pending_jobs);
+	if (it->all_done != NULL)
+		al_destroy_cond(it->all_done);
+	if (it->has_work != NULL)
+		al_destroy_cond(it->has_work);
+	if (it->mutex != NULL)
+		al_destroy_mutex(it->mutex);
+	free(it->threads);
+	free(it->name);
+	free(it);
+}
+
+int
+worker_pending(worker_t* it)
+{
+	int num_jobs;
+
+	al_lock_mutex(it->mutex);
+	num_jobs = vector_len(it->pending_jobs) + it->num_busy;
+	al_unlock_mutex(it->mutex);
+	return num_jobs;
+}
+
+void
+worker_post(worker_t* it, worker_func_t work, worker_func_t finish, void* udata)
+{
+	struct job job;
+
+	job.work = work;
+	job.finish = finish;
+	job.udata = udata;
+	al_lock_mutex(it->mutex);
+	vector_push(it->pending_jobs, &job);
+	al_signal_cond(it->has_work);
+	al_unlock_mutex(it->mutex);
+}
+
+void
+worker_update(worker_t* it)
+{
+	struct job job;
+
+	// note: the lock is released while each finish function runs since it may
+	//       well want to post more work.
+	al_lock_mutex(it->mutex);
+	while (vector_len(it->done_jobs) > 0) {
+		job = *(struct job*)vector_get(it->done_jobs, 0);
+		vector_remove(it->done_jobs, 0);
+		al_unlock_mutex(it->mutex);
+		if (job.finish != NULL)
+			job.finish(job.udata);
+		al_lock_mutex(it->mutex);
+	}
+	al_unlock_mutex(it->mutex);
+}
+
+void
+worker_wait(worker_t* it)
+{
+	al_lock_mutex(it->mutex);
+	while (vector_len(it->pending_jobs) > 0 || it->num_busy > 0)
+		al_wait_cond(it->all_done, it->mutex);
+	al_unlock_mutex(it->mutex);
+	worker_update(it);
+}
+
+static void*
+worker_thread(ALLEGRO_THREAD* thread, void* udata)
+{
+	struct job job;
+	worker_t*  worker;
+
+	worker = udata;
+	al_lock_mutex(worker->mutex);
+	for (;;) {
+		while (vector_len(worker->pending_jobs) == 0 && !worker->stopping)
+			al_wait_cond(worker->has_work, worker->mutex);
+		if (vector_len(worker->pending_jobs) == 0)
+			break;  // stopping and nothing left to do
+		job = *(struct job*)vector_get(worker->pending_jobs, 0);
+		vector_remove(worker->pending_jobs, 0);
+		++worker->num_busy;
+		al_unlock_mutex(worker->mutex);
+		job.work(job.udata);
+		al_lock_mutex(worker->mutex);
+		--worker->num_busy;
+		vector_push(worker->done_jobs, &job);
+		if (vector_len(worker->pending_jobs) == 0 && worker->num_busy == 0)
+			al_broadcast_cond(worker->all_done);
+	}
+	al_unlock_mutex(worker->mutex);
+	return NULL;
+}
@@ -45,6 +45,7 @@
 #include <limits.h>
 #include <math.h>
 #include <setjmp.h>
+#include <time.h>
 #if !defined(_WIN32)
 #include <alloca.h>
 #else
@@ -64,6 +65,17 @@
 #define jsal_jmpbuf               jmp_buf
 #endif
 
+// initial size of the value stack, in values.  the stack is grown as needed
+// but this is enough for most games to never need to.
+#define INITIAL_STACK_SIZE 1024
+
+// number of js_ref_t's allocated at a time for jsal_ref() and friends
+#define REFS_PER_SLAB 256
+
+// property IDs for names passed to the `_string` accessors are interned so
+// each name only goes through ChakraCore's property map once.
+#define MAX_INTERNED_KEYS 4096
+
 struct js_ref
 {
 	bool  weak_ref;
@@ -78,6 +90,13 @@ struct breakpoint
 	int          line;
 };
 
+struct interned_key
+{
+	uint32_t        hash;
+	JsPropertyIdRef key;
+	char*           name;
+};
+
 struct function
 {
 	bool          async_flag;
@@ -115,10 +134,12 @@ struct rejection
 	JsValueRef value;
 };
 
+static void CHAKRA_CALLBACK        on_before_collect           (void* userdata);
 static void CHAKRA_CALLBACK        on_debugger_event           (JsDiagDebugEvent event_type, JsValueRef data, void* userdata);
 static JsErrorCode CHAKRA_CALLBACK on_fetch_dynamic_import     (JsSourceContext importer, JsValueRef specifier, JsModuleRecord *out_module);
 static JsErrorCode CHAKRA_CALLBACK on_fetch_imported_module    (JsModuleRecord importer, JsValueRef specifier, JsModuleRecord *out_module);
 static void CHAKRA_CALLBACK        on_finalize_host_object     (void* userdata);
+static bool CHAKRA_CALLBACK        on_memory_event             (void* userdata, JsMemoryEventType event_type, size_t size);
 static JsValueRef CHAKRA_CALLBACK  on_js_to_native_call        (JsValueRef callee, JsValueRef argv[], unsigned short argc, JsNativeFunctionInfo* env, void* userdata);
 static JsErrorCode CHAKRA_CALLBACK on_notify_module_ready      (JsModuleRecord module, JsValueRef exception);
 static void CHAKRA_CALLBACK        on_reject_promise_unhandled (JsValueRef promise, JsValueRef reason, bool handled, void* userdata);
@@ -129,13 +150,18 @@ static const char*                 filename_from_script_id     (unsigned int scr
 static JsModuleRecord              get_module_record           (const char* specifier, JsModuleRecord parent, const char* url, bool *out_is_new);
 static js_ref_t*                   get_ref                     (int stack_index);
 static JsValueRef                  get_value                   (int stack_index);
+static double                      get_time                    (void);
+static JsPropertyIdRef             intern_key                  (const char* name);
 static JsPropertyIdRef             make_property_id            (JsValueRef key_value);
 static js_ref_t*                   make_ref                    (JsRef value, bool weak_ref);
+static js_ref_t*                   new_ref                     (void);
 static JsValueRef                  pop_value                   (void);
 static void                        push_debug_callback_args    (JsValueRef event_data);
 static unsigned int                script_id_from_filename     (const char* filename);
 static int                         push_value                  (JsValueRef value, bool weak_ref);
+static void                        resize_key_table            (int new_size);
 static void                        resize_stack                (int new_size);
+static bool                        reserve_stack               (int min_size);
 static void                        throw_on_error              (void);
 static except_t                    throw_value                 (JsValueRef value);
 
@@ -146,6 +172,8 @@ static int vasprintf (char* *out, const char* format, va_list ap);
 
 static bool                 s_async_flag = false;
 static js_break_callback_t  s_break_callback = NULL;
+static js_ref_t*            s_free_refs = NULL;
+static js_gc_stats_t        s_gc_stats;
 static vector_t*            s_breakpoints;
 static JsValueRef           s_callee_value = JS_INVALID_REFERENCE;
 static jsal_jmpbuf*         s_catch_label = NULL;
@@ -157,6 +185,8 @@ static JsValueRef           s_js_null;
 static JsRuntimeHandle      s_js_runtime = NULL;
 static JsValueRef           s_js_true;
 static JsValueRef           s_js_undefined;
+static struct interned_key* s_key_table = NULL;
+static int                  s_key_table_size = 0;
 static js_ref_t*            s_key_configurable;
 static js_ref_t*            s_key_done;
 static js_ref_t*            s_key_enumerable;
@@ -171,12 +201,15 @@ static js_module_callback_t s_module_callback = NULL;
 static vector_t*            s_module_jobs;
 static JsValueRef           s_newtarget_value = JS_INVALID_REFERENCE;
 static JsSourceContext      s_next_source_context = 1;
+static int                  s_num_keys = 0;
 static js_reject_callback_t s_reject_callback = NULL;
 static vector_t*            s_rejections;
 static int                  s_stack_base;
+static int                  s_stack_size = 0;
+static int                  s_stack_top = 0;
 static JsValueRef           s_stash;
 static JsValueRef           s_this_value = JS_INVALID_REFERENCE;
-static vector_t*            s_value_stack;
+static js_ref_t*            s_value_stack = NULL;
 static js_throw_callback_t  s_throw_callback = NULL;
 
 bool
@@ -207,19 +240,23 @@ jsal_init(void)
 	JsSetModuleHostInfo(NULL, JsModuleHostInfo_FetchImportedModuleFromScriptCallback, on_fetch_dynamic_import);
 	JsSetModuleHostInfo(NULL, JsModuleHostInfo_NotifyModuleReadyCallback, on_notify_module_ready);
 	JsSetModuleHostInfo(NULL, JsModuleHostInfo_ReportModuleCompletionCallback, on_report_module_completion);
+	JsSetRuntimeBeforeCollectCallback(s_js_runtime, NULL, on_before_collect);
+	JsSetRuntimeMemoryAllocationCallback(s_js_runtime, NULL, on_memory_event);
+	memset(&s_gc_stats, 0, sizeof(js_gc_stats_t));
 
 	// set up the stash, used to store JS values behind the scenes.
 	JsCreateObject(&s_stash);
 	JsAddRef(s_stash, NULL);
 
-	s_value_stack = vector_new(sizeof(js_ref_t));
 	s_stack_base = 0;
+	s_stack_top = 0;
 	s_breakpoints = vector_new(sizeof(struct breakpoint));
 	s_module_cache = vector_new(sizeof(struct module));
 	s_module_jobs = vector_new(sizeof(struct module_job));
 	s_rejections = vector_new(sizeof(struct rejection));
 
-	vector_reserve(s_value_stack, 128);
+	reserve_stack(INITIAL_STACK_SIZE);
+	resize_key_table(256);
 
 	s_key_configurable = jsal_new_key("configurable");
 	s_key_done = jsal_new_key("done");
@@ -257,6 +294,7 @@ jsal_uninit(void)
 	jsal_unref(s_key_set);
 	jsal_unref(s_key_value);
 	jsal_unref(s_key_writable);
+	resize_key_table(0);
 
 	iter = vector_enum(s_breakpoints);
 	while (iter_next(&iter)) {
@@ -276,7 +314,9 @@ jsal_uninit(void)
 	vector_free(s_breakpoints);
 	vector_free(s_module_cache);
 	vector_free(s_module_jobs);
-	vector_free(s_value_stack);
+	free(s_value_stack);
+	s_value_stack = NULL;
+	s_stack_size = 0;
 	vector_free(s_rejections);
 	JsRelease(s_stash, NULL);
 	JsSetCurrentContext(JS_INVALID_REFERENCE);
@@ -344,7 +384,7 @@ jsal_update(bool in_event_loop)
 			}
 			last_catch_label = s_catch_label;
 			last_stack_base = s_stack_base;
-			s_stack_base = vector_len(s_value_stack);
+			s_stack_base = s_stack_top;
 			push_value(rejection->promise, true);
 			push_value(rejection->value, true);
 			if (jsal_setjmp(label) == 0) {
@@ -530,15 +570,15 @@ jsal_def_prop_string(int object_index, const char* name)
 {
 	/* [ ... descriptor ] -> [ ... ] */
 
-	JsValueRef descriptor;
-	JsValueRef key;
-	JsValueRef object;
-	bool       result;
+	JsValueRef      descriptor;
+	JsPropertyIdRef key;
+	JsValueRef      object;
+	bool            result;
 
 	object = get_value(object_index);
 	descriptor = pop_value();
-	JsCreateString(name, strlen(name), &key);
-	JsObjectDefineProperty(object, key, descriptor, &result);
+	key = intern_key(name);
+	JsDefineProperty(object, key, descriptor, &result);
 	throw_on_error();
 }
 
@@ -563,8 +603,17 @@ jsal_del_global(void)
 bool
 jsal_del_global_string(const char* name)
 {
-	jsal_push_string(name);
-	return jsal_del_global();
+	JsPropertyIdRef key;
+	JsValueRef      object;
+	JsValueRef      result;
+	bool            retval;
+
+	JsGetGlobalObject(&object);
+	key = intern_key(name);
+	JsDeleteProperty(object, key, true, &result);
+	throw_on_error();
+	JsBooleanToBool(result, &retval);
+	return retval;
 }
 
 bool
@@ -596,9 +645,17 @@ jsal_del_prop_index(int object_index, int name)
 bool
 jsal_del_prop_string(int object_index, const char* name)
 {
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	return jsal_del_prop(object_index);
+	JsPropertyIdRef key;
+	JsValueRef      object;
+	JsValueRef      result;
+	bool            retval;
+
+	object = get_value(object_index);
+	key = intern_key(name);
+	JsDeleteProperty(object, key, true, &result);
+	throw_on_error();
+	JsBooleanToBool(result, &retval);
+	return retval;
 }
 
 int
@@ -696,7 +753,18 @@ jsal_freeze(int at_index)
 void
 jsal_gc(void)
 {
+	double pause_time;
+	double start_time;
+
+	// note: ChakraCore doesn't tell us when a collection finishes, so only
+	//       explicit collections can be timed.
+	start_time = get_time();
 	JsCollectGarbage(s_js_runtime);
+	pause_time = get_time() - start_time;
+	++s_gc_stats.num_explicit;
+	s_gc_stats.total_pause += pause_time;
+	if (pause_time > s_gc_stats.max_pause)
+		s_gc_stats.max_pause = pause_time;
 }
 
 bool
@@ -734,6 +802,12 @@ jsal_get_buffer_ptr(int at_index, size_t *out_size)
 	return value;
 }
 
+void
+jsal_get_gc_stats(js_gc_stats_t* out_stats)
+{
+	*out_stats = s_gc_stats;
+}
+
 bool
 jsal_get_global(void)
 {
@@ -756,8 +830,16 @@ jsal_get_global_string(const char* name)
 {
 	/* [ ... ] -> [ ... value ] */
 
-	jsal_push_string(name);
-	return jsal_get_global();
+	JsPropertyIdRef key;
+	JsValueRef      object;
+	JsValueRef      value;
+
+	JsGetGlobalObject(&object);
+	key = intern_key(name);
+	JsGetProperty(object, key, &value);
+	throw_on_error();
+	push_value(value, true);
+	return value != s_js_undefined;
 }
 
 void*
@@ -830,6 +912,26 @@ jsal_get_lstring(int index, size_t *out_length)
 	return buffer;
 }
 
+size_t
+jsal_get_memory_limit(void)
+{
+	size_t limit;
+
+	if (JsGetRuntimeMemoryLimit(s_js_runtime, &limit) != JsNoError)
+		return 0;
+	return limit != SIZE_MAX ? limit : 0;
+}
+
+size_t
+jsal_get_memory_usage(void)
+{
+	size_t usage;
+
+	if (JsGetRuntimeMemoryUsage(s_js_runtime, &usage) != JsNoError)
+		return 0;
+	return usage;
+}
+
 double
 jsal_get_number(int index)
 {
@@ -908,7 +1010,7 @@ jsal_get_prop_string(int object_index, const char* name)
 	JsValueRef      value;
 
 	object_ref = get_ref(object_index);
-	JsCreatePropertyId(name, strlen(name), &key);
+	key = intern_key(name);
 	JsGetProperty(object_ref->value, key, &value);
 	throw_on_error();
 	push_value(value, object_ref->weak_ref);
@@ -938,7 +1040,7 @@ jsal_get_string(int index)
 int
 jsal_get_top(void)
 {
-	return vector_len(s_value_stack) - s_stack_base;
+	return s_stack_top - s_stack_base;
 }
 
 unsigned int
@@ -979,9 +1081,12 @@ jsal_has_own_prop_index(int object_index, int name)
 bool
 jsal_has_own_prop_string(int object_index, const char* name)
 {
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	return jsal_has_own_prop(object_index);
+	bool       has_property;
+	JsValueRef object;
+
+	object = get_value(object_index);
+	JsHasOwnProperty(object, intern_key(name), &has_property);
+	return has_property;
 }
 
 bool
@@ -1021,9 +1126,12 @@ jsal_has_prop_key(int object_index, js_ref_t* key)
 bool
 jsal_has_prop_string(int object_index, const char* name)
 {
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	return jsal_has_prop(object_index);
+	bool       has_property;
+	JsValueRef object;
+
+	object = get_value(object_index);
+	JsHasProperty(object, intern_key(name), &has_property);
+	return has_property;
 }
 
 void
@@ -1037,9 +1145,10 @@ jsal_insert(int at_index)
 
 	if (at_index == jsal_get_top() - 1)
 		return;  // nop
-	ref = *(js_ref_t*)vector_get(s_value_stack, vector_len(s_value_stack) - 1);
-	vector_insert(s_value_stack, at_index + s_stack_base, &ref);
-	vector_pop(s_value_stack, 1);
+	at_index += s_stack_base;
+	ref = s_value_stack[s_stack_top - 1];
+	memmove(&s_value_stack[at_index + 1], &s_value_stack[at_index], (s_stack_top - at_index - 1) * sizeof(js_ref_t));
+	s_value_stack[at_index] = ref;
 }
 
 bool
@@ -1232,10 +1341,7 @@ jsal_make_buffer(int object_index, js_buffer_type_t buffer_type, void* buffer, s
 js_ref_t*
 jsal_new_key(const char* name)
 {
-	JsPropertyIdRef key;
-
-	JsCreatePropertyId(name, strlen(name), &key);
-	return make_ref(key, false);
+	return make_ref(intern_key(name), false);
 }
 
 bool
@@ -1671,10 +1777,10 @@ jsal_pull(int from_index)
 {
 	js_ref_t ref;
 
-	from_index = jsal_normalize_index(from_index);
-	ref = *(js_ref_t*)vector_get(s_value_stack, from_index + s_stack_base);
-	vector_push(s_value_stack, &ref);
-	vector_remove(s_value_stack, from_index + s_stack_base);
+	from_index = jsal_normalize_index(from_index) + s_stack_base;
+	ref = s_value_stack[from_index];
+	memmove(&s_value_stack[from_index], &s_value_stack[from_index + 1], (s_stack_top - from_index - 1) * sizeof(js_ref_t));
+	s_value_stack[s_stack_top - 1] = ref;
 }
 
 void
@@ -1741,7 +1847,7 @@ jsal_put_prop_string(int object_index, const char* name)
 
 	object = get_value(object_index);
 	value = pop_value();
-	JsCreatePropertyId(name, strlen(name), &key);
+	key = intern_key(name);
 	JsSetProperty(object, key, value, true);
 	throw_on_error();
 }
@@ -1752,7 +1858,7 @@ jsal_ref(int at_index)
 	js_ref_t*  ref;
 	js_ref_t*  stack_ref;
 
-	if (!(ref = calloc(1, sizeof(js_ref_t))))
+	if (!(ref = new_ref()))
 		return NULL;
 
 	// IMPORTANT: stack entry becomes a weak reference after this; to avoid a segfault, make
@@ -1773,11 +1879,12 @@ jsal_remove(int at_index)
 
 	js_ref_t* ref;
 
-	at_index = jsal_normalize_index(at_index);
-	ref = vector_get(s_value_stack, at_index + s_stack_base);
+	at_index = jsal_normalize_index(at_index) + s_stack_base;
+	ref = &s_value_stack[at_index];
 	if (!ref->weak_ref)
 		JsRelease(ref->value, NULL);
-	vector_remove(s_value_stack, at_index + s_stack_base);
+	memmove(ref, ref + 1, (s_stack_top - at_index - 1) * sizeof(js_ref_t));
+	--s_stack_top;
 }
 
 bool
@@ -1792,12 +1899,12 @@ jsal_replace(int at_index)
 
 	if (at_index == jsal_get_top() - 1)
 		return true;  // nop
-	old_ref = vector_get(s_value_stack, at_index + s_stack_base);
-	ref = vector_get(s_value_stack, vector_len(s_value_stack) - 1);
+	old_ref = &s_value_stack[at_index + s_stack_base];
+	ref = &s_value_stack[s_stack_top - 1];
 	if (!old_ref->weak_ref)
 		JsRelease(old_ref->value, NULL);
-	vector_put(s_value_stack, at_index + s_stack_base, ref);
-	vector_pop(s_value_stack, 1);
+	*old_ref = *ref;
+	--s_stack_top;
 	return true;
 }
 
@@ -1995,6 +2102,12 @@ jsal_set_host_data(int at_index, void* ptr)
 	object_info->data = ptr;
 }
 
+void
+jsal_set_memory_limit(size_t limit)
+{
+	JsSetRuntimeMemoryLimit(s_js_runtime, limit > 0 ? limit : SIZE_MAX);
+}
+
 void
 jsal_set_prototype(int object_index)
 {
@@ -2195,7 +2308,7 @@ jsal_try(js_function_t callback, int num_args)
 
 	last_catch_label = s_catch_label;
 	last_stack_base = s_stack_base;
-	s_stack_base = vector_len(s_value_stack) - num_args;
+	s_stack_base = s_stack_top - num_args;
 	if (jsal_setjmp(label) == 0) {
 		s_catch_label = &label;
 		if (!callback(num_args, false, 0))
@@ -2344,7 +2457,10 @@ jsal_unref(js_ref_t* ref)
 		return;
 	if (!ref->weak_ref)
 		JsRelease(ref->value, NULL);
-	free(ref);
+
+	// put the ref back on the freelist.  the value field doubles as the link.
+	ref->value = s_free_refs;
+	s_free_refs = ref;
 }
 
 bool
@@ -2505,25 +2621,50 @@ jsal_debug_inspect_eval(int call_index, const char* source, bool *out_errored)
 	return true;
 }
 
-bool
-jsal_debug_inspect_object(unsigned int handle, int property_index)
+int
+jsal_debug_count_props(unsigned int handle)
 {
-	/* [ ... ] -> [ ... key value handle ] */
+	JsValueRef results;
+	int        num_props;
+
+	if (JsDiagGetProperties(handle, 0, 1, &results) != JsNoError)
+		return -1;
+	push_value(results, true);
+	jsal_get_prop_string(-1, "totalPropertiesOfObject");
+	num_props = jsal_get_int(-1);
+	jsal_pop(2);
+	return num_props;
+}
+
+int
+jsal_debug_inspect_object(unsigned int handle, int start, int count)
+{
+	/* [ ... ] -> [ ... page ] */
 
 	JsValueRef results;
 
-	if (JsDiagGetProperties(handle, property_index, 1, &results) != JsNoError)
-		return false;
+	// note: this fetches a whole page of properties with a single call, rather
+	//       than one call per property.  use jsal_debug_inspect_prop() to pick
+	//       out individual properties from the page.
+	if (JsDiagGetProperties(handle, start, count, &results) != JsNoError)
+		return -1;
 	push_value(results, true);
 	jsal_get_prop_string(-1, "properties");
-	if (!jsal_get_prop_index(-1, 0)) {
-		jsal_pop(3);
+	jsal_remove(-2);
+	return jsal_get_length(-1);
+}
+
+bool
+jsal_debug_inspect_prop(int page_index, int index)
+{
+	/* [ ... ] -> [ ... key value handle ] */
+
+	if (!jsal_get_prop_index(page_index, index)) {
+		jsal_pop(1);
 		return false;
 	}
 	decode_debugger_value();
 	jsal_remove(-3);  // remove 'type' from result (not relevant...?)
-	jsal_remove(-4);
-	jsal_remove(-4);
 	return true;
 }
 
@@ -2594,7 +2735,7 @@ get_ref(int stack_index)
 	js_ref_t* ref;
 
 	stack_index = jsal_normalize_index(stack_index);
-	ref = vector_get(s_value_stack, stack_index + s_stack_base);
+	ref = &s_value_stack[stack_index + s_stack_base];
 	return ref;
 }
 
@@ -2604,10 +2745,69 @@ get_value(int stack_index)
 	js_ref_t* ref;
 
 	stack_index = jsal_normalize_index(stack_index);
-	ref = vector_get(s_value_stack, stack_index + s_stack_base);
+	ref = &s_value_stack[stack_index + s_stack_base];
 	return ref->value;
 }
 
+static double
+get_time(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / frequency.QuadPart;
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1.0e9;
+#endif
+}
+
+static JsPropertyIdRef
+intern_key(const char* name)
+{
+	struct interned_key* entry;
+	uint32_t             hash = 2166136261u;
+	int                  index;
+	JsPropertyIdRef      key = JS_INVALID_REFERENCE;
+	const char*          p;
+
+	for (p = name; *p != '\0'; ++p)
+		hash = (hash ^ (uint8_t)*p) * 16777619u;  // FNV-1a
+	index = hash & (s_key_table_size - 1);
+	while ((entry = &s_key_table[index])->name != NULL) {
+		if (entry->hash == hash && strcmp(entry->name, name) == 0)
+			return entry->key;
+		index = (index + 1) & (s_key_table_size - 1);
+	}
+
+	// note: if the table fills up, names are still looked up, just not cached.
+	//       the names used by the engine are a fixed set, so this should only
+	//       happen if something is generating names on the fly.
+	if (JsCreatePropertyId(name, p - name, &key) != JsNoError)
+		return key;
+	if (s_num_keys >= MAX_INTERNED_KEYS)
+		return key;
+	if ((s_num_keys + 1) * 2 > s_key_table_size) {
+		resize_key_table(s_key_table_size * 2);
+		index = hash & (s_key_table_size - 1);
+		while (s_key_table[index].name != NULL)
+			index = (index + 1) & (s_key_table_size - 1);
+		entry = &s_key_table[index];
+	}
+	if (!(entry->name = strdup(name)))
+		return key;
+	JsAddRef(key, NULL);
+	entry->hash = hash;
+	entry->key = key;
+	++s_num_keys;
+	return key;
+}
+
 static JsPropertyIdRef
 make_property_id(JsValueRef key)
 {
@@ -2637,26 +2837,49 @@ make_ref(JsRef value, bool weak_ref)
 	if (!weak_ref)
 		JsAddRef(value, NULL);
 
-	if (!(ref = calloc(1, sizeof(js_ref_t))))
+	if (!(ref = new_ref()))
 		return NULL;
 	ref->value = value;
 	ref->weak_ref = weak_ref;
 	return ref;
 }
 
+static js_ref_t*
+new_ref(void)
+{
+	// note: refs are carved out of slabs and recycled through a freelist rather
+	//       than being malloc'd one at a time.  slabs are never freed, but they
+	//       get reused if the JS runtime is torn down and started up again.
+	js_ref_t* ref;
+	js_ref_t* slab;
+
+	int i;
+
+	if (s_free_refs == NULL) {
+		if (!(slab = malloc(REFS_PER_SLAB * sizeof(js_ref_t))))
+			return NULL;
+		for (i = 0; i < REFS_PER_SLAB; ++i) {
+			slab[i].value = s_free_refs;
+			s_free_refs = &slab[i];
+		}
+	}
+	ref = s_free_refs;
+	s_free_refs = ref->value;
+	ref->value = JS_INVALID_REFERENCE;
+	ref->weak_ref = false;
+	return ref;
+}
+
 static JsValueRef
 pop_value(void)
 {
-	int        index;
 	js_ref_t*  ref;
 	JsValueRef value;
 
-	index = vector_len(s_value_stack) - 1;
-	ref = vector_get(s_value_stack, index);
+	ref = &s_value_stack[--s_stack_top];
 	value = ref->value;
 	if (!ref->weak_ref)
 		JsRelease(ref->value, NULL);
-	vector_pop(s_value_stack, 1);
 	return value;
 }
 
@@ -2760,40 +2983,94 @@ get_module_record(const char* specifier, JsModuleRecord parent_record, const cha
 static int
 push_value(JsValueRef value, bool weak_ref)
 {
-	js_ref_t ref;
+	js_ref_t* ref;
 
+	if (s_stack_top >= s_stack_size && !reserve_stack(s_stack_top + 1))
+		return s_stack_top - s_stack_base - 1;
 	if (!weak_ref)
 		JsAddRef(value, NULL);
-	ref.value = value;
-	ref.weak_ref = weak_ref;
-	vector_push(s_value_stack, &ref);
-	return vector_len(s_value_stack) - s_stack_base - 1;
+	ref = &s_value_stack[s_stack_top++];
+	ref->value = value;
+	ref->weak_ref = weak_ref;
+	return s_stack_top - s_stack_base - 1;
+}
+
+static bool
+reserve_stack(int min_size)
+{
+	js_ref_t* new_stack;
+	int       new_size;
+
+	if (min_size <= s_stack_size)
+		return true;
+	new_size = s_stack_size > 0 ? s_stack_size : INITIAL_STACK_SIZE;
+	while (new_size < min_size)
+		new_size *= 2;
+	if (!(new_stack = realloc(s_value_stack, new_size * sizeof(js_ref_t))))
+		return false;
+	s_value_stack = new_stack;
+	s_stack_size = new_size;
+	return true;
 }
 
 static void
-resize_stack(int new_size)
+resize_key_table(int new_size)
 {
-	js_ref_t  ref;
-	js_ref_t* ref_ptr;
-	int       old_size;
+	// note: passing 0 for `new_size` releases all interned keys and frees the
+	//       table.
+	struct interned_key* entry;
+	int                  index;
+	struct interned_key* new_table = NULL;
 
 	int i;
 
-	old_size = vector_len(s_value_stack);
-	if (new_size < old_size) {
-		for (i = new_size; i < old_size; ++i) {
-			ref_ptr = vector_get(s_value_stack, i);
-			if (!ref_ptr->weak_ref)
-				JsRelease(ref_ptr->value, NULL);
+	if (new_size > 0) {
+		if (!(new_table = calloc(new_size, sizeof(struct interned_key))))
+			return;
+		for (i = 0; i < s_key_table_size; ++i) {
+			entry = &s_key_table[i];
+			if (entry->name == NULL)
+				continue;
+			index = entry->hash & (new_size - 1);
+			while (new_table[index].name != NULL)
+				index = (index + 1) & (new_size - 1);
+			new_table[index] = *entry;
 		}
 	}
-	vector_resize(s_value_stack, new_size);
-	if (new_size > old_size) {
-		ref.value = s_js_undefined;
-		ref.weak_ref = true;
-		for (i = old_size; i < new_size; ++i)
-			vector_put(s_value_stack, i, &ref);
+	else {
+		for (i = 0; i < s_key_table_size; ++i) {
+			if (s_key_table[i].name == NULL)
+				continue;
+			JsRelease(s_key_table[i].key, NULL);
+			free(s_key_table[i].name);
+		}
+		s_num_keys = 0;
 	}
+	free(s_key_table);
+	s_key_table = new_table;
+	s_key_table_size = new_size;
+}
+
+static void
+resize_stack(int new_size)
+{
+	js_ref_t* ref;
+
+	int i;
+
+	if (new_size > s_stack_size && !reserve_stack(new_size))
+		return;
+	for (i = new_size; i < s_stack_top; ++i) {
+		ref = &s_value_stack[i];
+		if (!ref->weak_ref)
+			JsRelease(ref->value, NULL);
+	}
+	for (i = s_stack_top; i < new_size; ++i) {
+		ref = &s_value_stack[i];
+		ref->value = s_js_undefined;
+		ref->weak_ref = true;
+	}
+	s_stack_top = new_size;
 }
 
 static void
@@ -2824,10 +3101,17 @@ throw_value(JsValueRef value)
 	}
 }
 
+static void CHAKRA_CALLBACK
+on_before_collect(void* userdata)
+{
+	++s_gc_stats.num_collections;
+}
+
 static void CHAKRA_CALLBACK
 on_debugger_event(JsDiagDebugEvent event_type, JsValueRef data, void* userdata)
 {
 	struct breakpoint* breakpoint;
+	int                breakpoint_index = -1;
 	JsValueRef         breakpoint_info;
 	const char*        filename;
 	unsigned int       handle;
@@ -2835,6 +3119,7 @@ on_debugger_event(JsDiagDebugEvent event_type, JsValueRef data, void* userdata)
 	jsal_jmpbuf*       last_catch_label;
 	int                last_stack_base;
 	const char*        name;
+	unsigned int       id;
 	JsValueRef         properties;
 	unsigned int       script_id;
 	js_step_t          step = JS_STEP_CONTINUE;
@@ -2867,7 +3152,7 @@ on_debugger_event(JsDiagDebugEvent event_type, JsValueRef data, void* userdata)
 		case JsDiagDebugEventRuntimeException:
 			last_catch_label = s_catch_label;
 			last_stack_base = s_stack_base;
-			s_stack_base = vector_len(s_value_stack);
+			s_stack_base = s_stack_top;
 			push_value(data, true);
 			jsal_get_prop_string(-1, "exception");
 			jsal_get_prop_string(-1, "handle");
@@ -2910,8 +3195,22 @@ on_debugger_event(JsDiagDebugEvent event_type, JsValueRef data, void* userdata)
 		case JsDiagDebugEventStepComplete:
 			last_catch_label = s_catch_label;
 			last_stack_base = s_stack_base;
-			s_stack_base = vector_len(s_value_stack);
+			s_stack_base = s_stack_top;
+			if (event_type == JsDiagDebugEventBreakpoint) {
+				// let the callback know which breakpoint was hit, so it can apply any
+				// conditions attached to it
+				push_value(data, true);
+				jsal_get_prop_string(-1, "breakpointId");
+				id = jsal_get_uint(-1);
+				jsal_pop(2);
+				iter = vector_enum(s_breakpoints);
+				while ((breakpoint = iter_next(&iter))) {
+					if (breakpoint->id == id)
+						breakpoint_index = iter.index;
+				}
+			}
 			push_debug_callback_args(data);
+			jsal_push_int(breakpoint_index);
 			if (jsal_setjmp(label) == 0) {
 				s_catch_label = &label;
 				step = s_break_callback();
@@ -2962,7 +3261,7 @@ on_fetch_imported_module(JsModuleRecord importer, JsValueRef module_name, JsModu
 
 	last_catch_label = s_catch_label;
 	last_stack_base = s_stack_base;
-	s_stack_base = vector_len(s_value_stack);
+	s_stack_base = s_stack_top;
 	push_value(module_name, true);
 	if (importer != NULL) {
 		JsGetModuleHostInfo(importer, JsModuleHostInfo_HostDefined, &caller_id);
@@ -3025,6 +3324,16 @@ on_finalize_host_object(void* userdata)
 	free(object_info);
 }
 
+static bool CHAKRA_CALLBACK
+on_memory_event(void* userdata, JsMemoryEventType event_type, size_t size)
+{
+	// note: returning true allows the allocation.  a failure event means
+	//       ChakraCore ran into the memory limit and will throw an OOM error.
+	if (event_type == JsMemoryFailure)
+		++s_gc_stats.num_alloc_failures;
+	return true;
+}
+
 static JsValueRef CHAKRA_CALLBACK
 on_js_to_native_call(JsValueRef callee, JsValueRef argv[], unsigned short argc, JsNativeFunctionInfo* env, void* userdata)
 {
@@ -3057,7 +3366,7 @@ on_js_to_native_call(JsValueRef callee, JsValueRef argv[], unsigned short argc,
 	last_this_value = s_this_value;
 
 	// set up a stack frame and call the native function
-	s_stack_base = vector_len(s_value_stack);
+	s_stack_base = s_stack_top;
 	s_async_flag = function_data->async_flag;
 	s_callee_value = callee;
 	s_newtarget_value = env->newTargetArg;
@@ -3176,7 +3485,7 @@ on_report_module_completion(JsModuleRecord module, JsValueRef exception)
 
 	last_catch_label = s_catch_label;
 	last_stack_base = s_stack_base;
-	s_stack_base = vector_len(s_value_stack);
+	s_stack_base = s_stack_top;
 	if (exception == JS_INVALID_REFERENCE) {
 		JsGetModuleNamespace(module, &namespace);
 		push_value(namespace, true);
@@ -3215,7 +3524,7 @@ on_resolve_reject_promise(JsValueRef task, void* userdata)
 
 	last_catch_label = s_catch_label;
 	last_stack_base = s_stack_base;
-	s_stack_base = vector_len(s_value_stack);
+	s_stack_base = s_stack_top;
 	push_value(task, true);
 	if (jsal_setjmp(label) == 0) {
 		s_catch_label = &label;
@@ -90,6 +90,16 @@ enum js_error_type
 	JS_URI_ERROR,
 } js_error_type_t;
 
+typedef
+struct js_gc_stats
+{
+	unsigned int num_alloc_failures;
+	unsigned int num_collections;
+	unsigned int num_explicit;
+	double       max_pause;
+	double       total_pause;
+} js_gc_stats_t;
+
 typedef bool      (* js_function_t)        (int num_args, bool is_ctor, intptr_t magic);
 typedef js_step_t (* js_break_callback_t)  (void);
 typedef void      (* js_finalizer_t)       (void* host_ptr);
@@ -135,7 +145,10 @@ bool         jsal_get_global_string        (const char* name);
 void*        jsal_get_host_data            (int at_index);
 int          jsal_get_int                  (int at_index);
 int          jsal_get_length               (int at_index);
+void         jsal_get_gc_stats             (js_gc_stats_t* out_stats);
 const char*  jsal_get_lstring              (int at_index, size_t *out_length);
+size_t       jsal_get_memory_limit         (void);
+size_t       jsal_get_memory_usage         (void);
 double       jsal_get_number               (int at_index);
 bool         jsal_get_prop                 (int object_index);
 bool         jsal_get_prop_index           (int object_index, int name);
@@ -231,6 +244,7 @@ void         jsal_require_undefined        (int at_index);
 void         jsal_set_async_call_flag      (bool is_async);
 void         jsal_set_finalizer            (int at_index, js_finalizer_t callback);
 void         jsal_set_host_data            (int at_index, void* ptr);
+void         jsal_set_memory_limit         (size_t limit);
 void         jsal_set_prototype            (int object_index);
 void         jsal_set_top                  (int new_top);
 void         jsal_stringify                (int at_index);
@@ -260,10 +274,12 @@ void jsal_debug_on_throw           (js_throw_callback_t callback);
 int  jsal_debug_breakpoint_add     (const char* filename, unsigned int line, unsigned int column);
 void jsal_debug_breakpoint_inject  (void);
 void jsal_debug_breakpoint_remove  (int index);
+int  jsal_debug_count_props        (unsigned int object_id);
 bool jsal_debug_inspect_breakpoint (int index);
 bool jsal_debug_inspect_call       (int call_index);
 bool jsal_debug_inspect_eval       (int call_index, const char* source, bool *out_errored);
-bool jsal_debug_inspect_object     (unsigned int object_id, int property_index);
+int  jsal_debug_inspect_object     (unsigned int object_id, int start, int count);
+bool jsal_debug_inspect_prop       (int page_index, int index);
 bool jsal_debug_inspect_var        (int call_index, int var_index);
 
 #endif // !SPHERE_JSAL_H_INCLUDED
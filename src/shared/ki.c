@@ -62,6 +62,11 @@ struct ki_message
 	ki_type_t command;
 };
 
+static size_t     atom_size   (const uint8_t* data, size_t len);
+static ki_atom_t* decode_atom (const uint8_t* data, size_t *out_size);
+static void       encode_atom (const ki_atom_t* atom, vector_t* buffer);
+static bool       recv_bytes  (socket_t* socket, vector_t* buffer, size_t size);
+
 ki_atom_t*
 ki_atom_new(ki_type_t type)
 {
@@ -252,114 +257,31 @@ ki_atom_print(const ki_atom_t* it, bool verbose)
 ki_atom_t*
 ki_atom_recv(socket_t* socket)
 {
-	ki_atom_t* atom;
-	uint8_t    data[32];
-	uint8_t    ib;
-	int        read_size;
+	ki_atom_t* atom = NULL;
+	vector_t*  buffer;
+	size_t     size;
 
-	if (!(atom = calloc(1, sizeof(ki_atom_t))))
-		return NULL;
-	if (socket_read(socket, &ib, 1) == 0)
-		goto lost_connection;
-	atom->type = (ki_type_t)ib;
-	switch (ib) {
-	case KI_INT:
-		if (socket_read(socket, data, 4) == 0)
-			goto lost_connection;
-		atom->type = KI_INT;
-		atom->int_value = (data[0] << 24) + (data[1] << 16) + (data[2] << 8) + data[3];
-		break;
-	case KI_STRING:
-		if (socket_read(socket, data, 4) == 0)
-			goto lost_connection;
-		atom->buffer.size = (data[0] << 24) + (data[1] << 16) + (data[2] << 8) + data[3];
-		atom->buffer.data = calloc(1, atom->buffer.size + 1);
-		read_size = (int)atom->buffer.size;
-		if (socket_read(socket, atom->buffer.data, read_size) != read_size)
-			goto lost_connection;
-		atom->type = KI_STRING;
-		break;
-	case KI_BUFFER:
-		if (socket_read(socket, data, 4) == 0)
-			goto lost_connection;
-		atom->buffer.size = (data[0] << 24) + (data[1] << 16) + (data[2] << 8) + data[3];
-		atom->buffer.data = calloc(1, atom->buffer.size + 1);
-		read_size = (int)atom->buffer.size;
-		if (socket_read(socket, atom->buffer.data, read_size) != read_size)
-			goto lost_connection;
-		atom->type = KI_BUFFER;
-		break;
-	case KI_NUMBER:
-		if (socket_read(socket, data, 8) == 0)
+	buffer = vector_new(sizeof(uint8_t));
+	while ((size = atom_size(vector_get(buffer, 0), vector_len(buffer))) > vector_len(buffer)) {
+		if (!recv_bytes(socket, buffer, size - vector_len(buffer)))
 			goto lost_connection;
-		((uint8_t*)&atom->float_value)[0] = data[7];
-		((uint8_t*)&atom->float_value)[1] = data[6];
-		((uint8_t*)&atom->float_value)[2] = data[5];
-		((uint8_t*)&atom->float_value)[3] = data[4];
-		((uint8_t*)&atom->float_value)[4] = data[3];
-		((uint8_t*)&atom->float_value)[5] = data[2];
-		((uint8_t*)&atom->float_value)[6] = data[1];
-		((uint8_t*)&atom->float_value)[7] = data[0];
-		atom->type = KI_NUMBER;
-		break;
-	case KI_REF:
-		if (socket_read(socket, data, 4) == 0)
-			goto lost_connection;
-		atom->type = KI_REF;
-		atom->handle = (data[0] << 24) + (data[1] << 16) + (data[2] << 8) + data[3];
-		break;
 	}
-	return atom;
+	atom = decode_atom(vector_get(buffer, 0), NULL);
 
 lost_connection:
-	free(atom);
-	return NULL;
+	vector_free(buffer);
+	return atom;
 }
 
 bool
 ki_atom_send(const ki_atom_t* it, socket_t* socket)
 {
-	uint8_t  data[32];
-	uint32_t str_length;
+	vector_t* buffer;
 
-	data[0] = (uint8_t)it->type;
-	socket_write(socket, data, 1);
-	switch (it->type) {
-	case KI_NUMBER:
-		data[0] = ((uint8_t*)&it->float_value)[7];
-		data[1] = ((uint8_t*)&it->float_value)[6];
-		data[2] = ((uint8_t*)&it->float_value)[5];
-		data[3] = ((uint8_t*)&it->float_value)[4];
-		data[4] = ((uint8_t*)&it->float_value)[3];
-		data[5] = ((uint8_t*)&it->float_value)[2];
-		data[6] = ((uint8_t*)&it->float_value)[1];
-		data[7] = ((uint8_t*)&it->float_value)[0];
-		socket_write(socket, data, 8);
-		break;
-	case KI_REF:
-		data[0] = (uint8_t)(it->handle >> 24 & 0xFF);
-		data[1] = (uint8_t)(it->handle >> 16 & 0xFF);
-		data[2] = (uint8_t)(it->handle >> 8 & 0xFF);
-		data[3] = (uint8_t)(it->handle & 0xFF);
-		socket_write(socket, data, 4);
-		break;
-	case KI_INT:
-		data[0] = (uint8_t)(it->int_value >> 24 & 0xFF);
-		data[1] = (uint8_t)(it->int_value >> 16 & 0xFF);
-		data[2] = (uint8_t)(it->int_value >> 8 & 0xFF);
-		data[3] = (uint8_t)(it->int_value & 0xFF);
-		socket_write(socket, data, 4);
-		break;
-	case KI_STRING:
-		str_length = (uint32_t)strlen(it->buffer.data);
-		data[0] = (uint8_t)(str_length >> 24 & 0xFF);
-		data[1] = (uint8_t)(str_length >> 16 & 0xFF);
-		data[2] = (uint8_t)(str_length >> 8 & 0xFF);
-		data[3] = (uint8_t)(str_length & 0xFF);
-		socket_write(socket, data, 4);
-		socket_write(socket, it->buffer.data, (int)str_length);
-		break;
-	}
+	buffer = vector_new(sizeof(uint8_t));
+	encode_atom(it, buffer);
+	socket_write(socket, vector_get(buffer, 0), vector_len(buffer));
+	vector_free(buffer);
 	return socket_connected(socket);
 }
 
@@ -524,32 +446,69 @@ ki_message_t*
 ki_message_recv(socket_t* socket)
 {
 	ki_atom_t*    atom;
-	ki_message_t* message;
+	vector_t*     buffer;
+	size_t        end;
+	bool          have_eom = false;
+	ki_message_t* message = NULL;
+	size_t        num_atoms = 0;
+	int           num_bytes;
+	size_t        offset = 0;
+	size_t        pos = 0;
+	size_t        size;
+	size_t        want;
 
 	iter_t iter;
 
+	// note: the whole message is pulled off the socket before any of it is
+	//       decoded.  whatever has already arrived gets peeked at in one go and
+	//       scanned for complete atoms, and only what's known to belong to this
+	//       message is consumed.  this way a large message takes a handful of
+	//       reads rather than several per atom, and anything following it is
+	//       left in the socket for next time.
+	buffer = vector_new(sizeof(uint8_t));
+	while (!have_eom) {
+		num_bytes = socket_bytes_avail(socket);
+		vector_resize(buffer, (int)pos + num_bytes);
+		end = pos + socket_peek(socket, vector_get(buffer, (int)pos), num_bytes);
+		while (!have_eom && (size = atom_size(vector_get(buffer, (int)offset), end - offset)) <= end - offset) {
+			have_eom = num_atoms++ > 0 && *(uint8_t*)vector_get(buffer, (int)offset) == KI_EOM;
+			offset += size;
+		}
+
+		// if the message isn't complete yet, wait for as much of the next atom as
+		// we know about.  that much is guaranteed to be part of this message.
+		want = have_eom ? offset
+			: offset + atom_size(vector_get(buffer, (int)offset), end - offset);
+		vector_resize(buffer, (int)pos);
+		if (!recv_bytes(socket, buffer, want - pos))
+			goto lost_connection;
+		pos = want;
+	}
+
 	if (!(message = calloc(1, sizeof(ki_message_t))))
-		return NULL;
+		goto lost_connection;
 	message->atoms = vector_new(sizeof(ki_atom_t*));
-	if (!(atom = ki_atom_recv(socket)))
-		goto lost_dvalue;
-	message->command = ki_atom_type(atom);
-	ki_atom_free(atom);
-	if (!(atom = ki_atom_recv(socket)))
-		goto lost_dvalue;
-	while (ki_atom_type(atom) != KI_EOM) {
-		vector_push(message->atoms, &atom);
-		if (!(atom = ki_atom_recv(socket)))
-			goto lost_dvalue;
+	offset = 0;
+	while (offset < pos) {
+		if (!(atom = decode_atom(vector_get(buffer, (int)offset), &size)))
+			goto lost_connection;
+		offset += size;
+		if (offset == 1)
+			message->command = ki_atom_type(atom);
+		if (offset == 1 || offset == pos)
+			ki_atom_free(atom);
+		else
+			vector_push(message->atoms, &atom);
 	}
-	ki_atom_free(atom);
+	vector_free(buffer);
 	return message;
 
-lost_dvalue:
+lost_connection:
+	vector_free(buffer);
 	if (message != NULL) {
 		iter = vector_enum(message->atoms);
-		while ((atom = iter_next(&iter)))
-			ki_atom_free(atom);
+		while (iter_next(&iter))
+			ki_atom_free(*(ki_atom_t**)iter.ptr);
 		vector_free(message->atoms);
 		free(message);
 	}
@@ -559,25 +518,167 @@ lost_dvalue:
 bool
 ki_message_send(const ki_message_t* it, socket_t* socket)
 {
-	ki_atom_t*  atom;
+	ki_atom_t   atom;
 	ki_atom_t** atom_ptr;
-	ki_type_t   lead_tag;
+	vector_t*   buffer;
 
 	iter_t iter;
 
-	lead_tag = it->command == KI_REQ ? KI_REQ
+	// note: the message is serialized up front and sent with a single write.
+	//       besides being cheaper, this avoids a separate round of socket
+	//       updates for every atom, which really adds up over high-latency
+	//       links such as an SSH tunnel.
+	buffer = vector_new(sizeof(uint8_t));
+	memset(&atom, 0, sizeof(ki_atom_t));
+	atom.type = it->command == KI_REQ ? KI_REQ
 		: it->command == KI_REP ? KI_REP
 		: it->command == KI_ERR ? KI_ERR
 		: it->command == KI_NFY ? KI_NFY
 		: KI_EOM;
-	atom = ki_atom_new(lead_tag);
-	ki_atom_send(atom, socket);
-	ki_atom_free(atom);
+	encode_atom(&atom, buffer);
 	iter = vector_enum(it->atoms);
 	while ((atom_ptr = iter_next(&iter)))
-		ki_atom_send(*atom_ptr, socket);
-	atom = ki_atom_new(KI_EOM);
-	ki_atom_send(atom, socket);
-	ki_atom_free(atom);
+		encode_atom(*atom_ptr, buffer);
+	atom.type = KI_EOM;
+	encode_atom(&atom, buffer);
+	socket_write(socket, vector_get(buffer, 0), vector_len(buffer));
+	vector_free(buffer);
 	return socket_connected(socket);
 }
+
+static size_t
+atom_size(const uint8_t* data, size_t len)
+{
+	// note: this returns the full size of the encoded atom at `data` if enough
+	//       of it is available to tell, otherwise a lower bound.  either way,
+	//       the atom is complete once `len` is at least this much.
+	if (len < 1)
+		return 1;
+	switch (data[0]) {
+	case KI_INT:
+	case KI_REF:
+		return 5;
+	case KI_NUMBER:
+		return 9;
+	case KI_STRING:
+	case KI_BUFFER:
+		if (len < 5)
+			return 5;
+		return 5 + ((size_t)data[1] << 24) + ((size_t)data[2] << 16) + ((size_t)data[3] << 8) + data[4];
+	default:
+		return 1;
+	}
+}
+
+static ki_atom_t*
+decode_atom(const uint8_t* data, size_t *out_size)
+{
+	ki_atom_t* atom;
+	size_t     size;
+
+	if (!(atom = calloc(1, sizeof(ki_atom_t))))
+		return NULL;
+	atom->type = (ki_type_t)data[0];
+	switch (data[0]) {
+	case KI_INT:
+		atom->int_value = (data[1] << 24) + (data[2] << 16) + (data[3] << 8) + data[4];
+		break;
+	case KI_STRING:
+	case KI_BUFFER:
+		size = atom_size(data, 5) - 5;
+		if (!(atom->buffer.data = malloc(size + 1))) {
+			free(atom);
+			return NULL;
+		}
+		memcpy(atom->buffer.data, &data[5], size);
+		((char*)atom->buffer.data)[size] = '\0';
+		atom->buffer.size = size;
+		break;
+	case KI_NUMBER:
+		((uint8_t*)&atom->float_value)[0] = data[8];
+		((uint8_t*)&atom->float_value)[1] = data[7];
+		((uint8_t*)&atom->float_value)[2] = data[6];
+		((uint8_t*)&atom->float_value)[3] = data[5];
+		((uint8_t*)&atom->float_value)[4] = data[4];
+		((uint8_t*)&atom->float_value)[5] = data[3];
+		((uint8_t*)&atom->float_value)[6] = data[2];
+		((uint8_t*)&atom->float_value)[7] = data[1];
+		break;
+	case KI_REF:
+		atom->handle = (data[1] << 24) + (data[2] << 16) + (data[3] << 8) + data[4];
+		break;
+	}
+	if (out_size != NULL)
+		*out_size = atom_size(data, 5);
+	return atom;
+}
+
+static void
+encode_atom(const ki_atom_t* atom, vector_t* buffer)
+{
+	uint8_t* data;
+	int      offset;
+	uint32_t size = 0;
+	int      total_size;
+
+	if (atom->type == KI_STRING)
+		size = (uint32_t)strlen(atom->buffer.data);
+	else if (atom->type == KI_BUFFER)
+		size = (uint32_t)atom->buffer.size;
+	total_size = atom->type == KI_STRING || atom->type == KI_BUFFER ? 5 + (int)size
+		: atom->type == KI_NUMBER ? 9
+		: atom->type == KI_INT || atom->type == KI_REF ? 5
+		: 1;
+	offset = vector_len(buffer);
+	if (!vector_resize(buffer, offset + total_size))
+		return;
+	data = vector_get(buffer, offset);
+	data[0] = (uint8_t)atom->type;
+	switch (atom->type) {
+	case KI_NUMBER:
+		data[1] = ((uint8_t*)&atom->float_value)[7];
+		data[2] = ((uint8_t*)&atom->float_value)[6];
+		data[3] = ((uint8_t*)&atom->float_value)[5];
+		data[4] = ((uint8_t*)&atom->float_value)[4];
+		data[5] = ((uint8_t*)&atom->float_value)[3];
+		data[6] = ((uint8_t*)&atom->float_value)[2];
+		data[7] = ((uint8_t*)&atom->float_value)[1];
+		data[8] = ((uint8_t*)&atom->float_value)[0];
+		break;
+	case KI_REF:
+		data[1] = (uint8_t)(atom->handle >> 24 & 0xFF);
+		data[2] = (uint8_t)(atom->handle >> 16 & 0xFF);
+		data[3] = (uint8_t)(atom->handle >> 8 & 0xFF);
+		data[4] = (uint8_t)(atom->handle & 0xFF);
+		break;
+	case KI_INT:
+		data[1] = (uint8_t)(atom->int_value >> 24 & 0xFF);
+		data[2] = (uint8_t)(atom->int_value >> 16 & 0xFF);
+		data[3] = (uint8_t)(atom->int_value >> 8 & 0xFF);
+		data[4] = (uint8_t)(atom->int_value & 0xFF);
+		break;
+	case KI_STRING:
+	case KI_BUFFER:
+		data[1] = (uint8_t)(size >> 24 & 0xFF);
+		data[2] = (uint8_t)(size >> 16 & 0xFF);
+		data[3] = (uint8_t)(size >> 8 & 0xFF);
+		data[4] = (uint8_t)(size & 0xFF);
+		memcpy(&data[5], atom->buffer.data, size);
+		break;
+	default:
+		break;
+	}
+}
+
+static bool
+recv_bytes(socket_t* socket, vector_t* buffer, size_t size)
+{
+	int offset;
+
+	if (size == 0)
+		return true;
+	offset = vector_len(buffer);
+	if (!vector_resize(buffer, offset + (int)size))
+		return false;
+	return socket_read(socket, vector_get(buffer, offset), (int)size) == (int)size;
+}
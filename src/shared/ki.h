@@ -37,7 +37,7 @@
 #include <stdint.h>
 #include "sockets.h"
 
-#define KI_VERSION 1
+#define KI_VERSION 4
 
 typedef struct ki_atom    ki_atom_t;
 typedef struct ki_message ki_message_t;
@@ -97,6 +97,7 @@ enum ki_notify
 	KI_NFY_PAUSE,
 	KI_NFY_RESUME,
 	KI_NFY_THROW,
+	KI_NFY_STATS,
 };
 
 enum ki_request
@@ -118,6 +119,8 @@ enum ki_request
 	KI_REQ_STEP_OUT,
 	KI_REQ_STEP_OVER,
 	KI_REQ_WATERMARK,
+	KI_REQ_COUNT_PROPS,
+	KI_REQ_STATS,
 };
 
 ki_atom_t*       ki_atom_new           (ki_type_t type);
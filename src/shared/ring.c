@@ -0,0 +1,225 @@
+/**
+ *  Sphere: the JavaScript game platform
+ *  Copyright (c) 2015-2025, Where'd She Go?
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of Spherical nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+
+// a ring buffer of bytes which is safe for one producer and one consumer to use
+// at the same time from different threads without any locking.  only the writer
+// ever moves `tail` and only the reader ever moves `head`; both only move
+// forward and are masked into the buffer on access, so the buffer capacity is
+// always a power of two.  ring_clear() and ring_resize() touch both ends and
+// are NOT safe to call while the other side might be using the ring.
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+
+#include "ring.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+struct ring
+{
+	uint8_t*        buffer;
+	size_t          capacity;
+	volatile size_t head;
+	size_t          mask;
+	volatile size_t tail;
+};
+
+static size_t load_acquire  (const volatile size_t* ptr);
+static void   store_release (volatile size_t* ptr, size_t value);
+
+ring_t*
+ring_new(size_t capacity)
+{
+	ring_t* ring;
+
+	if (!(ring = calloc(1, sizeof(ring_t))))
+		return NULL;
+	if (!ring_resize(ring, capacity)) {
+		free(ring);
+		return NULL;
+	}
+	return ring;
+}
+
+void
+ring_free(ring_t* it)
+{
+	if (it == NULL)
+		return;
+	free(it->buffer);
+	free(it);
+}
+
+size_t
+ring_capacity(const ring_t* it)
+{
+	return it->capacity;
+}
+
+size_t
+ring_len(const ring_t* it)
+{
+	return load_acquire(&it->tail) - load_acquire(&it->head);
+}
+
+size_t
+ring_space(const ring_t* it)
+{
+	return it->capacity - ring_len(it);
+}
+
+void
+ring_clear(ring_t* it)
+{
+	store_release(&it->head, 0);
+	store_release(&it->tail, 0);
+}
+
+size_t
+ring_peek(const ring_t* it, void* buffer, size_t size)
+{
+	size_t head;
+	size_t offset;
+	size_t part_size;
+	size_t tail;
+
+	head = load_acquire(&it->head);
+	tail = load_acquire(&it->tail);
+	if (size > tail - head)
+		size = tail - head;
+	offset = head & it->mask;
+	part_size = size < it->capacity - offset ? size : it->capacity - offset;
+	memcpy(buffer, it->buffer + offset, part_size);
+	memcpy((uint8_t*)buffer + part_size, it->buffer, size - part_size);
+	return size;
+}
+
+size_t
+ring_read(ring_t* it, void* buffer, size_t size)
+{
+	size = ring_peek(it, buffer, size);
+	return ring_skip(it, size);
+}
+
+bool
+ring_resize(ring_t* it, size_t min_capacity)
+{
+	uint8_t* new_buffer;
+	size_t   new_capacity;
+	size_t   num_bytes;
+
+	// note: this keeps any data still in the ring, but can't shrink it to less
+	//       than that.
+	num_bytes = it->buffer != NULL ? ring_len(it) : 0;
+	if (min_capacity < num_bytes)
+		min_capacity = num_bytes;
+	new_capacity = 16;
+	while (new_capacity < min_capacity)
+		new_capacity *= 2;
+	if (new_capacity == it->capacity)
+		return true;
+	if (!(new_buffer = malloc(new_capacity)))
+		return false;
+	if (it->buffer != NULL)
+		ring_peek(it, new_buffer, num_bytes);
+	free(it->buffer);
+	it->buffer = new_buffer;
+	it->capacity = new_capacity;
+	it->mask = new_capacity - 1;
+	store_release(&it->head, 0);
+	store_release(&it->tail, num_bytes);
+	return true;
+}
+
+size_t
+ring_skip(ring_t* it, size_t size)
+{
+	size_t head;
+	size_t tail;
+
+	head = load_acquire(&it->head);
+	tail = load_acquire(&it->tail);
+	if (size > tail - head)
+		size = tail - head;
+	store_release(&it->head, head + size);
+	return size;
+}
+
+size_t
+ring_write(ring_t* it, const void* data, size_t size)
+{
+	size_t head;
+	size_t offset;
+	size_t part_size;
+	size_t tail;
+
+	head = load_acquire(&it->head);
+	tail = load_acquire(&it->tail);
+	if (size > it->capacity - (tail - head))
+		size = it->capacity - (tail - head);
+	offset = tail & it->mask;
+	part_size = size < it->capacity - offset ? size : it->capacity - offset;
+	memcpy(it->buffer + offset, data, part_size);
+	memcpy(it->buffer, (const uint8_t*)data + part_size, size - part_size);
+	store_release(&it->tail, tail + size);
+	return size;
+}
+
+static size_t
+load_acquire(const volatile size_t* ptr)
+{
+#if defined(_MSC_VER)
+	size_t value;
+
+	value = *ptr;
+	MemoryBarrier();
+	return value;
+#else
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static void
+store_release(volatile size_t* ptr, size_t value)
+{
+#if defined(_MSC_VER)
+	MemoryBarrier();
+	*ptr = value;
+#else
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
@@ -0,0 +1,55 @@
+/**
+ *  Sphere: the JavaScript game platform
+ *  Copyright (c) 2015-2025, Where'd She Go?
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of Spherical nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+
+
+#ifndef SPHERE_RING_H_INCLUDED
+#define SPHERE_RING_H_INCLUDED
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct ring ring_t;
+
+ring_t* ring_new      (size_t capacity);
+void    ring_free     (ring_t* it);
+size_t  ring_capacity (const ring_t* it);
+size_t  ring_len      (const ring_t* it);
+size_t  ring_space    (const ring_t* it);
+void    ring_clear    (ring_t* it);
+size_t  ring_peek     (const ring_t* it, void* buffer, size_t size);
+size_t  ring_read     (ring_t* it, void* buffer, size_t size);
+bool    ring_resize   (ring_t* it, size_t min_capacity);
+size_t  ring_skip     (ring_t* it, size_t size);
+size_t  ring_write    (ring_t* it, const void* data, size_t size);
+
+#endif // !SPHERE_RING_H_INCLUDED
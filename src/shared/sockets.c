@@ -37,14 +37,23 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
 
 #include "console.h"
 #include "dyad.h"
+#include "ring.h"
+#include "vector.h"
+
+#define MAX_EPOLL_EVENTS 256
 
 struct server
 {
 	unsigned int refcount;
 	unsigned int id;
+	unsigned int activity;
 	size_t       buffer_size;
 	int          max_backlog;
 	int          num_backlog;
@@ -59,25 +68,45 @@ struct socket
 {
 	unsigned int refcount;
 	unsigned int id;
+	unsigned int activity;
 	size_t       buffer_size;
 	int          bytes_in;
 	int          bytes_out;
+	unsigned int next_ticket;
 	bool         no_delay;
-	uint8_t*     recv_buffer;
-	int          recv_size;
+	vector_t*    pending_reads;
+	ring_t*      recv_buffer;
 	dyad_Stream* stream;
 	bool         sync_mode;
 };
 
-static void on_dyad_accept  (dyad_Event* e);
-static void on_dyad_close   (dyad_Event* e);
-static void on_dyad_connect (dyad_Event* e);
-static void on_dyad_receive (dyad_Event* e);
+struct pending_read
+{
+	unsigned int ticket;
+	int          bytes_left;
+	uint8_t*     ptr;
+};
 
+static socket_t* new_socket      (size_t buffer_size, bool sync_mode);
+static void      watch_stream    (dyad_Stream* stream);
+static void      on_dyad_accept  (dyad_Event* e);
+static void      on_dyad_close   (dyad_Event* e);
+static void      on_dyad_connect (dyad_Event* e);
+static void      on_dyad_ready   (dyad_Event* e);
+static void      on_dyad_receive (dyad_Event* e);
+
+#if defined(__linux__)
+static int               s_epoll_fd = -1;
+#endif
 static sockets_on_idle_t s_idle_callback = NULL;
+static double            s_last_update = 0.0;
+static bool              s_need_update = true;
 static unsigned int      s_next_server_id = 1;
 static unsigned int      s_next_socket_id = 1;
 static unsigned int      s_num_refs       = 0;
+static uint64_t          s_total_bytes_in = 0;
+static uint64_t          s_total_bytes_out = 0;
+static double            s_update_timeout;
 
 bool
 sockets_init(sockets_on_idle_t idle_handler)
@@ -88,8 +117,12 @@ sockets_init(sockets_on_idle_t idle_handler)
 	console_log(1, "initializing sockets subsystem");
 	console_log(2, "    Dyad.c %s", dyad_getVersion());
 	dyad_init();
-	dyad_setUpdateTimeout(idle_handler != NULL ? 0.0 : 0.05);
+	s_update_timeout = idle_handler != NULL ? 0.0 : 0.05;
 	s_idle_callback = idle_handler;
+#if defined(__linux__)
+	if ((s_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		console_log(1, "    couldn't create epoll instance, using select()");
+#endif
 	return true;
 }
 
@@ -101,11 +134,60 @@ sockets_uninit(void)
 
 	console_log(1, "shutting down sockets subsystem");
 	dyad_shutdown();
+#if defined(__linux__)
+	if (s_epoll_fd != -1)
+		close(s_epoll_fd);
+	s_epoll_fd = -1;
+#endif
 }
 
 void
 sockets_update(void)
 {
+	sockets_wait(s_update_timeout);
+}
+
+uint64_t
+sockets_bytes_in(void)
+{
+	return s_total_bytes_in;
+}
+
+uint64_t
+sockets_bytes_out(void)
+{
+	return s_total_bytes_out;
+}
+
+void
+sockets_wait(double timeout)
+{
+#if defined(__linux__)
+	struct epoll_event events[MAX_EPOLL_EVENTS];
+	int                num_events;
+
+	// note: epoll only decides *whether* Dyad needs to run; Dyad still does the
+	//       actual I/O when it does.  with every socket watched edge-triggered,
+	//       a frame where nothing happened on the network costs a single
+	//       syscall no matter how many connections are open, and an idle game
+	//       can sleep here until something does.
+	if (s_epoll_fd != -1) {
+		if (!s_need_update) {
+			num_events = epoll_wait(s_epoll_fd, events, MAX_EPOLL_EVENTS, (int)(timeout * 1000.0));
+
+			// run Dyad at least once a second regardless, for its housekeeping.
+			if (num_events <= 0 && dyad_getTime() < s_last_update + 1.0)
+				return;
+		}
+		s_need_update = false;
+		s_last_update = dyad_getTime();
+		dyad_setUpdateTimeout(0.0);
+		dyad_update();
+		return;
+	}
+#endif
+
+	dyad_setUpdateTimeout(timeout);
 	dyad_update();
 }
 
@@ -116,11 +198,8 @@ socket_new(size_t buffer_size, bool sync_mode)
 
 	console_log(2, "creating TCP socket #%u", s_next_socket_id);
 
-	if (!(socket = calloc(1, sizeof(socket_t))))
+	if (!(socket = new_socket(buffer_size, sync_mode)))
 		return NULL;
-	socket->buffer_size = buffer_size;
-	socket->sync_mode = sync_mode;
-	socket->recv_buffer = malloc(buffer_size);
 	socket->id = s_next_socket_id++;
 	return socket_ref(socket);
 }
@@ -140,9 +219,18 @@ socket_unref(socket_t* it)
 	console_log(3, "disposing TCP socket #%u no longer in use", it->id);
 	if (it->stream != NULL)
 		dyad_close(it->stream);
+	s_need_update = true;
+	ring_free(it->recv_buffer);
+	vector_free(it->pending_reads);
 	free(it);
 }
 
+unsigned int
+socket_activity(const socket_t* it)
+{
+	return it->activity;
+}
+
 bool
 socket_get_no_delay(const socket_t* it)
 {
@@ -160,7 +248,7 @@ socket_set_no_delay(socket_t* it, bool enabled)
 int
 socket_bytes_avail(const socket_t* it)
 {
-	return it->recv_size;
+	return (int)ring_len(it->recv_buffer);
 }
 
 int
@@ -216,14 +304,16 @@ socket_connect(socket_t* it, const char* hostname, int port)
 	socket_disconnect(it);
 
 	// clear receive buffer before connection attempt
-	it->recv_size = 0;
+	ring_clear(it->recv_buffer);
 
 	it->stream = dyad_newStream();
 	dyad_addListener(it->stream, DYAD_EVENT_CLOSE, on_dyad_close, it);
 	dyad_addListener(it->stream, DYAD_EVENT_CONNECT, on_dyad_connect, it);
 	dyad_addListener(it->stream, DYAD_EVENT_DATA, on_dyad_receive, it);
+	dyad_addListener(it->stream, DYAD_EVENT_READY, on_dyad_ready, it);
 	if (dyad_connect(it->stream, hostname, port) == -1)
 		goto on_error;
+	watch_stream(it->stream);
 	return true;
 
 on_error:
@@ -250,6 +340,7 @@ socket_close(socket_t* it)
 		return;
 	console_log(2, "closing connection on TCP socket #%u", it->id);
 	dyad_end(it->stream);
+	s_need_update = true;
 }
 
 void
@@ -257,14 +348,14 @@ socket_disconnect(socket_t* it)
 {
 	if (it->stream != NULL)
 		dyad_close(it->stream);
+	s_need_update = true;
 }
 
 int
 socket_peek(socket_t* it, void* buffer, int num_bytes)
 {
-	num_bytes = num_bytes <= it->recv_size ? num_bytes : it->recv_size;
+	num_bytes = (int)ring_peek(it->recv_buffer, buffer, num_bytes);
 	console_log(4, "peeking at %d bytes from TCP socket #%u", num_bytes, it->id);
-	memcpy(buffer, it->recv_buffer, num_bytes);
 	return num_bytes;
 }
 
@@ -273,22 +364,77 @@ socket_read(socket_t* it, void* buffer, int num_bytes)
 {
 	if (it->sync_mode) {
 		// in sync mode, block until all bytes are available.
-		while (it->recv_size < num_bytes && it->stream != NULL) {
+		while ((int)ring_len(it->recv_buffer) < num_bytes && it->stream != NULL) {
 			if (s_idle_callback != NULL)
 				s_idle_callback();
 			sockets_update();
 		}
-		if (it->recv_size < num_bytes)
+		if ((int)ring_len(it->recv_buffer) < num_bytes)
 			return 0;
 	}
-	num_bytes = num_bytes <= it->recv_size ? num_bytes : it->recv_size;
+	num_bytes = (int)ring_read(it->recv_buffer, buffer, num_bytes);
 	console_log(4, "reading %d bytes from TCP socket #%u", num_bytes, it->id);
-	memcpy(buffer, it->recv_buffer, num_bytes);
-	memmove(it->recv_buffer, it->recv_buffer + num_bytes, it->recv_size - num_bytes);
-	it->recv_size -= num_bytes;
 	return num_bytes;
 }
 
+bool
+socket_read_async(socket_t* it, void* buffer, int num_bytes, unsigned int *out_ticket)
+{
+	struct pending_read read;
+	int                 num_read;
+
+	// note: whatever is already buffered goes straight into the caller's buffer;
+	//       for the rest, the buffer is queued up and filled directly from the
+	//       network as data arrives, bypassing the receive buffer entirely.
+	//       a ticket of zero means the read was completed immediately.
+	*out_ticket = 0;
+	num_read = (int)ring_read(it->recv_buffer, buffer, num_bytes);
+	console_log(4, "reading %d bytes from TCP socket #%u, %d to follow",
+		num_read, it->id, num_bytes - num_read);
+	if (num_read == num_bytes)
+		return true;
+	if (++it->next_ticket == 0)
+		++it->next_ticket;
+	read.ticket = it->next_ticket;
+	read.bytes_left = num_bytes - num_read;
+	read.ptr = (uint8_t*)buffer + num_read;
+	if (!vector_push(it->pending_reads, &read))
+		return false;
+	*out_ticket = read.ticket;
+	return true;
+}
+
+void
+socket_read_cancel(socket_t* it, unsigned int ticket)
+{
+	struct pending_read* read;
+
+	iter_t iter;
+
+	iter = vector_enum(it->pending_reads);
+	while ((read = iter_next(&iter))) {
+		if (read->ticket == ticket) {
+			iter_remove(&iter);
+			break;
+		}
+	}
+}
+
+int
+socket_read_left(const socket_t* it, unsigned int ticket)
+{
+	struct pending_read* read;
+
+	int i, len;
+
+	for (i = 0, len = vector_len(it->pending_reads); i < len; ++i) {
+		read = vector_get(it->pending_reads, i);
+		if (read->ticket == ticket)
+			return read->bytes_left;
+	}
+	return 0;
+}
+
 int
 socket_write(socket_t* it, const void* data, int num_bytes)
 {
@@ -297,6 +443,8 @@ socket_write(socket_t* it, const void* data, int num_bytes)
 
 	console_log(4, "writing %d bytes to TCP socket #%u", num_bytes, it->id);
 	dyad_write(it->stream, data, num_bytes);
+	s_total_bytes_out += num_bytes;
+	s_need_update = true;
 	if (it->sync_mode && num_bytes > 0)
 		sockets_update();
 	return num_bytes;
@@ -321,14 +469,20 @@ server_new(const char* hostname, int port, size_t buffer_size, int max_backlog,
 		if (!(server->stream4 = dyad_newStream()))
 			goto on_error;
 		dyad_addListener(server->stream4, DYAD_EVENT_ACCEPT, on_dyad_accept, server);
-		if (dyad_listenEx(server->stream4, "0.0.0.0", port, max_backlog) != 0) {
+		if (dyad_listenEx(server->stream4, "0.0.0.0", port, max_backlog) == 0) {
+			watch_stream(server->stream4);
+		}
+		else {
 			dyad_close(server->stream4);
 			server->stream4 = NULL;
 		}
 		if (!(server->stream6 = dyad_newStream()))
 			goto on_error;
 		dyad_addListener(server->stream6, DYAD_EVENT_ACCEPT, on_dyad_accept, server);
-		if (dyad_listenEx(server->stream6, "::", port, max_backlog) != 0) {
+		if (dyad_listenEx(server->stream6, "::", port, max_backlog) == 0) {
+			watch_stream(server->stream6);
+		}
+		else {
 			dyad_close(server->stream6);
 			server->stream6 = NULL;
 		}
@@ -341,6 +495,7 @@ server_new(const char* hostname, int port, size_t buffer_size, int max_backlog,
 		dyad_addListener(server->stream4, DYAD_EVENT_ACCEPT, on_dyad_accept, server);
 		if (dyad_listenEx(server->stream4, hostname, port, max_backlog) == -1)
 			goto on_error;
+		watch_stream(server->stream4);
 	}
 
 	server->id = s_next_server_id++;
@@ -380,9 +535,16 @@ server_unref(server_t* it)
 		dyad_end(it->stream4);
 	if (it->stream6 != NULL)
 		dyad_end(it->stream6);
+	s_need_update = true;
 	free(it);
 }
 
+unsigned int
+server_activity(const server_t* it)
+{
+	return it->activity;
+}
+
 int
 server_num_pending(const server_t* it)
 {
@@ -418,16 +580,14 @@ server_accept(server_t* it)
 		dyad_getPort(it->backlog[0]));
 
 	// construct a socket object for the new connection
-	if (!(client = calloc(1, sizeof(socket_t))))
+	if (!(client = new_socket(it->buffer_size, it->sync_mode)))
 		return NULL;
-	client->sync_mode = it->sync_mode;
-	client->buffer_size = it->buffer_size;
 	client->no_delay = it->no_delay;
-	client->recv_buffer = malloc(it->buffer_size);
 	client->stream = it->backlog[0];
 	dyad_setNoDelay(client->stream, client->no_delay);
 	dyad_addListener(client->stream, DYAD_EVENT_CLOSE, on_dyad_close, client);
 	dyad_addListener(client->stream, DYAD_EVENT_DATA, on_dyad_receive, client);
+	dyad_addListener(client->stream, DYAD_EVENT_READY, on_dyad_ready, client);
 
 	// we accepted the connection, remove it from the backlog
 	--it->num_backlog;
@@ -438,6 +598,48 @@ server_accept(server_t* it)
 	return socket_ref(client);
 }
 
+static socket_t*
+new_socket(size_t buffer_size, bool sync_mode)
+{
+	socket_t* socket;
+
+	if (!(socket = calloc(1, sizeof(socket_t))))
+		goto on_error;
+	if (!(socket->recv_buffer = ring_new(buffer_size)))
+		goto on_error;
+	if (!(socket->pending_reads = vector_new(sizeof(struct pending_read))))
+		goto on_error;
+	socket->buffer_size = buffer_size;
+	socket->sync_mode = sync_mode;
+	return socket;
+
+on_error:
+	if (socket != NULL) {
+		ring_free(socket->recv_buffer);
+		free(socket);
+	}
+	return NULL;
+}
+
+static void
+watch_stream(dyad_Stream* stream)
+{
+#if defined(__linux__)
+	struct epoll_event event;
+	int                fd;
+
+	fd = (int)dyad_getSocket(stream);
+	if (s_epoll_fd != -1 && fd >= 0) {
+		// note: closing the socket removes it from the epoll set automatically,
+		//       so there's no need to unwatch streams.
+		memset(&event, 0, sizeof(struct epoll_event));
+		event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		epoll_ctl(s_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+	}
+#endif
+	s_need_update = true;
+}
+
 static void
 on_dyad_accept(dyad_Event* e)
 {
@@ -449,6 +651,8 @@ on_dyad_accept(dyad_Event* e)
 		console_log(4, "taking connection from %s:%d on server #%u",
 			dyad_getAddress(e->remote), dyad_getPort(e->remote), server->id);
 		server->backlog[server->num_backlog++] = e->remote;
+		watch_stream(e->remote);
+		++server->activity;
 	}
 	else {
 		console_log(4, "backlog full on server #%u, refusing %s:%d", server->id,
@@ -467,6 +671,8 @@ on_dyad_close(dyad_Event* e)
 	socket->bytes_in = dyad_getBytesReceived(socket->stream);
 	socket->bytes_out = dyad_getBytesSent(socket->stream);
 	socket->stream = NULL;
+	++socket->activity;
+	s_need_update = true;
 }
 
 static void
@@ -477,22 +683,53 @@ on_dyad_connect(dyad_Event* e)
 	socket = e->udata;
 
 	dyad_setNoDelay(socket->stream, socket->no_delay);
+	++socket->activity;
 }
 
 static void
-on_dyad_receive(dyad_Event* e)
+on_dyad_ready(dyad_Event* e)
 {
-	size_t    new_size;
 	socket_t* socket;
 
 	socket = e->udata;
 
-	// buffer any data received until read() is called
-	new_size = socket->recv_size + e->size;
-	if (new_size > socket->buffer_size) {
-		socket->buffer_size = new_size * 2;
-		socket->recv_buffer = realloc(socket->recv_buffer, socket->buffer_size);
+	++socket->activity;
+}
+
+static void
+on_dyad_receive(dyad_Event* e)
+{
+	const uint8_t*       data;
+	struct pending_read* read;
+	int                  size;
+	socket_t*            socket;
+
+	socket = e->udata;
+	++socket->activity;
+	s_total_bytes_in += e->size;
+
+	// scatter incoming data into any pending async reads first, in the order
+	// they were made.  only what's left over goes into the receive buffer.
+	data = (const uint8_t*)e->data;
+	size = e->size;
+	while (size > 0 && vector_len(socket->pending_reads) > 0) {
+		read = vector_get(socket->pending_reads, 0);
+		if (read->bytes_left > size) {
+			memcpy(read->ptr, data, size);
+			read->ptr += size;
+			read->bytes_left -= size;
+			return;
+		}
+		memcpy(read->ptr, data, read->bytes_left);
+		data += read->bytes_left;
+		size -= read->bytes_left;
+		vector_remove(socket->pending_reads, 0);
 	}
-	memcpy(socket->recv_buffer + socket->recv_size, e->data, e->size);
-	socket->recv_size += e->size;
+	if (size == 0)
+		return;
+
+	// buffer any data received until read() is called
+	if ((size_t)size > ring_space(socket->recv_buffer))
+		ring_resize(socket->recv_buffer, ring_len(socket->recv_buffer) + size);
+	ring_write(socket->recv_buffer, data, size);
 }
@@ -35,40 +35,49 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef void (* sockets_on_idle_t) (void);
 
 typedef struct server server_t;
 typedef struct socket socket_t;
 
-bool        sockets_init         (sockets_on_idle_t idle_handler);
-void        sockets_uninit       (void);
-void        sockets_update       (void);
-server_t*   server_new           (const char* hostname, int port, size_t buffer_size, int max_backlog, bool sync_mode);
-server_t*   server_ref           (server_t* it);
-void        server_unref         (server_t* it);
-int         server_num_pending   (const server_t* it);
-bool        server_get_no_delay  (const server_t* it);
-void        server_set_no_delay  (server_t* it, bool enabled);
-socket_t*   server_accept        (server_t* it);
-socket_t*   socket_new           (size_t buffer_size, bool sync_mode);
-socket_t*   socket_ref           (socket_t* it);
-void        socket_unref         (socket_t* it);
-bool        socket_get_no_delay  (const socket_t* it);
-void        socket_set_no_delay  (socket_t* it, bool enabled);
-int         socket_bytes_avail   (const socket_t* it);
-int         socket_bytes_in      (const socket_t* it);
-int         socket_bytes_out     (const socket_t* it);
-int         socket_bytes_pending (const socket_t* it);
-bool        socket_connected     (const socket_t* it);
-bool        socket_closed        (const socket_t* it);
-const char* socket_hostname      (const socket_t* it);
-int         socket_port          (const socket_t* it);
-void        socket_close         (socket_t* it);
-bool        socket_connect       (socket_t* it, const char* hostname, int port);
-void        socket_disconnect    (socket_t* it);
-int         socket_peek          (socket_t* it, void* buffer, int num_bytes);
-int         socket_read          (socket_t* it, void* buffer, int num_bytes);
-int         socket_write         (socket_t* it, const void* data, int num_bytes);
+bool         sockets_init         (sockets_on_idle_t idle_handler);
+void         sockets_uninit       (void);
+void         sockets_update       (void);
+uint64_t     sockets_bytes_in     (void);
+uint64_t     sockets_bytes_out    (void);
+void         sockets_wait         (double timeout);
+server_t*    server_new           (const char* hostname, int port, size_t buffer_size, int max_backlog, bool sync_mode);
+server_t*    server_ref           (server_t* it);
+void         server_unref         (server_t* it);
+unsigned int server_activity      (const server_t* it);
+int          server_num_pending   (const server_t* it);
+bool         server_get_no_delay  (const server_t* it);
+void         server_set_no_delay  (server_t* it, bool enabled);
+socket_t*    server_accept        (server_t* it);
+socket_t*    socket_new           (size_t buffer_size, bool sync_mode);
+socket_t*    socket_ref           (socket_t* it);
+void         socket_unref         (socket_t* it);
+unsigned int socket_activity      (const socket_t* it);
+bool         socket_get_no_delay  (const socket_t* it);
+void         socket_set_no_delay  (socket_t* it, bool enabled);
+int          socket_bytes_avail   (const socket_t* it);
+int          socket_bytes_in      (const socket_t* it);
+int          socket_bytes_out     (const socket_t* it);
+int          socket_bytes_pending (const socket_t* it);
+bool         socket_connected     (const socket_t* it);
+bool         socket_closed        (const socket_t* it);
+const char*  socket_hostname      (const socket_t* it);
+int          socket_port          (const socket_t* it);
+void         socket_close         (socket_t* it);
+bool         socket_connect       (socket_t* it, const char* hostname, int port);
+void         socket_disconnect    (socket_t* it);
+int          socket_peek          (socket_t* it, void* buffer, int num_bytes);
+int          socket_read          (socket_t* it, void* buffer, int num_bytes);
+bool         socket_read_async    (socket_t* it, void* buffer, int num_bytes, unsigned int *out_ticket);
+void         socket_read_cancel   (socket_t* it, unsigned int ticket);
+int          socket_read_left     (const socket_t* it, unsigned int ticket);
+int          socket_write         (socket_t* it, const void* data, int num_bytes);
 
 #endif // !SPHERE_SOCKETS_H_INCLUDED
@@ -53,6 +53,7 @@ help_print(const char* command_name)
 			" s,  stepover     Run the next line of code                                    \n"
 			" si, stepin       Run the next line of code, stepping into functions           \n"
 			" so, stepout      Run until the current function call returns                  \n"
+			" st, stats        Show engine performance counters, e.g. frame time and memory \n"
 			" v,  vars         List local variables and their values in the active frame    \n"
 			" u,  up           Move up the call stack (outwards) from the selected frame    \n"
 			" w,  where        Show the filename and line number of the next line of code   \n"
@@ -79,9 +80,16 @@ help_print(const char* command_name)
 			"in control.                                                                    \n\n"
 			"The ID number of the set breakpoint will be given, which will be needed if you \n"
 			"want to clear it later using 'clear'.                                          \n\n"
+			"Options can be given after <file:line> to make the breakpoint more selective.  \n"
+			"These are checked by the engine, so they don't slow the game down as much as   \n"
+			"pausing every time would:                                                      \n\n"
+			"    hits <n>    - only pause from the <n>th time the breakpoint is reached     \n"
+			"    if <expr>   - only pause when the JavaScript expression <expr> is truthy   \n"
+			"    log <text>  - don't pause, just log <text>, e.g. 'log x is ${x}'           \n\n"
 			"SYNTAX:                                                                        \n"
-			"    breakpoint             - to list active breakpoints                        \n"
-			"    breakpoint <file:line> - to set a breakpoint                               \n"
+			"    breakpoint                                    - to list breakpoints        \n"
+			"    breakpoint <file:line> [hits <n>] [if <expr>] - to set a breakpoint        \n"
+			"    breakpoint <file:line> [hits <n>] log <text>  - to set a log point         \n"
 		);
 	}
 	else if (strcmp(command_name, "clear") == 0) {
@@ -134,9 +142,12 @@ help_print(const char* command_name)
 			"Each object in the output includes a numeric handle preceded by an asterisk,   \n"
 			"e.g. '*123'.  These are called 'quick refs', and they let you drill down into  \n"
 			"nested objects by using `examine` on the handle.  For instance, `x *123`.      \n\n"
+			"Large objects are shown 50 properties at a time.  Press Enter at the prompt to \n"
+			"see the next page, or provide a starting index after a quick ref to jump ahead,\n"
+			"e.g. `x *123 500`.                                                             \n\n"
 			"SHORT NAME: x                                                                  \n"
 			"SYNTAX:                                                                        \n"
-			"    examine <quick-ref>                                                        \n"
+			"    examine <quick-ref> [<start>]                                              \n"
 			"    examine <expr>                                                             \n"
 		);
 	}
@@ -179,6 +190,24 @@ help_print(const char* command_name)
 			"    stepin                                                                     \n"
 		);
 	}
+	else if (strcmp(command_name, "stats") == 0) {
+		printf(
+			"Show the engine's performance counters: frame times, time spent in each phase  \n"
+			"of the event loop, Dispatch queue sizes, JavaScript memory use and garbage     \n"
+			"collections, texture memory, active sounds, network traffic and asset cache    \n"
+			"usage.  'js.limit_bytes' is the limit set with 'spherun --memory-limit' (0 =   \n"
+			"none) and 'js.alloc_failures' counts allocations refused because of it.        \n"
+			"'gfx.draws_saved' is how many draw calls batching saved in the last frame.     \n\n"
+			"Use 'stats on' to have the engine send these once a second while the game is   \n"
+			"running, which lets you watch a running build without a profiler.  'stats off' \n"
+			"stops them again.                                                              \n\n"
+			"SHORT NAME: st                                                                 \n"
+			"SYNTAX:                                                                        \n"
+			"    stats                                                                      \n"
+			"    stats on                                                                   \n"
+			"    stats off                                                                  \n"
+		);
+	}
 	else if (strcmp(command_name, "stepout") == 0) {
 		printf(
 			"Continue execution until the active function call returns.  Execution will     \n"
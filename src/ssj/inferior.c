@@ -74,6 +74,7 @@ struct inferior
 static void clear_pause_cache (inferior_t* obj);
 static int  do_handshake      (socket_t* socket);
 static bool handle_notify     (inferior_t* obj, const ki_message_t* msg);
+static void print_stats       (const ki_message_t* msg, int index, bool compact);
 
 static unsigned int s_next_inferior_id = 1;
 
@@ -318,7 +319,7 @@ on_error:
 }
 
 objview_t*
-inferior_get_object(inferior_t* it, unsigned int handle, bool get_all)
+inferior_get_object(inferior_t* it, unsigned int handle, int start, int count)
 {
 	int              attributes;
 	unsigned int     flags;
@@ -335,8 +336,8 @@ inferior_get_object(inferior_t* it, unsigned int handle, bool get_all)
 	request = ki_message_new(KI_REQ);
 	ki_message_add_int(request, KI_REQ_INSPECT_OBJ);
 	ki_message_add_ref(request, handle);
-	ki_message_add_int(request, 0);
-	ki_message_add_int(request, INT_MAX);
+	ki_message_add_int(request, start);
+	ki_message_add_int(request, count);
 	if (!(request = inferior_request(it, request)))
 		return NULL;
 	view = objview_new();
@@ -403,15 +404,26 @@ inferior_get_vars(inferior_t* it, int frame)
 }
 
 int
-inferior_add_breakpoint(inferior_t* it, const char* filename, int linenum)
+inferior_add_breakpoint(inferior_t* it, const char* filename, int linenum, const char* condition, int hit_count, const char* log_expr)
 {
-	int        handle;
+	int           handle;
 	ki_message_t* msg;
 
+	// note: engines speaking KI v2 or earlier would silently ignore the extra options
+	//       and set an unconditional breakpoint, which isn't what the user asked for.
+	if (it->protocol < 3 && (condition != NULL || hit_count > 0 || log_expr != NULL)) {
+		printf("conditional breakpoints aren't supported by this engine.\n");
+		return -1;
+	}
 	msg = ki_message_new(KI_REQ);
 	ki_message_add_int(msg, KI_REQ_ADD_BREAK);
 	ki_message_add_string(msg, filename);
 	ki_message_add_int(msg, linenum);
+	if (it->protocol >= 3) {
+		ki_message_add_string(msg, condition != NULL ? condition : "");
+		ki_message_add_int(msg, hit_count);
+		ki_message_add_string(msg, log_expr != NULL ? log_expr : "");
+	}
 	if (!(msg = inferior_request(it, msg)))
 		goto on_error;
 	if (ki_message_tag(msg) == KI_ERR)
@@ -445,6 +457,28 @@ on_error:
 	return false;
 }
 
+int
+inferior_count_props(inferior_t* it, unsigned int handle)
+{
+	ki_message_t* msg;
+	int           num_props;
+
+	// note: engines speaking KI v1 don't support this request and will send
+	//       back an empty reply, so don't even bother asking.
+	if (it->protocol < 2)
+		return -1;
+	msg = ki_message_new(KI_REQ);
+	ki_message_add_int(msg, KI_REQ_COUNT_PROPS);
+	ki_message_add_ref(msg, handle);
+	if (!(msg = inferior_request(it, msg)))
+		return -1;
+	num_props = -1;
+	if (ki_message_tag(msg) != KI_ERR && ki_message_len(msg) >= 1)
+		num_props = ki_message_int(msg, 0);
+	ki_message_free(msg);
+	return num_props;
+}
+
 void
 inferior_detach(inferior_t* it)
 {
@@ -532,6 +566,30 @@ inferior_resume(inferior_t* it, resume_op_t op)
 	return true;
 }
 
+bool
+inferior_show_stats(inferior_t* it, int interval_ms)
+{
+	ki_message_t* msg;
+
+	if (it->protocol < 4) {
+		printf("engine stats aren't supported by this engine.\n");
+		return false;
+	}
+	msg = ki_message_new(KI_REQ);
+	ki_message_add_int(msg, KI_REQ_STATS);
+	if (interval_ms >= 0)
+		ki_message_add_int(msg, interval_ms);
+	if (!(msg = inferior_request(it, msg)))
+		return false;
+	if (ki_message_tag(msg) == KI_ERR) {
+		ki_message_free(msg);
+		return false;
+	}
+	print_stats(msg, 0, false);
+	ki_message_free(msg);
+	return true;
+}
+
 static void
 clear_pause_cache(inferior_t* inferior)
 {
@@ -613,6 +671,9 @@ handle_notify(inferior_t* inferior, const ki_message_t* msg)
 			inferior->paused = false;
 			clear_pause_cache(inferior);
 			break;
+		case KI_NFY_STATS:
+			print_stats(msg, 1, true);
+			break;
 		case KI_NFY_THROW:
 			if ((status_type = ki_message_int(msg, 1)) == 0)
 				break;
@@ -626,3 +687,33 @@ handle_notify(inferior_t* inferior, const ki_message_t* msg)
 	}
 	return true;
 }
+
+static void
+print_stats(const ki_message_t* msg, int index, bool compact)
+{
+	const char* name;
+	size_t      name_len;
+	double      value;
+
+	if (compact)
+		printf("\33[30;1mstats:");
+	for (; index + 1 < ki_message_len(msg); index += 2) {
+		name = ki_message_string(msg, index);
+		value = ki_message_number(msg, index + 1);
+		name_len = strlen(name);
+		if (compact)
+			printf(" %s=", name);
+		else
+			printf("    %-20s ", name);
+		if (name_len > 6 && strcmp(name + name_len - 6, "_bytes") == 0)
+			printf("%.1f KiB", value / 1024.0);
+		else if (name_len > 3 && strcmp(name + name_len - 3, "_ms") == 0)
+			printf("%.2f", value);
+		else
+			printf("%.0f", value);
+		if (!compact)
+			printf("\n");
+	}
+	if (compact)
+		printf("\33[m\n");
+}
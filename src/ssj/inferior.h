@@ -60,14 +60,16 @@ bool               inferior_running          (const inferior_t* it);
 const char*        inferior_title            (const inferior_t* it);
 const backtrace_t* inferior_get_calls        (inferior_t* it);
 const listing_t*   inferior_get_listing      (inferior_t* it, const char* filename);
-objview_t*         inferior_get_object       (inferior_t* it, unsigned int handle, bool get_all);
+objview_t*         inferior_get_object       (inferior_t* it, unsigned int handle, int start, int count);
 objview_t*         inferior_get_vars         (inferior_t* it, int frame);
-int                inferior_add_breakpoint   (inferior_t* it, const char* filename, int linenum);
+int                inferior_add_breakpoint   (inferior_t* it, const char* filename, int linenum, const char* condition, int hit_count, const char* log_expr);
 bool               inferior_clear_breakpoint (inferior_t* it, int handle);
+int                inferior_count_props      (inferior_t* it, unsigned int handle);
 void               inferior_detach           (inferior_t* it);
 ki_atom_t*         inferior_eval             (inferior_t* it, const char* expr, int frame, bool* out_is_error);
 bool               inferior_pause            (inferior_t* it);
 ki_message_t*      inferior_request          (inferior_t* it, ki_message_t* msg);
 bool               inferior_resume           (inferior_t* it, resume_op_t op);
+bool               inferior_show_stats       (inferior_t* it, int interval_ms);
 
 #endif // !SSJ_INFERIOR_H_INCLUDED
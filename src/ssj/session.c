@@ -37,11 +37,14 @@
 #include "inferior.h"
 #include "parser.h"
 
+#define EXAMINE_PAGE_SIZE 50
+
 enum auto_action
 {
 	AUTO_NONE,
 	AUTO_LIST,
 	AUTO_CONTINUE,
+	AUTO_EXAMINE,
 	AUTO_STEP_IN,
 	AUTO_STEP_OUT,
 	AUTO_STEP_OVER,
@@ -51,14 +54,20 @@ enum auto_action
 struct breakpoint
 {
 	int   handle;
+	char* condition;
 	char* filename;
+	int   hit_count;
 	int   linenum;
+	char* log_text;
 };
 
 struct session
 {
 	enum auto_action   auto_action;
 	struct breakpoint* breaks;
+	unsigned int       examine_handle;
+	int                examine_offset;
+	bool               examine_verbose;
 	int                frame;
 	inferior_t*        inferior;
 	int                list_num_lines;
@@ -83,6 +92,7 @@ command_db[] =
 	"stepover",   "s",  "",
 	"stepin",     "si", "",
 	"stepout",    "so", "",
+	"stats",      "st", "~s",
 	"up",         "u",  "~n",
 	"vars",       "v",  "",
 	"where",      "w",  "",
@@ -103,11 +113,14 @@ static void        handle_frame      (session_t* session, command_t* cmd);
 static void        handle_help       (session_t* session, command_t* cmd);
 static void        handle_list       (session_t* session, command_t* cmd);
 static void        handle_resume     (session_t* session, command_t* cmd, resume_op_t op);
+static void        handle_stats      (session_t* session, command_t* cmd);
 static void        handle_up_down    (session_t* session, command_t* cmd, int direction);
 static void        handle_vars       (session_t* session, command_t* cmd);
 static void        handle_where      (session_t* session, command_t* cmd);
 static void        handle_quit       (session_t* session, command_t* cmd);
+static char*       log_template      (const char* text);
 static void        preview_frame     (session_t* session, int frame);
+static void        print_breakpoint  (const session_t* session, int index);
 static bool        validate_args     (const command_t* command, const char* verb_name, const char* pattern);
 
 session_t*
@@ -254,6 +267,12 @@ do_command_line(session_t* session)
 		case AUTO_CONTINUE:
 			command = command_parse("continue");
 			break;
+		case AUTO_EXAMINE:
+			synth = strnewf("%s *%u %d", session->examine_verbose ? "examine" : "eval",
+				session->examine_handle, session->examine_offset);
+			command = command_parse(synth);
+			free(synth);
+			break;
 		case AUTO_LIST:
 			synth = strnewf("list %d \"%s\":%d", session->list_num_lines, session->list_filename, session->list_linenum);
 			command = command_parse(synth);
@@ -321,6 +340,8 @@ do_command_line(session_t* session)
 		handle_resume(session, command, OP_STEP_IN);
 	else if (strcmp(verb, "stepout") == 0)
 		handle_resume(session, command, OP_STEP_OUT);
+	else if (strcmp(verb, "stats") == 0)
+		handle_stats(session, command);
 	else if (strcmp(verb, "vars") == 0)
 		handle_vars(session, command);
 	else if (strcmp(verb, "where") == 0)
@@ -360,10 +381,15 @@ handle_backtrace(session_t* session, command_t* cmd)
 static void
 handle_breakpoint(session_t* session, command_t* cmd)
 {
+	const char*        condition = NULL;
 	const char*        filename;
 	int                handle;
+	int                hit_count = 0;
+	const char*        keyword;
 	int                linenum;
 	const listing_t*   listing;
+	char*              log_expr = NULL;
+	const char*        log_text = NULL;
 	struct breakpoint* new_breaks;
 
 	int i;
@@ -374,40 +400,71 @@ handle_breakpoint(session_t* session, command_t* cmd)
 		}
 		else {
 			for (i = 0; i < session->num_breaks; ++i) {
-				printf("#%2d: breakpoint at %s:%d\n", i,
-					session->breaks[i].filename,
-					session->breaks[i].linenum);
+				printf("#%2d: ", i);
+				print_breakpoint(session, i);
 			}
 		}
 	}
 	else {
 		filename = command_get_string(cmd, 1);
 		linenum = command_get_int(cmd, 1);
-		if ((handle = inferior_add_breakpoint(session->inferior, filename, linenum)) < 0)
+
+		// parse breakpoint options: [hits <n>] [if <expr> | log <text>]
+		i = 2;
+		while (i < command_len(cmd)) {
+			keyword = command_get_string(cmd, i);
+			if (keyword != NULL && strcmp(keyword, "hits") == 0 && i + 1 < command_len(cmd)
+				&& command_get_tag(cmd, i + 1) == TOK_NUMBER)
+			{
+				hit_count = command_get_int(cmd, i + 1);
+				i += 2;
+			}
+			else if (keyword != NULL && strcmp(keyword, "if") == 0 && i + 1 < command_len(cmd)) {
+				condition = command_get_rest(cmd, i + 1);
+				break;
+			}
+			else if (keyword != NULL && strcmp(keyword, "log") == 0 && i + 1 < command_len(cmd)) {
+				log_text = command_get_rest(cmd, i + 1);
+				break;
+			}
+			else {
+				printf("'breakpoint': invalid option '%s'.\n", command_get_rest(cmd, i));
+				printf("type 'help breakpoint' for usage.\n");
+				return;
+			}
+		}
+		if (log_text != NULL)
+			log_expr = log_template(log_text);
+
+		handle = inferior_add_breakpoint(session->inferior, filename, linenum, condition, hit_count, log_expr);
+		free(log_expr);
+		if (handle < 0)
 			goto on_error;
 		if (!(new_breaks = realloc(session->breaks, (session->num_breaks + 1) * sizeof(struct breakpoint))))
 			goto on_error;
 		i = session->num_breaks++;
 		new_breaks[i].handle = handle;
-		new_breaks[i].filename = strdup(command_get_string(cmd, 1));
-		new_breaks[i].linenum = command_get_int(cmd, 1);
-		printf("breakpoint #%2d set at %s:%d.\n", i,
-			new_breaks[i].filename,
-			new_breaks[i].linenum);
+		new_breaks[i].filename = strdup(filename);
+		new_breaks[i].linenum = linenum;
+		new_breaks[i].condition = condition != NULL ? strdup(condition) : NULL;
+		new_breaks[i].hit_count = hit_count;
+		new_breaks[i].log_text = log_text != NULL ? strdup(log_text) : NULL;
 		session->breaks = new_breaks;
+		printf("breakpoint #%2d set: ", i);
+		print_breakpoint(session, i);
 		if ((listing = inferior_get_listing(session->inferior, filename)))
 			listing_print(listing, linenum, 1, 0);
 	}
 	return;
 
 on_error:
-	printf("SSj was unable to set the breakpoint.");
+	printf("SSj was unable to set the breakpoint.\n");
 }
 
 static void
 handle_clear(session_t* session, command_t* cmd)
 {
-	const char*      filename;
+	char*            filename;
 	int              handle;
 	int              index;
 	int              linenum;
@@ -426,13 +483,14 @@ handle_clear(session_t* session, command_t* cmd)
 		linenum = session->breaks[index].linenum;
 		if (!inferior_clear_breakpoint(session->inferior, handle))
 			return;
-		free(session->breaks[index].filename);
-		--session->num_breaks;
-		memmove(session->breaks + index, session->breaks + index + 1, sizeof(struct breakpoint) * (session->num_breaks - index));
-		printf("cleared breakpoint #%2d at %s:%d.\n", index,
-			session->breaks[index].filename, session->breaks[index].linenum);
+		printf("cleared breakpoint #%2d at %s:%d.\n", index, filename, linenum);
 		if ((listing = inferior_get_listing(session->inferior, filename)))
 			listing_print(listing, linenum, 1, 0);
+		free(session->breaks[index].condition);
+		free(session->breaks[index].log_text);
+		free(filename);
+		--session->num_breaks;
+		memmove(session->breaks + index, session->breaks + index + 1, sizeof(struct breakpoint) * (session->num_breaks - index));
 	}
 }
 
@@ -461,6 +519,29 @@ handle_resume(session_t* session, command_t* cmd, resume_op_t op)
 	}
 }
 
+static void
+handle_stats(session_t* session, command_t* cmd)
+{
+	const char* option;
+
+	if (command_len(cmd) < 2) {
+		inferior_show_stats(session->inferior, -1);
+		return;
+	}
+	option = command_get_string(cmd, 1);
+	if (strcmp(option, "on") == 0) {
+		if (inferior_show_stats(session->inferior, 1000))
+			printf("engine stats will be shown once a second while the game is running.\n");
+	}
+	else if (strcmp(option, "off") == 0) {
+		if (inferior_show_stats(session->inferior, 0))
+			printf("engine stats will no longer be shown while the game is running.\n");
+	}
+	else {
+		printf("'stats': expected 'on' or 'off', got '%s'.\n", option);
+	}
+}
+
 static void
 handle_eval(session_t* session, command_t* cmd, bool verbose)
 {
@@ -471,16 +552,22 @@ handle_eval(session_t* session, command_t* cmd, bool verbose)
 	bool             is_accessor;
 	bool             is_error = false;
 	int              max_len = 0;
+	int              num_props = -1;
 	objview_t*       object;
 	unsigned int     prop_flags;
 	const char*      prop_key;
 	ki_atom_t*       result;
 	const ki_atom_t* setter;
+	int              start = 0;
 
 	int i = 0;
 
 	if (command_get_tag(cmd, 1) == TOK_REF) {
 		handle = command_get_handle(cmd, 1);
+		if (command_len(cmd) >= 3)
+			start = command_get_int(cmd, 2);
+		if (start < 0)
+			start = 0;
 	}
 	else {
 		expr = command_get_rest(cmd, 1);
@@ -499,14 +586,22 @@ handle_eval(session_t* session, command_t* cmd, bool verbose)
 		}
 	}
 
-	if (!(object = inferior_get_object(session->inferior, handle, verbose)))
+	// note: huge objects (e.g. arrays with thousands of elements) are fetched one page
+	//       at a time.  pressing Enter at the prompt fetches the next page.
+	if (!(object = inferior_get_object(session->inferior, handle, start, EXAMINE_PAGE_SIZE)))
 		return;
-	if (is_error)
-		printf("\33[31;1m");
+	if (start > 0 || objview_len(object) >= EXAMINE_PAGE_SIZE)
+		num_props = inferior_count_props(session->inferior, handle);
 	if (objview_len(object) == 0) {
-		printf("object has no properties or doesn't exist.\n");
+		if (start > 0)
+			printf("no more properties to show.\n");
+		else
+			printf("object has no properties or doesn't exist.\n");
+		objview_free(object);
 		return;
 	}
+	if (is_error)
+		printf("\33[31;1m");
 	if (!verbose)
 		printf("= {\n");
 	for (i = 0; i < objview_len(object); ++i) {
@@ -543,11 +638,25 @@ handle_eval(session_t* session, command_t* cmd, bool verbose)
 		}
 		printf("\n");
 	}
-	objview_free(object);
+	if (num_props > start + objview_len(object)) {
+		if (!verbose)
+			printf("    ...\n");
+		session->examine_handle = handle;
+		session->examine_offset = start + objview_len(object);
+		session->examine_verbose = verbose;
+		session->auto_action = AUTO_EXAMINE;
+	}
 	if (!verbose)
 		printf("}\n");
 	if (is_error)
 		printf("\33[m");
+	if (num_props > 0) {
+		printf("showing %d-%d of %d properties", start + 1, start + objview_len(object), num_props);
+		if (session->auto_action == AUTO_EXAMINE)
+			printf(", press Enter for more");
+		printf(".\n");
+	}
+	objview_free(object);
 }
 
 static void
@@ -713,6 +822,30 @@ handle_quit(session_t* session, command_t* cmd)
 	inferior_detach(session->inferior);
 }
 
+static char*
+log_template(const char* text)
+{
+	// log points are evaluated engine-side as a template literal, so that e.g.
+	// 'x is ${x}' works as expected.  backticks in the text need to be escaped.
+
+	char*       buffer;
+	const char* p_in;
+	char*       p_out;
+
+	if (!(buffer = malloc(strlen(text) * 2 + 3)))
+		return NULL;
+	p_out = buffer;
+	*p_out++ = '`';
+	for (p_in = text; *p_in != '\0'; ++p_in) {
+		if (*p_in == '`')
+			*p_out++ = '\\';
+		*p_out++ = *p_in;
+	}
+	*p_out++ = '`';
+	*p_out = '\0';
+	return buffer;
+}
+
 static void
 preview_frame(session_t* session, int frame)
 {
@@ -736,6 +869,23 @@ preview_frame(session_t* session, int frame)
 	}
 }
 
+static void
+print_breakpoint(const session_t* session, int index)
+{
+	const struct breakpoint* breakpoint;
+
+	breakpoint = &session->breaks[index];
+	printf("%s %s:%d", breakpoint->log_text != NULL ? "log point" : "breakpoint",
+		breakpoint->filename, breakpoint->linenum);
+	if (breakpoint->hit_count > 0)
+		printf(" from hit %d on", breakpoint->hit_count);
+	if (breakpoint->condition != NULL)
+		printf(" if %s", breakpoint->condition);
+	if (breakpoint->log_text != NULL)
+		printf(" log '%s'", breakpoint->log_text);
+	printf("\n");
+}
+
 static bool
 validate_args(const command_t* command, const char* verb_name, const char* pattern)
 {